@@ -114,6 +114,22 @@ static ngx_command_t  ngx_core_commands[] = {
         NULL
     },
 
+    {   ngx_string("worker_pool_cache"),
+        NGX_MAIN_CONF | NGX_DIRECT_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_num_slot,
+        0,
+        offsetof(ngx_core_conf_t, pool_cache),
+        NULL
+    },
+
+    {   ngx_string("slab_reserve"),
+        NGX_MAIN_CONF | NGX_DIRECT_CONF | NGX_CONF_TAKE1,
+        ngx_conf_set_num_slot,
+        0,
+        offsetof(ngx_core_conf_t, slab_reserve),
+        NULL
+    },
+
     {   ngx_string("worker_rlimit_nofile"),
         NGX_MAIN_CONF | NGX_DIRECT_CONF | NGX_CONF_TAKE1,
         ngx_conf_set_num_slot,
@@ -996,6 +1012,8 @@ ngx_core_module_create_conf(ngx_cycle_t *cycle)
 
     ccf->worker_processes = NGX_CONF_UNSET;
     ccf->debug_points = NGX_CONF_UNSET;
+    ccf->pool_cache = NGX_CONF_UNSET;
+    ccf->slab_reserve = NGX_CONF_UNSET;
 
     ccf->rlimit_nofile = NGX_CONF_UNSET;
     ccf->rlimit_core = NGX_CONF_UNSET;
@@ -1030,6 +1048,8 @@ ngx_core_module_init_conf(ngx_cycle_t *cycle, void *conf)
 
     ngx_conf_init_value(ccf->worker_processes, 1);
     ngx_conf_init_value(ccf->debug_points, 0);
+    ngx_conf_init_value(ccf->pool_cache, 64);
+    ngx_conf_init_value(ccf->slab_reserve, 0);
 
 #if (NGX_HAVE_CPU_AFFINITY)
 
@@ -104,6 +104,13 @@ typedef intptr_t        ngx_flag_t;
 #define ngx_abort       abort
 
 
+#if (NGX_HAVE_GCC_PREFETCH)
+#define ngx_prefetch(p)  __builtin_prefetch(p)
+#else
+#define ngx_prefetch(p)
+#endif
+
+
 /* TODO: platform specific: array[NGX_INVALID_ARRAY_INDEX] must cause SIGSEGV */
 #define NGX_INVALID_ARRAY_INDEX 0x80000000
 
@@ -88,6 +88,45 @@ ngx_create_listening(ngx_conf_t *cf, void *sockaddr, socklen_t socklen)
 }
 
 
+// listen ... reuseport: 每个worker进程各自一个监听socket，
+// 第0个就是ls本身，这里再为其余的worker复制出ls，由内核在它们之间分发新连接
+ngx_int_t
+ngx_clone_listening(ngx_conf_t *cf, ngx_listening_t *ls)
+{
+#if (NGX_HAVE_REUSEPORT)
+
+    ngx_int_t         n;
+    ngx_core_conf_t  *ccf;
+    ngx_listening_t   ols;
+
+    if (!ls->reuseport) {
+        return NGX_OK;
+    }
+
+    ols = *ls;
+
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cf->cycle->conf_ctx,
+                                           ngx_core_module);
+
+    for (n = 1; n < ccf->worker_processes; n++) {
+
+        /* create a socket for each worker process */
+
+        ls = ngx_array_push(&cf->cycle->listening);
+        if (ls == NULL) {
+            return NGX_ERROR;
+        }
+
+        *ls = ols;
+        ls->worker = n;
+    }
+
+#endif
+
+    return NGX_OK;
+}
+
+
 ngx_int_t
 ngx_set_inherited_sockets(ngx_cycle_t *cycle)
 {
@@ -95,6 +134,9 @@ ngx_set_inherited_sockets(ngx_cycle_t *cycle)
     ngx_uint_t                 i;
     ngx_listening_t           *ls;
     socklen_t                  olen;
+#if (NGX_HAVE_REUSEPORT)
+    int                        reuseport;
+#endif
 #if (NGX_HAVE_DEFERRED_ACCEPT && defined SO_ACCEPTFILTER)
     ngx_err_t                  err;
     struct accept_filter_arg   af;
@@ -190,6 +232,25 @@ ngx_set_inherited_sockets(ngx_cycle_t *cycle)
             ls[i].sndbuf = -1;
         }
 
+#if (NGX_HAVE_REUSEPORT)
+
+        reuseport = 0;
+        olen = sizeof(int);
+
+        if (getsockopt(ls[i].fd, SOL_SOCKET, SO_REUSEPORT,
+                       (void *) &reuseport, &olen)
+            == -1)
+        {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                          "getsockopt(SO_REUSEPORT) %V failed, ignored",
+                          &ls[i].addr_text);
+
+        } else {
+            ls[i].reuseport = reuseport ? 1 : 0;
+        }
+
+#endif
+
 #if 0
         /* SO_SETFIB is currently a set only option */
 
@@ -300,6 +361,31 @@ ngx_open_listening_sockets(ngx_cycle_t *cycle)
                 continue;
             }
 
+#if (NGX_HAVE_REUSEPORT)
+
+            if (ls[i].add_reuseport) {
+
+                /*
+                 * to allow transition from a socket without SO_REUSEPORT
+                 * to multiple sockets with SO_REUSEPORT, we have to set
+                 * SO_REUSEPORT on the old socket before opening new ones
+                 */
+
+                int  reuseport = 1;
+
+                if (setsockopt(ls[i].fd, SOL_SOCKET, SO_REUSEPORT,
+                               (const void *) &reuseport, sizeof(int))
+                    == -1)
+                {
+                    ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_socket_errno,
+                                  "setsockopt(SO_REUSEPORT) %V failed, ignored",
+                                  &ls[i].addr_text);
+                }
+
+                ls[i].add_reuseport = 0;
+            }
+#endif
+
             if (ls[i].fd != -1) {
                 continue;
             }
@@ -338,6 +424,32 @@ ngx_open_listening_sockets(ngx_cycle_t *cycle)
                 return NGX_ERROR;
             }
 
+#if (NGX_HAVE_REUSEPORT)
+
+            if (ls[i].reuseport) {
+                int  reuseport;
+
+                reuseport = 1;
+
+                if (setsockopt(s, SOL_SOCKET, SO_REUSEPORT,
+                               (const void *) &reuseport, sizeof(int))
+                    == -1)
+                {
+                    ngx_log_error(NGX_LOG_EMERG, log, ngx_socket_errno,
+                                  "setsockopt(SO_REUSEPORT) %V failed",
+                                  &ls[i].addr_text);
+
+                    if (ngx_close_socket(s) == -1) {
+                        ngx_log_error(NGX_LOG_EMERG, log, ngx_socket_errno,
+                                      ngx_close_socket_n " %V failed",
+                                      &ls[i].addr_text);
+                    }
+
+                    return NGX_ERROR;
+                }
+            }
+#endif
+
 #if (NGX_HAVE_INET6 && defined IPV6_V6ONLY)
 
             if (ls[i].sockaddr->sa_family == AF_INET6) {
@@ -761,9 +873,10 @@ ngx_close_listening_sockets(ngx_cycle_t *cycle)
 ngx_connection_t *
 ngx_get_connection(ngx_socket_t s, ngx_log_t *log)
 {
-    ngx_uint_t         instance;
-    ngx_event_t       *rev, *wev;
-    ngx_connection_t  *c;
+    ngx_uint_t              instance;
+    ngx_event_t            *rev, *wev;
+    ngx_connection_t       *c;
+    ngx_connection_cold_t  *cold;
 
     /* disable warning: Win32 SOCKET is u_int while UNIX socket is int */
 
@@ -806,11 +919,14 @@ ngx_get_connection(ngx_socket_t s, ngx_log_t *log)
 
     rev = c->read;
     wev = c->write;
+    cold = c->cold;
 
     ngx_memzero(c, sizeof(ngx_connection_t));
+    ngx_memzero(cold, sizeof(ngx_connection_cold_t));
 
     c->read = rev;
     c->write = wev;
+    c->cold = cold;
     c->fd = s;
     c->log = log;
 
@@ -979,7 +1095,7 @@ ngx_reusable_connection(ngx_connection_t *c, ngx_uint_t reusable)
                    "reusable connection: %ui", reusable);
 
     if (c->reusable) {
-        ngx_queue_remove(&c->queue);
+        ngx_queue_remove(&c->cold->queue);
 
 #if (NGX_STAT_STUB)
         (void) ngx_atomic_fetch_add(ngx_stat_waiting, -1);
@@ -992,7 +1108,8 @@ ngx_reusable_connection(ngx_connection_t *c, ngx_uint_t reusable)
         /* need cast as ngx_cycle is volatile */
 
         ngx_queue_insert_head(
-            (ngx_queue_t *) &ngx_cycle->reusable_connections_queue, &c->queue);
+            (ngx_queue_t *) &ngx_cycle->reusable_connections_queue,
+            &c->cold->queue);
 
 #if (NGX_STAT_STUB)
         (void) ngx_atomic_fetch_add(ngx_stat_waiting, 1);
@@ -1004,9 +1121,10 @@ ngx_reusable_connection(ngx_connection_t *c, ngx_uint_t reusable)
 static void
 ngx_drain_connections(void)
 {
-    ngx_int_t          i;
-    ngx_queue_t       *q;
-    ngx_connection_t  *c;
+    ngx_int_t               i;
+    ngx_queue_t            *q;
+    ngx_connection_t       *c;
+    ngx_connection_cold_t  *cold;
 
     for (i = 0; i < 32; i++) {
         if (ngx_queue_empty(&ngx_cycle->reusable_connections_queue)) {
@@ -1014,7 +1132,10 @@ ngx_drain_connections(void)
         }
 
         q = ngx_queue_last(&ngx_cycle->reusable_connections_queue);
-        c = ngx_queue_data(q, ngx_connection_t, queue);
+        cold = ngx_queue_data(q, ngx_connection_cold_t, queue);
+
+        /* the cold part has the same index as its connection */
+        c = &ngx_cycle->connections[cold - ngx_cycle->connections_cold];
 
         ngx_log_debug0(NGX_LOG_DEBUG_CORE, c->log, 0,
                        "reusing connection");
@@ -1039,11 +1160,11 @@ ngx_connection_local_sockaddr(ngx_connection_t *c, ngx_str_t *s,
     struct sockaddr_in6  *sin6;
 #endif
 
-    switch (c->local_sockaddr->sa_family) {
+    switch (c->cold->local_sockaddr->sa_family) {
 
 #if (NGX_HAVE_INET6)
     case AF_INET6:
-        sin6 = (struct sockaddr_in6 *) c->local_sockaddr;
+        sin6 = (struct sockaddr_in6 *) c->cold->local_sockaddr;
 
         for (addr = 0, i = 0; addr == 0 && i < 16; i++) {
             addr |= sin6->sin6_addr.s6_addr[i];
@@ -1053,7 +1174,7 @@ ngx_connection_local_sockaddr(ngx_connection_t *c, ngx_str_t *s,
 #endif
 
     default: /* AF_INET */
-        sin = (struct sockaddr_in *) c->local_sockaddr;
+        sin = (struct sockaddr_in *) c->cold->local_sockaddr;
         addr = sin->sin_addr.s_addr;
         break;
     }
@@ -1067,19 +1188,19 @@ ngx_connection_local_sockaddr(ngx_connection_t *c, ngx_str_t *s,
             return NGX_ERROR;
         }
 
-        c->local_sockaddr = ngx_palloc(c->pool, len);
-        if (c->local_sockaddr == NULL) {
+        c->cold->local_sockaddr = ngx_palloc(c->pool, len);
+        if (c->cold->local_sockaddr == NULL) {
             return NGX_ERROR;
         }
 
-        ngx_memcpy(c->local_sockaddr, &sa, len);
+        ngx_memcpy(c->cold->local_sockaddr, &sa, len);
     }
 
     if (s == NULL) {
         return NGX_OK;
     }
 
-    s->len = ngx_sock_ntop(c->local_sockaddr, s->data, s->len, port);
+    s->len = ngx_sock_ntop(c->cold->local_sockaddr, s->data, s->len, port);
 
     return NGX_OK;
 }
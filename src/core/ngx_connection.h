@@ -54,6 +54,14 @@ struct ngx_listening_s {
     ngx_listening_t    *previous;
     ngx_connection_t   *connection;
 
+    ngx_uint_t          worker;
+
+#if (NGX_STAT_STUB)
+    // 在共享内存中，各worker共同累加，reload时从previous继承
+    ngx_atomic_t       *stat_accepted;
+    ngx_atomic_t       *stat_dropped;   /* no free worker_connections */
+#endif
+
     unsigned            open:1; // 当前监听句柄有效，且执行ngx_init_cycle时不关闭监听端口
     unsigned            remain:1;
     unsigned            ignore:1;
@@ -71,6 +79,11 @@ struct ngx_listening_s {
 #endif
     unsigned            keepalive:2;
 
+#if (NGX_HAVE_REUSEPORT)
+    unsigned            reuseport:1;
+    unsigned            add_reuseport:1;
+#endif
+
 #if (NGX_HAVE_DEFERRED_ACCEPT)
     unsigned            deferred_accept:1;
     unsigned            delete_deferred:1;
@@ -109,47 +122,39 @@ typedef enum {
 } ngx_connection_tcp_nopush_e;
 
 
-#define NGX_LOWLEVEL_BUFFERED  0x0f
-#define NGX_SSL_BUFFERED       0x01
-
-
-struct ngx_connection_s {
-    void               *data;
-    ngx_event_t        *read;
-    ngx_event_t        *write;
-
-    ngx_socket_t        fd;
-
-    ngx_recv_pt         recv;
-    ngx_send_pt         send;
-    ngx_recv_chain_pt   recv_chain;
-    ngx_send_chain_pt   send_chain;
+/*
+ * the fields used only when a connection is accepted, logged or closed
+ * are kept in a separate array, so the connection array walked by the event
+ * loop stays small and the cold part is only touched by used connections
+ */
 
+struct ngx_connection_cold_s {
     ngx_listening_t    *listening;
 
-    off_t               sent;
-
-    ngx_log_t          *log;
-
-    ngx_pool_t         *pool;
-
     struct sockaddr    *sockaddr;
     socklen_t           socklen;
     ngx_str_t           addr_text;
 
-#if (NGX_SSL)
-    ngx_ssl_connection_t  *ssl;
-#endif
-
     struct sockaddr    *local_sockaddr;
 
-    ngx_buf_t          *buffer;
-
     ngx_queue_t         queue;
 
     ngx_atomic_uint_t   number;
+};
 
-    ngx_uint_t          requests;
+
+#define NGX_LOWLEVEL_BUFFERED  0x0f
+#define NGX_SSL_BUFFERED       0x01
+
+
+struct ngx_connection_s {
+    void               *data;
+    ngx_event_t        *read;
+    ngx_event_t        *write;
+
+    ngx_socket_t        fd;
+
+    /* the flags fill the padding after fd */
 
     unsigned            buffered:8;
 
@@ -175,6 +180,30 @@ struct ngx_connection_s {
 
 #if (NGX_HAVE_AIO_SENDFILE)
     unsigned            aio_sendfile:1;
+#endif
+
+    ngx_recv_pt         recv;
+    ngx_send_pt         send;
+    ngx_recv_chain_pt   recv_chain;
+    ngx_send_chain_pt   send_chain;
+
+    ngx_log_t          *log;
+
+    ngx_connection_cold_t  *cold;
+
+    off_t               sent;
+
+    ngx_pool_t         *pool;
+
+#if (NGX_SSL)
+    ngx_ssl_connection_t  *ssl;
+#endif
+
+    ngx_buf_t          *buffer;
+
+    ngx_uint_t          requests;
+
+#if (NGX_HAVE_AIO_SENDFILE)
     ngx_buf_t          *busy_sendfile;
 #endif
 
@@ -186,6 +215,7 @@ struct ngx_connection_s {
 
 ngx_listening_t *ngx_create_listening(ngx_conf_t *cf, void *sockaddr,
     socklen_t socklen);
+ngx_int_t ngx_clone_listening(ngx_conf_t *cf, ngx_listening_t *ls);
 ngx_int_t ngx_set_inherited_sockets(ngx_cycle_t *cycle);
 ngx_int_t ngx_open_listening_sockets(ngx_cycle_t *cycle);
 void ngx_configure_listening_sockets(ngx_cycle_t *cycle);
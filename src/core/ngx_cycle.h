@@ -33,6 +33,7 @@ struct ngx_shm_zone_s {
     ngx_shm_t                 shm;
     ngx_shm_zone_init_pt      init; // 各个共享内存初始化操作，不同使用有不一样的操作
     void                     *tag;  // 指向当前模块ngx_module_t变量
+    ngx_uint_t                noreuse;  /* unsigned  noreuse:1; */
 };
 
 // 核心结构体，保存所有配置啊、使用的变量啊
@@ -53,6 +54,10 @@ struct ngx_cycle_s {
 
     ngx_array_t               listening;
     ngx_array_t               paths;
+
+    // 健康检查辅助进程的入口，由upstream健康检查模块设置
+    ngx_event_handler_pt      health_check;
+    ngx_uint_t                health_check_peers;
     ngx_list_t                open_files;
     ngx_list_t                shared_memory;    // 所有的共享内存，组成链表
 
@@ -60,6 +65,7 @@ struct ngx_cycle_s {
     ngx_uint_t                files_n;
 
     ngx_connection_t         *connections;
+    ngx_connection_cold_t    *connections_cold;
     ngx_event_t              *read_events;
     ngx_event_t              *write_events;
 
@@ -93,6 +99,9 @@ typedef struct {
 
      int                      priority;
 
+     ngx_int_t                pool_cache;
+     ngx_int_t                slab_reserve;
+
      ngx_uint_t               cpu_affinity_n;
      uint64_t                *cpu_affinity;
 
@@ -31,6 +31,12 @@ struct ngx_file_s {
     ngx_event_aio_t           *aio;
 #endif
 
+#if (NGX_THREAD_POOL)
+    ngx_int_t                (*thread_handler)(ngx_thread_task_t *task,
+                                               ngx_file_t *file);
+    void                      *thread_ctx;
+#endif
+
     unsigned                   valid_info:1;
     unsigned                   directio:1;
 };
@@ -53,6 +59,8 @@ typedef struct {
     ngx_path_loader_pt         loader;
     void                      *data;
 
+    ngx_uint_t                 loaders;     // 并行的cache loader进程数
+
     u_char                    *conf_file;   // 配置该路径的配置文件名
     ngx_uint_t                 line;        // 在配置文件中的行数
 } ngx_path_t;
@@ -9,6 +9,27 @@
 #include <ngx_core.h>
 
 
+/*
+ * the perfect hash places the keys of a group in the free slots
+ * by a per group displacement, so each key has a slot of its own
+ */
+
+#define NGX_HASH_PERFECT_GROUP  4
+#define NGX_HASH_PERFECT_TRIES  65536
+
+
+typedef struct {
+    ngx_uint_t        group;
+    ngx_uint_t        n;
+} ngx_hash_perfect_group_t;
+
+
+static ngx_inline ngx_uint_t ngx_hash_perfect_index(ngx_uint_t key,
+    ngx_uint_t disp, ngx_uint_t size);
+static int ngx_libc_cdecl ngx_hash_perfect_cmp(const void *one,
+    const void *two);
+
+
 void *
 ngx_hash_find(ngx_hash_t *hash, ngx_uint_t key, u_char *name, size_t len)
 {
@@ -19,7 +40,15 @@ ngx_hash_find(ngx_hash_t *hash, ngx_uint_t key, u_char *name, size_t len)
     ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0, "hf:\"%*s\"", len, name);
 #endif
 
-    elt = hash->buckets[key % hash->size];
+    if (hash->disp) {
+        key = ngx_hash_perfect_index(key, hash->disp[key % hash->ndisp],
+                                     hash->size);
+
+    } else {
+        key %= hash->size;
+    }
+
+    elt = hash->buckets[key];
 
     if (elt == NULL) {
         return NULL;
@@ -444,6 +473,8 @@ found:
 
     hinit->hash->buckets = buckets;
     hinit->hash->size = size;
+    hinit->hash->disp = NULL;
+    hinit->hash->ndisp = 0;
 
 #if 0
 
@@ -479,6 +510,240 @@ found:
 }
 
 
+/*
+ * builds a hash with a single probe and no collision chains, so the
+ * bucket_size and max_size limits do not apply; if the keys cannot be
+ * placed, e.g. two keys have the same hash, the usual hash is built
+ */
+
+ngx_int_t
+ngx_hash_perfect_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
+    ngx_uint_t nelts)
+{
+    u_char                    *elts;
+    size_t                     len;
+    ngx_uint_t                 i, j, k, n, d, s, size, ngroups;
+    ngx_uint_t                *disp, *first, *order, *slots, *tries;
+    ngx_hash_elt_t            *elt, **buckets;
+    ngx_hash_perfect_group_t  *groups;
+
+    n = 0;
+
+    for (i = 0; i < nelts; i++) {
+        if (names[i].key.data != NULL) {
+            n++;
+        }
+    }
+
+    if (n == 0) {
+        return ngx_hash_init(hinit, names, nelts);
+    }
+
+    ngroups = (n + NGX_HASH_PERFECT_GROUP - 1) / NGX_HASH_PERFECT_GROUP;
+
+    /* the slots are 80% full */
+    size = n + n / 4 + 1;
+
+    groups = ngx_alloc(ngroups * sizeof(ngx_hash_perfect_group_t)
+                       + (2 * ngroups + 1 + n + 2 * size) * sizeof(ngx_uint_t),
+                       hinit->pool->log);
+    if (groups == NULL) {
+        return NGX_ERROR;
+    }
+
+    disp = (ngx_uint_t *) &groups[ngroups];
+    first = disp + ngroups;
+    order = first + ngroups + 1;
+    slots = order + n;
+    tries = slots + size;
+
+    ngx_memzero(disp, (2 * ngroups + 1) * sizeof(ngx_uint_t));
+    ngx_memzero(slots, size * sizeof(ngx_uint_t));
+
+    for (i = 0; i < ngroups; i++) {
+        groups[i].group = i;
+        groups[i].n = 0;
+    }
+
+    /* sort the keys by groups */
+
+    for (i = 0; i < nelts; i++) {
+        if (names[i].key.data != NULL) {
+            groups[names[i].key_hash % ngroups].n++;
+        }
+    }
+
+    for (i = 0; i < ngroups; i++) {
+        first[i + 1] = first[i] + groups[i].n;
+    }
+
+    for (i = 0; i < nelts; i++) {
+        if (names[i].key.data != NULL) {
+            k = names[i].key_hash % ngroups;
+            order[first[k] + disp[k]++] = i;
+        }
+    }
+
+    /* place the largest groups first while most of the slots are free */
+
+    ngx_qsort(groups, ngroups, sizeof(ngx_hash_perfect_group_t),
+              ngx_hash_perfect_cmp);
+
+    /*
+     * slots[] keeps the key index + 1 of the placed keys,
+     * tries[] marks the slots taken by the group tried with displacement d
+     */
+
+    for (i = 0; i < size; i++) {
+        tries[i] = NGX_HASH_PERFECT_TRIES;
+    }
+
+    for (i = 0; i < ngroups && groups[i].n; i++) {
+
+        k = groups[i].group;
+
+        for (d = 0; d < NGX_HASH_PERFECT_TRIES; d++) {
+
+            for (j = first[k]; j < first[k + 1]; j++) {
+                s = ngx_hash_perfect_index(names[order[j]].key_hash, d, size);
+
+                if (slots[s] || tries[s] == d) {
+                    break;
+                }
+
+                tries[s] = d;
+            }
+
+            if (j == first[k + 1]) {
+                break;
+            }
+
+            for (j--; j + 1 > first[k]; j--) {
+                s = ngx_hash_perfect_index(names[order[j]].key_hash, d, size);
+                tries[s] = NGX_HASH_PERFECT_TRIES;
+            }
+        }
+
+        if (d == NGX_HASH_PERFECT_TRIES) {
+            ngx_free(groups);
+            return ngx_hash_init(hinit, names, nelts);
+        }
+
+        disp[k] = d;
+
+        for (j = first[k]; j < first[k + 1]; j++) {
+            s = ngx_hash_perfect_index(names[order[j]].key_hash, d, size);
+            slots[s] = order[j] + 1;
+            tries[s] = NGX_HASH_PERFECT_TRIES;
+        }
+    }
+
+    /* each slot holds one element and the NULL value terminator */
+
+    len = 0;
+
+    for (i = 0; i < nelts; i++) {
+        if (names[i].key.data != NULL) {
+            len += NGX_HASH_ELT_SIZE(&names[i]) + sizeof(void *);
+        }
+    }
+
+    if (hinit->hash == NULL) {
+        hinit->hash = ngx_pcalloc(hinit->pool, sizeof(ngx_hash_wildcard_t)
+                                             + size * sizeof(ngx_hash_elt_t *));
+        if (hinit->hash == NULL) {
+            ngx_free(groups);
+            return NGX_ERROR;
+        }
+
+        buckets = (ngx_hash_elt_t **)
+                      ((u_char *) hinit->hash + sizeof(ngx_hash_wildcard_t));
+
+    } else {
+        buckets = ngx_pcalloc(hinit->pool, size * sizeof(ngx_hash_elt_t *));
+        if (buckets == NULL) {
+            ngx_free(groups);
+            return NGX_ERROR;
+        }
+    }
+
+    elts = ngx_palloc(hinit->pool, len + ngroups * sizeof(ngx_uint_t));
+    if (elts == NULL) {
+        ngx_free(groups);
+        return NGX_ERROR;
+    }
+
+    ngx_memcpy(elts, disp, ngroups * sizeof(ngx_uint_t));
+
+    hinit->hash->disp = (ngx_uint_t *) elts;
+    elts += ngroups * sizeof(ngx_uint_t);
+
+    for (s = 0; s < size; s++) {
+        if (slots[s] == 0) {
+            continue;
+        }
+
+        i = slots[s] - 1;
+
+        elt = (ngx_hash_elt_t *) elts;
+        buckets[s] = elt;
+
+        elt->value = names[i].value;
+        elt->len = (u_short) names[i].key.len;
+
+        ngx_strlow(elt->name, names[i].key.data, names[i].key.len);
+
+        elts += NGX_HASH_ELT_SIZE(&names[i]);
+
+        elt = (ngx_hash_elt_t *) elts;
+        elt->value = NULL;
+
+        elts += sizeof(void *);
+    }
+
+    ngx_free(groups);
+
+    hinit->hash->buckets = buckets;
+    hinit->hash->size = size;
+    hinit->hash->ndisp = ngroups;
+
+    return NGX_OK;
+}
+
+
+static ngx_inline ngx_uint_t
+ngx_hash_perfect_index(ngx_uint_t key, ngx_uint_t disp, ngx_uint_t size)
+{
+    uint32_t  x;
+
+    x = (uint32_t) key ^ ((uint32_t) disp * 0x85ebca6b);
+
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+
+    return x % size;
+}
+
+
+static int ngx_libc_cdecl
+ngx_hash_perfect_cmp(const void *one, const void *two)
+{
+    ngx_hash_perfect_group_t  *first, *second;
+
+    first = (ngx_hash_perfect_group_t *) one;
+    second = (ngx_hash_perfect_group_t *) two;
+
+    if (first->n == second->n) {
+        return (int) (first->group - second->group);
+    }
+
+    return (first->n < second->n) ? 1 : -1;
+}
+
+
 ngx_int_t
 ngx_hash_wildcard_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
     ngx_uint_t nelts)
@@ -24,6 +24,8 @@ typedef struct {
 typedef struct {
     ngx_hash_elt_t  **buckets;  // 指向散列表的槽
     ngx_uint_t        size;     // 散列表中槽的总数
+    ngx_uint_t       *disp;     // 完美散列每组的位移，普通散列表为NULL
+    ngx_uint_t        ndisp;
 } ngx_hash_t;
 
 
@@ -121,6 +123,8 @@ void *ngx_hash_find_combined(ngx_hash_combined_t *hash, ngx_uint_t key,
 
 ngx_int_t ngx_hash_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
     ngx_uint_t nelts);
+ngx_int_t ngx_hash_perfect_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
+    ngx_uint_t nelts);
 ngx_int_t ngx_hash_wildcard_init(ngx_hash_init_t *hinit, ngx_hash_key_t *names,
     ngx_uint_t nelts);
 
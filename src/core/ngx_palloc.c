@@ -11,6 +11,51 @@
 
 static void *ngx_palloc_block(ngx_pool_t *pool, size_t size);
 static void *ngx_palloc_large(ngx_pool_t *pool, size_t size);
+static void *ngx_pool_cache_get(size_t size);
+static ngx_int_t ngx_pool_cache_put(ngx_pool_t *p);
+
+
+#define NGX_POOL_CACHE_SLOTS  8
+
+/*
+ * 每个worker自己的空闲内存块缓存，按块大小分槽，
+ * 每个槽用d.next串成单链表，最多缓存ngx_pool_cache_max个块
+ */
+
+typedef struct {
+    size_t                size;
+    ngx_uint_t            nfree;
+    ngx_pool_t           *free;
+} ngx_pool_cache_slot_t;
+
+
+static ngx_pool_cache_slot_t  ngx_pool_cache[NGX_POOL_CACHE_SLOTS];
+static ngx_uint_t             ngx_pool_cache_nslots;
+static ngx_uint_t             ngx_pool_cache_max;
+
+/*
+ * the counters of the worker are plain variables and are added
+ * to the shared ones by ngx_pool_cache_sync() at most once per
+ * NGX_POOL_CACHE_SYNC milliseconds
+ */
+
+#define NGX_POOL_CACHE_SYNC   1000
+
+static ngx_atomic_uint_t      ngx_pool_cache_hits;
+static ngx_atomic_uint_t      ngx_pool_cache_misses;
+static ngx_atomic_uint_t      ngx_pool_cache_cached;
+static ngx_atomic_uint_t      ngx_pool_cache_synced;
+static ngx_msec_t             ngx_pool_cache_sync_time;
+
+
+/* the counters are moved to the shared zone by ngx_event_module_init() */
+
+ngx_atomic_t   ngx_stat_pool_hits0;
+ngx_atomic_t  *ngx_stat_pool_hits = &ngx_stat_pool_hits0;
+ngx_atomic_t   ngx_stat_pool_misses0;
+ngx_atomic_t  *ngx_stat_pool_misses = &ngx_stat_pool_misses0;
+ngx_atomic_t   ngx_stat_pool_cached0;
+ngx_atomic_t  *ngx_stat_pool_cached = &ngx_stat_pool_cached0;
 
 
 /**
@@ -28,11 +73,15 @@ ngx_create_pool(size_t size, ngx_log_t *log)
 {
     ngx_pool_t  *p;
 
-    // 申请对齐的内存，NGX_POOL_ALIGNMENT：16
-    // 这里是实际申请内存的地方
-    p = ngx_memalign(NGX_POOL_ALIGNMENT, size, log);
+    p = ngx_pool_cache_get(size);
+
     if (p == NULL) {
-        return NULL;
+        // 申请对齐的内存，NGX_POOL_ALIGNMENT：16
+        // 这里是实际申请内存的地方
+        p = ngx_memalign(NGX_POOL_ALIGNMENT, size, log);
+        if (p == NULL) {
+            return NULL;
+        }
     }
 
     p->d.last = (u_char *) p + sizeof(ngx_pool_t);
@@ -101,7 +150,9 @@ ngx_destroy_pool(ngx_pool_t *pool)
 #endif
 
     for (p = pool, n = pool->d.next; /* void */; p = n, n = n->d.next) {
-        ngx_free(p);
+        if (ngx_pool_cache_put(p) != NGX_OK) {
+            ngx_free(p);
+        }
 
         if (n == NULL) {
             break;
@@ -210,10 +261,14 @@ ngx_palloc_block(ngx_pool_t *pool, size_t size)
     // 前一个内存块大小，每次都扩大这么多
     psize = (size_t) (pool->d.end - (u_char *) pool);
 
-    // NGX_POOL_ALIGNMENT：16
-    m = ngx_memalign(NGX_POOL_ALIGNMENT, psize, pool->log);
+    m = ngx_pool_cache_get(psize);
+
     if (m == NULL) {
-        return NULL;
+        // NGX_POOL_ALIGNMENT：16
+        m = ngx_memalign(NGX_POOL_ALIGNMENT, psize, pool->log);
+        if (m == NULL) {
+            return NULL;
+        }
     }
 
     new = (ngx_pool_t *) m;
@@ -479,3 +534,150 @@ ngx_get_cached_block(size_t size)
 }
 
 #endif
+
+
+void
+ngx_pool_cache_init(ngx_uint_t max)
+{
+    ngx_uint_t   i;
+    ngx_pool_t  *p, *n;
+
+    for (i = 0; i < ngx_pool_cache_nslots; i++) {
+        for (p = ngx_pool_cache[i].free; p; p = n) {
+            n = p->d.next;
+            ngx_free(p);
+            ngx_pool_cache_cached--;
+        }
+    }
+
+    ngx_pool_cache_nslots = 0;
+    ngx_pool_cache_max = max;
+
+    ngx_pool_cache_sync(1);
+}
+
+
+void
+ngx_pool_cache_sync(ngx_uint_t force)
+{
+    if (!force
+        && ngx_current_msec - ngx_pool_cache_sync_time < NGX_POOL_CACHE_SYNC)
+    {
+        return;
+    }
+
+    ngx_pool_cache_sync_time = ngx_current_msec;
+
+    if (ngx_pool_cache_hits) {
+        (void) ngx_atomic_fetch_add(ngx_stat_pool_hits, ngx_pool_cache_hits);
+        ngx_pool_cache_hits = 0;
+    }
+
+    if (ngx_pool_cache_misses) {
+        (void) ngx_atomic_fetch_add(ngx_stat_pool_misses,
+                                    ngx_pool_cache_misses);
+        ngx_pool_cache_misses = 0;
+    }
+
+    if (ngx_pool_cache_cached != ngx_pool_cache_synced) {
+        (void) ngx_atomic_fetch_add(ngx_stat_pool_cached,
+                                    ngx_pool_cache_cached
+                                    - ngx_pool_cache_synced);
+        ngx_pool_cache_synced = ngx_pool_cache_cached;
+    }
+}
+
+
+// 登记一种需要缓存的内存池大小，一般是connection_pool_size和request_pool_size
+void
+ngx_pool_cache_add(size_t size)
+{
+    ngx_uint_t  i;
+
+    if (ngx_pool_cache_max == 0) {
+        return;
+    }
+
+    for (i = 0; i < ngx_pool_cache_nslots; i++) {
+        if (ngx_pool_cache[i].size == size) {
+            return;
+        }
+    }
+
+    if (ngx_pool_cache_nslots == NGX_POOL_CACHE_SLOTS) {
+        return;
+    }
+
+    ngx_pool_cache[i].size = size;
+    ngx_pool_cache[i].nfree = 0;
+    ngx_pool_cache[i].free = NULL;
+
+    ngx_pool_cache_nslots++;
+}
+
+
+static void *
+ngx_pool_cache_get(size_t size)
+{
+    ngx_uint_t              i;
+    ngx_pool_t             *p;
+    ngx_pool_cache_slot_t  *slot;
+
+    for (i = 0; i < ngx_pool_cache_nslots; i++) {
+        slot = &ngx_pool_cache[i];
+
+        if (slot->size != size) {
+            continue;
+        }
+
+        p = slot->free;
+
+        if (p == NULL) {
+            ngx_pool_cache_misses++;
+            return NULL;
+        }
+
+        slot->free = p->d.next;
+        slot->nfree--;
+
+        ngx_pool_cache_hits++;
+        ngx_pool_cache_cached--;
+
+        return p;
+    }
+
+    return NULL;
+}
+
+
+static ngx_int_t
+ngx_pool_cache_put(ngx_pool_t *p)
+{
+    size_t                  size;
+    ngx_uint_t              i;
+    ngx_pool_cache_slot_t  *slot;
+
+    size = (size_t) (p->d.end - (u_char *) p);
+
+    for (i = 0; i < ngx_pool_cache_nslots; i++) {
+        slot = &ngx_pool_cache[i];
+
+        if (slot->size != size) {
+            continue;
+        }
+
+        if (slot->nfree >= ngx_pool_cache_max) {
+            return NGX_DECLINED;
+        }
+
+        p->d.next = slot->free;
+        slot->free = p;
+        slot->nfree++;
+
+        ngx_pool_cache_cached++;
+
+        return NGX_OK;
+    }
+
+    return NGX_DECLINED;
+}
@@ -142,5 +142,29 @@ void ngx_pool_cleanup_file(void *data);
  */
 void ngx_pool_delete_file(void *data);
 
+/**
+ * @brief 打开worker内的空闲内存块缓存，max为每种大小最多缓存的块数，0表示关闭
+ *
+ * @param max
+ */
+void ngx_pool_cache_init(ngx_uint_t max);
+/**
+ * @brief 登记一种要缓存的内存池大小
+ *
+ * @param size ngx_create_pool()时的size
+ */
+void ngx_pool_cache_add(size_t size);
+/**
+ * @brief 把worker内的缓存计数累加到共享内存的统计里
+ *
+ * @param force 为0时每NGX_POOL_CACHE_SYNC毫秒最多累加一次
+ */
+void ngx_pool_cache_sync(ngx_uint_t force);
+
+
+extern ngx_atomic_t  *ngx_stat_pool_hits;
+extern ngx_atomic_t  *ngx_stat_pool_misses;
+extern ngx_atomic_t  *ngx_stat_pool_cached;
+
 
 #endif /* _NGX_PALLOC_H_INCLUDED_ */
@@ -2260,7 +2260,7 @@ ngx_udp_connect(ngx_udp_connection_t *uc)
 
     uc->connection = c;
 
-    c->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
+    c->cold->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
 
 #if (NGX_THREADS)
 
@@ -2274,7 +2274,7 @@ ngx_udp_connect(ngx_udp_connection_t *uc)
 #endif
 
     ngx_log_debug3(NGX_LOG_DEBUG_EVENT, &uc->log, 0,
-                   "connect to %V, fd:%d #%d", &uc->server, s, c->number);
+                   "connect to %V, fd:%d #%d", &uc->server, s, c->cold->number);
 
     rc = connect(s, uc->sockaddr, uc->socklen);
 
@@ -59,6 +59,7 @@ static ngx_slab_page_t *ngx_slab_alloc_pages(ngx_slab_pool_t *pool,
 static void ngx_slab_free_pages(ngx_slab_pool_t *pool, ngx_slab_page_t *page,
                                 ngx_uint_t pages);
 static void ngx_slab_error(ngx_slab_pool_t *pool, ngx_uint_t level, char *text);
+static ngx_uint_t ngx_slab_chunks(ngx_uint_t shift);
 
 static ngx_uint_t ngx_slab_max_size;    // 2048，slab和page的分割点，大于等于该值需要从page中分配
 
@@ -134,6 +135,11 @@ void ngx_slab_init(ngx_slab_pool_t *pool) {
 
     p += n * sizeof(ngx_slab_page_t);
 
+    pool->stats = (ngx_slab_stat_t *)p;
+    ngx_memzero(pool->stats, n * sizeof(ngx_slab_stat_t));
+
+    p += n * sizeof(ngx_slab_stat_t);
+
     // 可以划分多少个slab_page去管理所有内存
     pages = (ngx_uint_t)(size / (ngx_pagesize + sizeof(ngx_slab_page_t)));
 
@@ -159,8 +165,12 @@ void ngx_slab_init(ngx_slab_pool_t *pool) {
         pool->pages->slab = pages;  // 总共管理多少页面
     }
 
+    pool->pfree = pages;
+
     pool->log_ctx = &pool->zero;
     pool->zero = '\0';
+
+    pool->log_nomem = 1;
 }
 
 void *ngx_slab_alloc(ngx_slab_pool_t *pool, size_t size) {
@@ -219,6 +229,8 @@ void *ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) {
     ngx_log_debug2(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0,
                    "slab alloc: %uz slot: %ui", size, slot);
 
+    pool->stats[slot].reqs++;
+
     // slots数组
     slots = (ngx_slab_page_t *)((u_char *)pool + sizeof(ngx_slab_pool_t));
     page = slots[slot].next; // 这个slot的管理节点
@@ -258,7 +270,7 @@ void *ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) {
                                     if (bitmap[n] != NGX_SLAB_BUSY) {
                                         p = (uintptr_t)bitmap + i;
 
-                                        goto done;
+                                        goto used;
                                     }
                                 }
 
@@ -273,7 +285,7 @@ void *ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) {
 
                             p = (uintptr_t)bitmap + i;
 
-                            goto done;
+                            goto used;
                         }
                     }
                 }
@@ -307,7 +319,7 @@ void *ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) {
                         p += i << shift;
                         p += (uintptr_t)pool->start;
 
-                        goto done;
+                        goto used;
                     }
                 }
 
@@ -347,7 +359,7 @@ void *ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) {
                         p += i << shift;
                         p += (uintptr_t)pool->start;
 
-                        goto done;
+                        goto used;
                     }
                 }
 
@@ -360,6 +372,9 @@ void *ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) {
     page = ngx_slab_alloc_pages(pool, 1);
 
     if (page) {
+        pool->stats[slot].pages++;
+        pool->stats[slot].total += ngx_slab_chunks(shift);
+
         if (shift < ngx_slab_exact_shift) {
             p = (page - pool->pages) << ngx_pagesize_shift;
             bitmap = (uintptr_t *)(pool->start + p);
@@ -388,7 +403,7 @@ void *ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) {
             p = ((page - pool->pages) << ngx_pagesize_shift) + s * n;
             p += (uintptr_t)pool->start;
 
-            goto done;
+            goto used;
 
         } else if (shift == ngx_slab_exact_shift) {
             page->slab = 1; // 只申请了其中1块内存
@@ -400,7 +415,7 @@ void *ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) {
             p = (page - pool->pages) << ngx_pagesize_shift;
             p += (uintptr_t)pool->start;
 
-            goto done;
+            goto used;
 
         } else { /* shift > ngx_slab_exact_shift */
             // 前半边bit用作bitmap，后半段用于存储该块的大小
@@ -413,12 +428,20 @@ void *ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size) {
             p = (page - pool->pages) << ngx_pagesize_shift;
             p += (uintptr_t)pool->start;
 
-            goto done;
+            goto used;
         }
     }
 
     p = 0;
 
+    pool->stats[slot].fails++;
+
+    goto done;
+
+used:
+
+    pool->stats[slot].used++;
+
 done:
 
     ngx_log_debug1(NGX_LOG_DEBUG_ALLOC, ngx_cycle->log, 0, "slab alloc: %p", p);
@@ -468,10 +491,11 @@ void ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p) {
             bitmap = (uintptr_t *)((uintptr_t)p & ~(ngx_pagesize - 1));
 
             if (bitmap[n] & m) {
+                slot = shift - pool->min_shift;
+
                 if (page->next == NULL) {
                     slots = (ngx_slab_page_t *)((u_char *)pool +
                                                 sizeof(ngx_slab_pool_t));
-                    slot = shift - pool->min_shift;
 
                     page->next = slots[slot].next;
                     slots[slot].next = page;
@@ -482,6 +506,8 @@ void ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p) {
 
                 bitmap[n] &= ~m;
 
+                pool->stats[slot].used--;
+
                 n = (1 << (ngx_pagesize_shift - shift)) / 8 / (1 << shift);
 
                 if (n == 0) {
@@ -501,9 +527,7 @@ void ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p) {
                     }
                 }
 
-                ngx_slab_free_pages(pool, page, 1);
-
-                goto done;
+                goto empty;
             }
 
             goto chunk_already_free;
@@ -519,10 +543,12 @@ void ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p) {
             }
 
             if (slab & m) {
+                shift = ngx_slab_exact_shift;
+                slot = shift - pool->min_shift;
+
                 if (slab == NGX_SLAB_BUSY) {
                     slots = (ngx_slab_page_t *)((u_char *)pool +
                                                 sizeof(ngx_slab_pool_t));
-                    slot = ngx_slab_exact_shift - pool->min_shift;
 
                     page->next = slots[slot].next;
                     slots[slot].next = page;
@@ -533,13 +559,13 @@ void ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p) {
 
                 page->slab &= ~m;
 
+                pool->stats[slot].used--;
+
                 if (page->slab) {
                     goto done;
                 }
 
-                ngx_slab_free_pages(pool, page, 1);
-
-                goto done;
+                goto empty;
             }
 
             goto chunk_already_free;
@@ -558,10 +584,11 @@ void ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p) {
                     NGX_SLAB_MAP_SHIFT);
 
             if (slab & m) {
+                slot = shift - pool->min_shift;
+
                 if (page->next == NULL) {
                     slots = (ngx_slab_page_t *)((u_char *)pool +
                                                 sizeof(ngx_slab_pool_t));
-                    slot = shift - pool->min_shift;
 
                     page->next = slots[slot].next;
                     slots[slot].next = page;
@@ -572,13 +599,13 @@ void ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p) {
 
                 page->slab &= ~m;
 
+                pool->stats[slot].used--;
+
                 if (page->slab & NGX_SLAB_MAP_MASK) {   // 本页还有被占用的内存
                     goto done;
                 }
 
-                ngx_slab_free_pages(pool, page, 1);
-
-                goto done;
+                goto empty;
             }
 
             goto chunk_already_free;
@@ -615,6 +642,18 @@ void ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p) {
 
     return;
 
+empty:
+
+    // 整页都空了，slot里的页数不超过reserve时留着给下次申请用，不还给页分配器
+    if (pool->stats[slot].pages <= pool->reserve) {
+        goto done;
+    }
+
+    ngx_slab_free_pages(pool, page, 1);
+
+    pool->stats[slot].pages--;
+    pool->stats[slot].total -= ngx_slab_chunks(shift);
+
 done:
 
     ngx_slab_junk(p, size);
@@ -674,6 +713,8 @@ static ngx_slab_page_t *ngx_slab_alloc_pages(ngx_slab_pool_t *pool,
             page->next = NULL;
             page->prev = NGX_SLAB_PAGE;
 
+            pool->pfree -= pages;
+
             if (--pages == 0) { // 只有1个page
                 return page;
             }
@@ -690,7 +731,10 @@ static ngx_slab_page_t *ngx_slab_alloc_pages(ngx_slab_pool_t *pool,
         }
     }
 
-    ngx_slab_error(pool, NGX_LOG_CRIT, "ngx_slab_alloc() failed: no memory");
+    if (pool->log_nomem) {
+        ngx_slab_error(pool, NGX_LOG_CRIT,
+                       "ngx_slab_alloc() failed: no memory");
+    }
 
     return NULL;
 }
@@ -699,6 +743,8 @@ static void ngx_slab_free_pages(ngx_slab_pool_t *pool, ngx_slab_page_t *page,
                                 ngx_uint_t pages) {
     ngx_slab_page_t *prev;
 
+    pool->pfree += pages;
+
     page->slab = pages--;
 
     if (pages) {
@@ -723,3 +769,24 @@ static void ngx_slab_error(ngx_slab_pool_t *pool, ngx_uint_t level,
                            char *text) {
     ngx_log_error(level, ngx_cycle->log, 0, "%s%s", text, pool->log_ctx);
 }
+
+// 一页能分出多少块，小块的页头要留出位图
+static ngx_uint_t ngx_slab_chunks(ngx_uint_t shift) {
+    ngx_uint_t n;
+
+    if (shift >= ngx_slab_exact_shift) {
+        return ngx_pagesize >> shift;
+    }
+
+    n = (1 << (ngx_pagesize_shift - shift)) / 8 / (1 << shift);
+
+    if (n == 0) {
+        n = 1;
+    }
+
+    return (ngx_pagesize >> shift) - n;
+}
+
+ngx_uint_t ngx_slab_slots(ngx_slab_pool_t *pool) {
+    return ngx_pagesize_shift - pool->min_shift;
+}
@@ -26,6 +26,15 @@ struct ngx_slab_page_s {
     uintptr_t         prev; // 很多用途
 };
 
+// 每个slot的使用统计，放在共享内存里slots数组之后
+typedef struct {
+    ngx_uint_t        pages;    // 分给该slot的页数
+    ngx_uint_t        total;    // 这些页上能分配的块总数
+    ngx_uint_t        used;     // 已分配出去的块数
+    ngx_uint_t        reqs;     // 申请次数
+    ngx_uint_t        fails;    // 申请失败次数
+} ngx_slab_stat_t;
+
 // slab池，相当于slab句柄
 typedef struct {
     ngx_shmtx_sh_t    lock;
@@ -36,6 +45,10 @@ typedef struct {
     ngx_slab_page_t  *pages;
     ngx_slab_page_t   free;     // 相当于一个头节点，存储的是ngx_slab_page_t管理节点
 
+    ngx_slab_stat_t  *stats;
+    ngx_uint_t        pfree;    // 空闲页数
+    ngx_uint_t        reserve;  // 每个slot最少保留的页数，空了也不还给页分配器
+
     u_char           *start;    // 共享内存开始位置
     u_char           *end;      // 共享内存结束位置
 
@@ -44,6 +57,8 @@ typedef struct {
     u_char           *log_ctx;
     u_char            zero;
 
+    unsigned          log_nomem:1;  // 申请失败时是否记录日志
+
     void             *data;
     void             *addr;
 } ngx_slab_pool_t;
@@ -54,6 +69,7 @@ void *ngx_slab_alloc(ngx_slab_pool_t *pool, size_t size);
 void *ngx_slab_alloc_locked(ngx_slab_pool_t *pool, size_t size);
 void ngx_slab_free(ngx_slab_pool_t *pool, void *p);
 void ngx_slab_free_locked(ngx_slab_pool_t *pool, void *p);
+ngx_uint_t ngx_slab_slots(ngx_slab_pool_t *pool);
 
 
 #endif /* _NGX_SLAB_H_INCLUDED_ */
@@ -68,12 +68,15 @@ int epoll_wait(int epfd, struct epoll_event *events, int nevents, int timeout)
     return -1;
 }
 
+#if (NGX_HAVE_EVENTFD)
+#define SYS_eventfd       323
+#endif
+
 #if (NGX_HAVE_FILE_AIO)
 
 #define SYS_io_setup      245
 #define SYS_io_destroy    246
 #define SYS_io_getevents  247
-#define SYS_eventfd       323
 
 typedef u_int  aio_context_t;
 
@@ -92,6 +95,7 @@ struct io_event {
 typedef struct {
     ngx_uint_t  events;
     ngx_uint_t  aio_requests;
+    ngx_flag_t  adaptive;
 } ngx_epoll_conf_t;
 
 
@@ -104,6 +108,11 @@ static ngx_int_t ngx_epoll_del_event(ngx_event_t *ev, ngx_int_t event,
 static ngx_int_t ngx_epoll_add_connection(ngx_connection_t *c);
 static ngx_int_t ngx_epoll_del_connection(ngx_connection_t *c,
     ngx_uint_t flags);
+#if (NGX_HAVE_EVENTFD)
+static ngx_int_t ngx_epoll_notify_init(ngx_log_t *log);
+static void ngx_epoll_notify_handler(ngx_event_t *ev);
+static ngx_int_t ngx_epoll_notify(ngx_event_handler_pt handler);
+#endif
 static ngx_int_t ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
     ngx_uint_t flags);
 
@@ -117,6 +126,14 @@ static char *ngx_epoll_init_conf(ngx_cycle_t *cycle, void *conf);
 static int                  ep = -1;    // epoll对象的描述符
 static struct epoll_event  *event_list;
 static ngx_uint_t           nevents;    // event_list数组的大小
+static ngx_uint_t           max_events; // event_list可以增长到的大小
+
+#if (NGX_HAVE_EVENTFD)
+// 其他线程(如线程池)通知事件循环所用的eventfd
+static int                  notify_fd = -1;
+static ngx_event_t          notify_event;
+static ngx_connection_t     notify_conn;
+#endif
 
 #if (NGX_HAVE_FILE_AIO)
 
@@ -166,6 +183,11 @@ ngx_event_module_t  ngx_epoll_module_ctx = {
         ngx_epoll_del_event,             /* disable an event */
         ngx_epoll_add_connection,        /* add an connection */
         ngx_epoll_del_connection,        /* delete an connection */
+#if (NGX_HAVE_EVENTFD)
+        ngx_epoll_notify,                /* trigger a notify */
+#else
+        NULL,                            /* trigger a notify */
+#endif
         NULL,                            /* process the changes */
         ngx_epoll_process_events,        /* process the events */
         ngx_epoll_init,                  /* init the events */
@@ -309,6 +331,12 @@ ngx_epoll_init(ngx_cycle_t *cycle, ngx_msec_t timer)
             return NGX_ERROR;
         }
 
+#if (NGX_HAVE_EVENTFD)
+        if (ngx_epoll_notify_init(cycle->log) != NGX_OK) {
+            ngx_epoll_module_ctx.actions.notify = NULL;
+        }
+#endif
+
 #if (NGX_HAVE_FILE_AIO)
 
         ngx_epoll_aio_init(cycle, epcf);
@@ -330,6 +358,14 @@ ngx_epoll_init(ngx_cycle_t *cycle, ngx_msec_t timer)
 
     nevents = epcf->events;
 
+    /*
+     * without the "epoll_events" directive the event list grows up to
+     * worker_connections while epoll_wait() returns it full
+     */
+
+    max_events = epcf->adaptive ? ngx_max(cycle->connection_n, nevents)
+                                : nevents;
+
     ngx_io = ngx_os_io;
 
     ngx_event_actions = ngx_epoll_module_ctx.actions;
@@ -358,6 +394,20 @@ ngx_epoll_done(ngx_cycle_t *cycle)
 
     ep = -1;
 
+#if (NGX_HAVE_EVENTFD)
+
+    if (notify_fd != -1) {
+
+        if (close(notify_fd) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "eventfd close() failed");
+        }
+
+        notify_fd = -1;
+    }
+
+#endif
+
 #if (NGX_HAVE_FILE_AIO)
 
     if (ngx_eventfd != -1) {
@@ -383,8 +433,112 @@ ngx_epoll_done(ngx_cycle_t *cycle)
 
     event_list = NULL;
     nevents = 0;
+    max_events = 0;
+}
+
+
+#if (NGX_HAVE_EVENTFD)
+
+static ngx_int_t
+ngx_epoll_notify_init(ngx_log_t *log)
+{
+    struct epoll_event  ee;
+
+#if (NGX_HAVE_SYS_EVENTFD_H)
+    notify_fd = eventfd(0, 0);
+#else
+    notify_fd = syscall(SYS_eventfd, 0);
+#endif
+
+    if (notify_fd == -1) {
+        ngx_log_error(NGX_LOG_EMERG, log, ngx_errno, "eventfd() failed");
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "notify eventfd: %d", notify_fd);
+
+    notify_event.handler = ngx_epoll_notify_handler;
+    notify_event.log = log;
+    notify_event.active = 1;
+
+    notify_conn.fd = notify_fd;
+    notify_conn.read = &notify_event;
+    notify_conn.log = log;
+
+    ee.events = EPOLLIN|EPOLLET;
+    ee.data.ptr = &notify_conn;
+
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, notify_fd, &ee) == -1) {
+        ngx_log_error(NGX_LOG_EMERG, log, ngx_errno,
+                      "epoll_ctl(EPOLL_CTL_ADD, eventfd) failed");
+
+        if (close(notify_fd) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          "eventfd close() failed");
+        }
+
+        notify_fd = -1;
+
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_epoll_notify_handler(ngx_event_t *ev)
+{
+    ssize_t               n;
+    uint64_t              count;
+    ngx_err_t             err;
+    ngx_event_handler_pt  handler;
+
+    /*
+     * the eventfd is edge-triggered and its counter is only drained
+     * before it could overflow
+     */
+
+    if (++ev->index == NGX_MAX_UINT32_VALUE) {
+        ev->index = 0;
+
+        n = read(notify_fd, &count, sizeof(uint64_t));
+
+        err = ngx_errno;
+
+        ngx_log_debug3(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                       "read() eventfd %d: %z count:%uL", notify_fd, n, count);
+
+        if ((size_t) n != sizeof(uint64_t)) {
+            ngx_log_error(NGX_LOG_ALERT, ev->log, err,
+                          "read() eventfd %d failed", notify_fd);
+        }
+    }
+
+    handler = ev->data;
+    handler(ev);
+}
+
+
+static ngx_int_t
+ngx_epoll_notify(ngx_event_handler_pt handler)
+{
+    static uint64_t inc = 1;
+
+    notify_event.data = handler;
+
+    if ((size_t) write(notify_fd, &inc, sizeof(uint64_t)) != sizeof(uint64_t)) {
+        ngx_log_error(NGX_LOG_ALERT, notify_event.log, ngx_errno,
+                      "write() to eventfd %d failed", notify_fd);
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
 }
 
+#endif
+
 
 static ngx_int_t
 ngx_epoll_add_event(ngx_event_t *ev, ngx_int_t event, ngx_uint_t flags)
@@ -431,6 +585,24 @@ ngx_epoll_add_event(ngx_event_t *ev, ngx_int_t event, ngx_uint_t flags)
                    c->fd, op, ee.events);
 
     if (epoll_ctl(ep, op, c->fd, &ee) == -1) {
+
+#if (NGX_HAVE_EPOLLEXCLUSIVE)
+
+        /*
+         * EPOLLEXCLUSIVE is rejected with EPOLL_CTL_MOD and by some
+         * kernels, fall back to an ordinary level-triggered registration
+         */
+
+        if ((flags & NGX_EXCLUSIVE_EVENT) && ngx_errno == NGX_EINVAL) {
+            ngx_log_error(NGX_LOG_NOTICE, ev->log, ngx_errno,
+                          "epoll_ctl(%d, %d) with EPOLLEXCLUSIVE failed, "
+                          "retrying without it", op, c->fd);
+
+            return ngx_epoll_add_event(ev, event, flags & ~NGX_EXCLUSIVE_EVENT);
+        }
+
+#endif
+
         ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_errno,
                       "epoll_ctl(%d, %d) failed", op, c->fd);
         return NGX_ERROR;
@@ -568,13 +740,14 @@ ngx_epoll_del_connection(ngx_connection_t *c, ngx_uint_t flags)
 static ngx_int_t
 ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer, ngx_uint_t flags)
 {
-    int                events;
-    uint32_t           revents;
-    ngx_int_t          instance, i;
-    ngx_uint_t         level;
-    ngx_err_t          err;
-    ngx_event_t       *rev, *wev, **queue;
-    ngx_connection_t  *c;
+    int                  events;
+    uint32_t             revents;
+    ngx_int_t            instance, i;
+    ngx_uint_t           level, n;
+    ngx_err_t            err;
+    ngx_event_t         *rev, *wev, **queue;
+    ngx_connection_t    *c, *next;
+    struct epoll_event  *list;
 
     /* NGX_TIMER_INFINITE == INFTIM */
 
@@ -623,6 +796,16 @@ ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer, ngx_uint_t flags)
 
     ngx_mutex_lock(ngx_posted_events_mutex);
 
+    /*
+     * the connections are prefetched for the whole batch,
+     * the events of the next connection are prefetched in the loop
+     */
+
+    for (i = 0; i < events; i++) {
+        ngx_prefetch((void *) ((uintptr_t) event_list[i].data.ptr
+                               & (uintptr_t) ~1));
+    }
+
     for (i = 0; i < events; i++) {
         c = event_list[i].data.ptr;
 
@@ -630,6 +813,13 @@ ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer, ngx_uint_t flags)
         instance = (uintptr_t) c & 1;
         c = (ngx_connection_t *) ((uintptr_t) c & (uintptr_t) ~1);
 
+        if (i + 1 < events) {
+            next = (ngx_connection_t *) ((uintptr_t) event_list[i + 1].data.ptr
+                                         & (uintptr_t) ~1);
+            ngx_prefetch(next->read);
+            ngx_prefetch(next->write);
+        }
+
         rev = c->read;
 
         // 判断过期事件
@@ -737,6 +927,23 @@ ngx_epoll_process_events(ngx_cycle_t *cycle, ngx_msec_t timer, ngx_uint_t flags)
 
     ngx_mutex_unlock(ngx_posted_events_mutex);
 
+    if ((ngx_uint_t) events == nevents && nevents < max_events) {
+
+        n = ngx_min(nevents * 2, max_events);
+
+        list = ngx_alloc(sizeof(struct epoll_event) * n, cycle->log);
+
+        if (list) {
+            ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                           "epoll events: %ui", n);
+
+            ngx_free(event_list);
+
+            event_list = list;
+            nevents = n;
+        }
+    }
+
     return NGX_OK;
 }
 
@@ -849,6 +1056,8 @@ ngx_epoll_init_conf(ngx_cycle_t *cycle, void *conf)
 {
     ngx_epoll_conf_t *epcf = conf;
 
+    epcf->adaptive = (epcf->events == NGX_CONF_UNSET_UINT);
+
     ngx_conf_init_uint_value(epcf->events, 512);
     ngx_conf_init_uint_value(epcf->aio_requests, 32);
 
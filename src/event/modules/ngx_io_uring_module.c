@@ -0,0 +1,930 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+
+
+/*
+ * The ring is used as a readiness notification mechanism only, as epoll
+ * is: the sockets are still read and written by the usual recv() and
+ * send() calls after a notification, there is no completion-based
+ * socket I/O.  Only the file aio reads are submitted to the ring.
+ *
+ * If the kernel supports multishot polls (Linux 5.13), every active event
+ * has an IORING_OP_POLL_ADD request with IORING_POLL_ADD_MULTI that stays
+ * in the ring and posts a completion on every wakeup, so the events are
+ * edge-triggered as for epoll with EPOLLET.  The listening sockets and
+ * the events on older kernels use one-shot requests that are rearmed
+ * after the notification while the event stays active, so these events
+ * are level-triggered as for poll().  All requests queued while an
+ * iteration handles the events are submitted by the single io_uring_enter()
+ * that waits for the next completions.
+ *
+ * The completion user_data is the event pointer with the instance bit,
+ * file aio reads are marked with NGX_IO_URING_FILE, and the cancel
+ * requests have zero user_data.
+ */
+
+#define NGX_IO_URING_FILE  2
+
+
+typedef struct {
+    ngx_uint_t  entries;
+} ngx_io_uring_conf_t;
+
+
+static ngx_int_t ngx_io_uring_init(ngx_cycle_t *cycle, ngx_msec_t timer);
+static ngx_int_t ngx_io_uring_setup(ngx_cycle_t *cycle,
+    ngx_io_uring_conf_t *iucf);
+static ngx_uint_t ngx_io_uring_probe_multishot(ngx_log_t *log);
+static void ngx_io_uring_done(ngx_cycle_t *cycle);
+static ngx_int_t ngx_io_uring_add_event(ngx_event_t *ev, ngx_int_t event,
+    ngx_uint_t flags);
+static ngx_int_t ngx_io_uring_del_event(ngx_event_t *ev, ngx_int_t event,
+    ngx_uint_t flags);
+static ngx_int_t ngx_io_uring_poll(ngx_event_t *ev);
+static struct io_uring_sqe *ngx_io_uring_get_sqe(ngx_log_t *log);
+static ngx_int_t ngx_io_uring_submit(ngx_log_t *log);
+#if (NGX_HAVE_EVENTFD)
+static ngx_int_t ngx_io_uring_notify_init(ngx_log_t *log);
+static void ngx_io_uring_notify_handler(ngx_event_t *ev);
+static ngx_int_t ngx_io_uring_notify(ngx_event_handler_pt handler);
+#endif
+static ngx_int_t ngx_io_uring_process_events(ngx_cycle_t *cycle,
+    ngx_msec_t timer, ngx_uint_t flags);
+
+static void *ngx_io_uring_create_conf(ngx_cycle_t *cycle);
+static char *ngx_io_uring_init_conf(ngx_cycle_t *cycle, void *conf);
+
+
+static int io_uring_setup(u_int entries, struct io_uring_params *p);
+static int io_uring_enter(int fd, u_int to_submit, u_int min_complete,
+    u_int flags, void *arg, size_t argsz);
+
+
+static int                   ring = -1;
+
+static void                 *sq_ring;
+static size_t                sq_ring_size;
+static void                 *cq_ring;
+static size_t                cq_ring_size;
+static struct io_uring_sqe  *sqes;
+static size_t                sqes_size;
+
+static uint32_t             *sq_head;
+static uint32_t             *sq_tail;
+static uint32_t              sq_mask;
+static uint32_t              sq_entries;
+static uint32_t              sq_local_tail;  // 已填写但尚未提交的SQE的尾部
+static ngx_uint_t            nsubmit;        // 等待提交的SQE数量
+static ngx_uint_t            multishot;      // 内核是否支持multishot poll
+
+static uint32_t             *cq_head;
+static uint32_t             *cq_tail;
+static uint32_t              cq_mask;
+static struct io_uring_cqe  *cqes;
+
+#if (NGX_HAVE_EVENTFD)
+static int                   notify_fd = -1;
+static ngx_event_t           notify_event;
+static ngx_connection_t      notify_conn;
+static ngx_event_handler_pt  notify_handler;
+#endif
+
+#if (NGX_HAVE_FILE_AIO)
+// 文件异步读是否经由io_uring，ngx_file_aio_read()据此选择提交方式
+ngx_uint_t                   ngx_io_uring_file_aio;
+#endif
+
+static ngx_str_t      io_uring_name = ngx_string("io_uring");
+
+/*
+ * "use io_uring" selects a readiness notification engine, the sockets
+ * are not read or written through the ring; "io_uring_entries" sets
+ * the size of the submission queue
+ */
+
+static ngx_command_t  ngx_io_uring_commands[] = {
+
+    { ngx_string("io_uring_entries"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      0,
+      offsetof(ngx_io_uring_conf_t, entries),
+      NULL },
+
+      ngx_null_command
+};
+
+
+ngx_event_module_t  ngx_io_uring_module_ctx = {
+    &io_uring_name,
+    ngx_io_uring_create_conf,            /* create configuration */
+    ngx_io_uring_init_conf,              /* init configuration */
+
+    {
+        ngx_io_uring_add_event,          /* add an event */
+        ngx_io_uring_del_event,          /* delete an event */
+        ngx_io_uring_add_event,          /* enable an event */
+        ngx_io_uring_del_event,          /* disable an event */
+        NULL,                            /* add an connection */
+        NULL,                            /* delete an connection */
+#if (NGX_HAVE_EVENTFD)
+        ngx_io_uring_notify,             /* trigger a notify */
+#else
+        NULL,                            /* trigger a notify */
+#endif
+        NULL,                            /* process the changes */
+        ngx_io_uring_process_events,     /* process the events */
+        ngx_io_uring_init,               /* init the events */
+        ngx_io_uring_done,               /* done the events */
+    }
+};
+
+ngx_module_t  ngx_io_uring_module = {
+    NGX_MODULE_V1,
+    &ngx_io_uring_module_ctx,            /* module context */
+    ngx_io_uring_commands,               /* module directives */
+    NGX_EVENT_MODULE,                    /* module type */
+    NULL,                                /* init master */
+    NULL,                                /* init module */
+    NULL,                                /* init process */
+    NULL,                                /* init thread */
+    NULL,                                /* exit thread */
+    NULL,                                /* exit process */
+    NULL,                                /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+/*
+ * We call io_uring_setup() and io_uring_enter() as syscalls
+ * to not depend on liburing.
+ */
+
+static int
+io_uring_setup(u_int entries, struct io_uring_params *p)
+{
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+
+static int
+io_uring_enter(int fd, u_int to_submit, u_int min_complete, u_int flags,
+    void *arg, size_t argsz)
+{
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags,
+                   arg, argsz);
+}
+
+
+static ngx_int_t
+ngx_io_uring_init(ngx_cycle_t *cycle, ngx_msec_t timer)
+{
+    ngx_io_uring_conf_t  *iucf;
+
+    iucf = ngx_event_get_conf(cycle->conf_ctx, ngx_io_uring_module);
+
+    if (ring == -1) {
+        if (ngx_io_uring_setup(cycle, iucf) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+#if (NGX_HAVE_EVENTFD)
+        if (ngx_io_uring_notify_init(cycle->log) != NGX_OK) {
+            ngx_io_uring_module_ctx.actions.notify = NULL;
+        }
+#endif
+
+#if (NGX_HAVE_FILE_AIO)
+        ngx_io_uring_file_aio = 1;
+#endif
+    }
+
+    ngx_io = ngx_os_io;
+
+    ngx_event_actions = ngx_io_uring_module_ctx.actions;
+
+    if (multishot) {
+        ngx_event_flags = NGX_USE_CLEAR_EVENT|NGX_USE_GREEDY_EVENT;
+
+    } else {
+        ngx_event_flags = NGX_USE_LEVEL_EVENT;
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_setup(ngx_cycle_t *cycle, ngx_io_uring_conf_t *iucf)
+{
+    uint32_t                *array, i;
+    struct io_uring_params   p;
+
+    /*
+     * the ring is used by the worker thread only, and the completions
+     * are needed only when the worker waits for them
+     */
+
+    ngx_memzero(&p, sizeof(struct io_uring_params));
+    p.flags = IORING_SETUP_SINGLE_ISSUER|IORING_SETUP_DEFER_TASKRUN;
+
+    ring = io_uring_setup(iucf->entries, &p);
+
+    if (ring == -1 && ngx_errno == NGX_EINVAL) {
+        ngx_memzero(&p, sizeof(struct io_uring_params));
+        ring = io_uring_setup(iucf->entries, &p);
+    }
+
+    if (ring == -1) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                      "io_uring_setup(%ui) failed", iucf->entries);
+        return NGX_ERROR;
+    }
+
+    if (!(p.features & IORING_FEAT_EXT_ARG)) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, 0,
+                      "io_uring does not support IORING_FEAT_EXT_ARG");
+        goto failed;
+    }
+
+    sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size = ngx_max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = mmap(NULL, sq_ring_size, PROT_READ|PROT_WRITE,
+                   MAP_SHARED|MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+
+    if (sq_ring == MAP_FAILED) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                      "mmap(IORING_OFF_SQ_RING) failed");
+        sq_ring = NULL;
+        goto failed;
+    }
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring = sq_ring;
+
+    } else {
+        cq_ring = mmap(NULL, cq_ring_size, PROT_READ|PROT_WRITE,
+                       MAP_SHARED|MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+
+        if (cq_ring == MAP_FAILED) {
+            ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                          "mmap(IORING_OFF_CQ_RING) failed");
+            cq_ring = NULL;
+            goto failed;
+        }
+    }
+
+    sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    sqes = mmap(NULL, sqes_size, PROT_READ|PROT_WRITE,
+                MAP_SHARED|MAP_POPULATE, ring, IORING_OFF_SQES);
+
+    if (sqes == MAP_FAILED) {
+        ngx_log_error(NGX_LOG_EMERG, cycle->log, ngx_errno,
+                      "mmap(IORING_OFF_SQES) failed");
+        sqes = NULL;
+        goto failed;
+    }
+
+    sq_head = (uint32_t *) ((u_char *) sq_ring + p.sq_off.head);
+    sq_tail = (uint32_t *) ((u_char *) sq_ring + p.sq_off.tail);
+    sq_mask = *(uint32_t *) ((u_char *) sq_ring + p.sq_off.ring_mask);
+    sq_entries = p.sq_entries;
+    sq_local_tail = *sq_tail;
+    nsubmit = 0;
+
+    /* the submission queue entries are used in order */
+
+    array = (uint32_t *) ((u_char *) sq_ring + p.sq_off.array);
+
+    for (i = 0; i < sq_entries; i++) {
+        array[i] = i;
+    }
+
+    cq_head = (uint32_t *) ((u_char *) cq_ring + p.cq_off.head);
+    cq_tail = (uint32_t *) ((u_char *) cq_ring + p.cq_off.tail);
+    cq_mask = *(uint32_t *) ((u_char *) cq_ring + p.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe *) ((u_char *) cq_ring + p.cq_off.cqes);
+
+    multishot = ngx_io_uring_probe_multishot(cycle->log);
+
+    ngx_log_debug4(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "io_uring: %d sq:%uD cq:%uD multishot:%ui",
+                   ring, p.sq_entries, p.cq_entries, multishot);
+
+    return NGX_OK;
+
+failed:
+
+    ngx_io_uring_done(cycle);
+
+    return NGX_ERROR;
+}
+
+
+static ngx_uint_t
+ngx_io_uring_probe_multishot(ngx_log_t *log)
+{
+    int                   n, fd[2];
+    uint32_t              head, tail;
+    ngx_uint_t            found;
+    struct io_uring_sqe  *sqe;
+    struct io_uring_cqe  *cqe;
+
+    /*
+     * a multishot poll for POLLOUT on an empty pipe completes at once
+     * and stays in the ring, the kernels without multishot polls
+     * fail the request with -EINVAL
+     */
+
+    if (pipe(fd) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno, "pipe() failed");
+        return 0;
+    }
+
+    found = 0;
+
+    sqe = ngx_io_uring_get_sqe(log);
+    if (sqe == NULL) {
+        goto done;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd[1];
+    sqe->len = IORING_POLL_ADD_MULTI;
+#if (NGX_HAVE_LITTLE_ENDIAN)
+    sqe->poll32_events = POLLOUT;
+#else
+    sqe->poll32_events = (POLLOUT << 16) | (POLLOUT >> 16);
+#endif
+    sqe->user_data = 0;
+
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+
+    n = io_uring_enter(ring, (u_int) nsubmit, 1, IORING_ENTER_GETEVENTS,
+                       NULL, 0);
+
+    if (n == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno, "io_uring_enter() failed");
+        goto done;
+    }
+
+    nsubmit -= n;
+
+    head = *cq_head;
+    tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+    for ( /* void */ ; head != tail; head++) {
+        cqe = &cqes[head & cq_mask];
+
+        if (cqe->user_data == 0 && (cqe->flags & IORING_CQE_F_MORE)) {
+            found = 1;
+        }
+    }
+
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+    if (found) {
+
+        /* the completions of the cancel have zero user_data as well */
+
+        sqe = ngx_io_uring_get_sqe(log);
+        if (sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = 0;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+            sqe->user_data = 0;
+        }
+    }
+
+done:
+
+    if (close(fd[0]) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno, "close() pipe failed");
+    }
+
+    if (close(fd[1]) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno, "close() pipe failed");
+    }
+
+    return found;
+}
+
+
+static void
+ngx_io_uring_done(ngx_cycle_t *cycle)
+{
+    if (sqes) {
+        munmap(sqes, sqes_size);
+        sqes = NULL;
+    }
+
+    if (cq_ring && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+
+    cq_ring = NULL;
+
+    if (sq_ring) {
+        munmap(sq_ring, sq_ring_size);
+        sq_ring = NULL;
+    }
+
+    if (ring != -1 && close(ring) == -1) {
+        ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                      "io_uring close() failed");
+    }
+
+    ring = -1;
+
+#if (NGX_HAVE_EVENTFD)
+
+    if (notify_fd != -1) {
+
+        if (close(notify_fd) == -1) {
+            ngx_log_error(NGX_LOG_ALERT, cycle->log, ngx_errno,
+                          "eventfd close() failed");
+        }
+
+        notify_fd = -1;
+    }
+
+#endif
+
+#if (NGX_HAVE_FILE_AIO)
+    ngx_io_uring_file_aio = 0;
+#endif
+
+    nsubmit = 0;
+    multishot = 0;
+}
+
+
+static ngx_int_t
+ngx_io_uring_add_event(ngx_event_t *ev, ngx_int_t event, ngx_uint_t flags)
+{
+    ev->active = 1;
+
+    /*
+     * the oneshot flag means that the poll request is in the ring,
+     * a multishot request stays there until it is cancelled
+     */
+
+    if (ev->oneshot) {
+        return NGX_OK;
+    }
+
+    return ngx_io_uring_poll(ev);
+}
+
+
+static ngx_int_t
+ngx_io_uring_del_event(ngx_event_t *ev, ngx_int_t event, ngx_uint_t flags)
+{
+    struct io_uring_sqe  *sqe;
+
+    ev->active = 0;
+
+    if (!ev->oneshot) {
+        return NGX_OK;
+    }
+
+    /*
+     * the poll request holds a reference to the socket, so it is cancelled
+     * even if the socket is going to be closed; all requests of the event
+     * are cancelled, as the poll may have been rearmed while its previous
+     * completion was not handled yet
+     */
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "io_uring del event: fd:%d ev:%i",
+                   ((ngx_connection_t *) ev->data)->fd, event);
+
+    sqe = ngx_io_uring_get_sqe(ev->log);
+    if (sqe == NULL) {
+        return NGX_ERROR;
+    }
+
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uintptr_t) ev | ev->instance;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = 0;
+
+    ev->oneshot = 0;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_io_uring_poll(ngx_event_t *ev)
+{
+    uint32_t              events;
+    ngx_connection_t     *c;
+    struct io_uring_sqe  *sqe;
+
+    c = ev->data;
+
+    events = ev->write ? POLLOUT : POLLIN;
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "io_uring poll: fd:%d ev:%04XD multishot:%ui",
+                   c->fd, events, multishot && !ev->accept);
+
+    sqe = ngx_io_uring_get_sqe(ev->log);
+    if (sqe == NULL) {
+        return NGX_ERROR;
+    }
+
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = c->fd;
+#if (NGX_HAVE_LITTLE_ENDIAN)
+    sqe->poll32_events = events;
+#else
+    sqe->poll32_events = (events << 16) | (events >> 16);
+#endif
+    sqe->user_data = (uintptr_t) ev | ev->instance;
+
+    /*
+     * a listening socket stays level-triggered, as a single notification
+     * is not repeated for the connections that are left in the backlog
+     */
+
+    if (multishot && !ev->accept) {
+        sqe->len = IORING_POLL_ADD_MULTI;
+    }
+
+    ev->oneshot = 1;
+
+    return NGX_OK;
+}
+
+
+static struct io_uring_sqe *
+ngx_io_uring_get_sqe(ngx_log_t *log)
+{
+    struct io_uring_sqe  *sqe;
+
+    if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)
+        == sq_entries)
+    {
+        /* the submission queue is full, submit it without waiting */
+
+        if (ngx_io_uring_submit(log) != NGX_OK) {
+            return NULL;
+        }
+
+        if (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)
+            == sq_entries)
+        {
+            ngx_log_error(NGX_LOG_ALERT, log, 0,
+                          "io_uring submission queue overflow");
+            return NULL;
+        }
+    }
+
+    sqe = &sqes[sq_local_tail & sq_mask];
+
+    ngx_memzero(sqe, sizeof(struct io_uring_sqe));
+
+    sq_local_tail++;
+    nsubmit++;
+
+    return sqe;
+}
+
+
+static ngx_int_t
+ngx_io_uring_submit(ngx_log_t *log)
+{
+    int  n;
+
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+
+    n = io_uring_enter(ring, (u_int) nsubmit, 0, 0, NULL, 0);
+
+    if (n == -1) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      "io_uring_enter() failed");
+        return NGX_ERROR;
+    }
+
+    nsubmit -= n;
+
+    return NGX_OK;
+}
+
+
+#if (NGX_HAVE_FILE_AIO)
+
+ngx_int_t
+ngx_io_uring_read_file(ngx_event_aio_t *aio, u_char *buf, size_t size,
+    off_t offset)
+{
+    struct io_uring_sqe  *sqe;
+
+    sqe = ngx_io_uring_get_sqe(aio->event.log);
+    if (sqe == NULL) {
+        return NGX_ERROR;
+    }
+
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = aio->fd;
+    sqe->addr = (uintptr_t) buf;
+    sqe->len = (uint32_t) size;
+    sqe->off = offset;
+    sqe->user_data = (uintptr_t) &aio->event | NGX_IO_URING_FILE;
+
+    return NGX_OK;
+}
+
+#endif
+
+
+#if (NGX_HAVE_EVENTFD)
+
+static ngx_int_t
+ngx_io_uring_notify_init(ngx_log_t *log)
+{
+#if (NGX_HAVE_SYS_EVENTFD_H)
+    notify_fd = eventfd(0, 0);
+#else
+    notify_fd = syscall(SYS_eventfd, 0);
+#endif
+
+    if (notify_fd == -1) {
+        ngx_log_error(NGX_LOG_EMERG, log, ngx_errno, "eventfd() failed");
+        return NGX_ERROR;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_EVENT, log, 0,
+                   "notify eventfd: %d", notify_fd);
+
+    notify_event.handler = ngx_io_uring_notify_handler;
+    notify_event.data = &notify_conn;
+    notify_event.log = log;
+    notify_event.active = 1;
+
+    notify_conn.fd = notify_fd;
+    notify_conn.read = &notify_event;
+    notify_conn.log = log;
+
+    return ngx_io_uring_poll(&notify_event);
+}
+
+
+static void
+ngx_io_uring_notify_handler(ngx_event_t *ev)
+{
+    ssize_t    n;
+    uint64_t   count;
+    ngx_err_t  err;
+
+    /*
+     * the counter is drained on each notification, so the next write
+     * wakes the poll up again whether it is rearmed or multishot
+     */
+
+    n = read(notify_fd, &count, sizeof(uint64_t));
+
+    err = ngx_errno;
+
+    ngx_log_debug3(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                   "read() eventfd %d: %z count:%uL", notify_fd, n, count);
+
+    if ((size_t) n != sizeof(uint64_t)) {
+        ngx_log_error(NGX_LOG_ALERT, ev->log, err,
+                      "read() eventfd %d failed", notify_fd);
+    }
+
+    ev->ready = 0;
+
+    notify_handler(ev);
+}
+
+
+static ngx_int_t
+ngx_io_uring_notify(ngx_event_handler_pt handler)
+{
+    static uint64_t inc = 1;
+
+    notify_handler = handler;
+
+    if ((size_t) write(notify_fd, &inc, sizeof(uint64_t)) != sizeof(uint64_t)) {
+        ngx_log_error(NGX_LOG_ALERT, notify_event.log, ngx_errno,
+                      "write() to eventfd %d failed", notify_fd);
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
+static ngx_int_t
+ngx_io_uring_process_events(ngx_cycle_t *cycle, ngx_msec_t timer,
+    ngx_uint_t flags)
+{
+    int                             n;
+    uint32_t                        head, tail;
+    uint64_t                        data;
+    ngx_int_t                       instance;
+    ngx_uint_t                      level;
+    ngx_err_t                       err;
+    ngx_event_t                    *ev, **queue;
+    struct io_uring_cqe            *cqe;
+    struct __kernel_timespec        ts;
+    struct io_uring_getevents_arg   arg;
+#if (NGX_HAVE_FILE_AIO)
+    ngx_event_aio_t                *aio;
+#endif
+
+    ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                   "io_uring timer: %M, submit: %ui", timer, nsubmit);
+
+    ngx_memzero(&arg, sizeof(struct io_uring_getevents_arg));
+
+    if (timer != NGX_TIMER_INFINITE) {
+        ts.tv_sec = timer / 1000;
+        ts.tv_nsec = (timer % 1000) * 1000000;
+        arg.ts = (uint64_t) (uintptr_t) &ts;
+    }
+
+    /* the requests queued since the last iteration are submitted here */
+
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+
+    n = io_uring_enter(ring, (u_int) nsubmit, 1,
+                       IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG,
+                       &arg, sizeof(struct io_uring_getevents_arg));
+
+    err = (n == -1) ? ngx_errno : 0;
+
+    if (n > 0) {
+        nsubmit -= n;
+    }
+
+    if (flags & NGX_UPDATE_TIME || ngx_event_timer_alarm) {
+        ngx_time_update();
+    }
+
+    if (err && err != ETIME && err != NGX_EBUSY) {
+        if (err == NGX_EINTR) {
+
+            if (ngx_event_timer_alarm) {
+                ngx_event_timer_alarm = 0;
+                return NGX_OK;
+            }
+
+            level = NGX_LOG_INFO;
+
+        } else {
+            level = NGX_LOG_ALERT;
+        }
+
+        ngx_log_error(level, cycle->log, err, "io_uring_enter() failed");
+        return NGX_ERROR;
+    }
+
+    ngx_mutex_lock(ngx_posted_events_mutex);
+
+    head = *cq_head;
+    tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+    for ( /* void */ ; head != tail; head++) {
+        cqe = &cqes[head & cq_mask];
+
+        data = cqe->user_data;
+
+        ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                       "io_uring cqe: %uXL res:%d", data, cqe->res);
+
+        if (data == 0) {
+            continue;
+        }
+
+#if (NGX_HAVE_FILE_AIO)
+
+        if (data & NGX_IO_URING_FILE) {
+            ev = (ngx_event_t *) (uintptr_t) (data & ~NGX_IO_URING_FILE);
+
+            ev->complete = 1;
+            ev->active = 0;
+            ev->ready = 1;
+
+            aio = ev->data;
+            aio->res = cqe->res;
+
+            ngx_locked_post_event(ev, &ngx_posted_events);
+
+            continue;
+        }
+
+#endif
+
+        instance = data & 1;
+        ev = (ngx_event_t *) (uintptr_t) (data & (uint64_t) ~1);
+
+        if (ev->closed || ev->instance != instance
+            || cqe->res == -ECANCELED)
+        {
+            /*
+             * the stale event from a file descriptor
+             * that was just closed in this iteration
+             */
+
+            ngx_log_debug1(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                           "io_uring: stale event %p", ev);
+            continue;
+        }
+
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+
+            /* a one-shot request or a terminated multishot request */
+
+            ev->oneshot = 0;
+        }
+
+        if (!ev->active) {
+            continue;
+        }
+
+        if (cqe->res < 0) {
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, cycle->log, 0,
+                           "io_uring poll error fd:%d res:%d",
+                           ((ngx_connection_t *) ev->data)->fd, cqe->res);
+        }
+
+        if ((flags & NGX_POST_THREAD_EVENTS) && !ev->accept) {
+            ev->posted_ready = 1;
+
+        } else {
+            ev->ready = 1;
+        }
+
+        if (flags & NGX_POST_EVENTS) {
+            queue = (ngx_event_t **) (ev->accept ?
+                           &ngx_posted_accept_events : &ngx_posted_events);
+
+            ngx_locked_post_event(ev, queue);
+
+        } else {
+            ev->handler(ev);
+        }
+
+        if (ev->active && !ev->oneshot
+            && !ev->closed && ev->instance == instance)
+        {
+            (void) ngx_io_uring_poll(ev);
+        }
+    }
+
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+    ngx_mutex_unlock(ngx_posted_events_mutex);
+
+    return NGX_OK;
+}
+
+
+static void *
+ngx_io_uring_create_conf(ngx_cycle_t *cycle)
+{
+    ngx_io_uring_conf_t  *iucf;
+
+    iucf = ngx_palloc(cycle->pool, sizeof(ngx_io_uring_conf_t));
+    if (iucf == NULL) {
+        return NULL;
+    }
+
+    iucf->entries = NGX_CONF_UNSET;
+
+    return iucf;
+}
+
+
+static char *
+ngx_io_uring_init_conf(ngx_cycle_t *cycle, void *conf)
+{
+    ngx_io_uring_conf_t *iucf = conf;
+
+    ngx_conf_init_uint_value(iucf->entries, 1024);
+
+    return NGX_CONF_OK;
+}
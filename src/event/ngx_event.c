@@ -23,6 +23,10 @@ extern ngx_module_t ngx_select_module;
 
 static char *ngx_event_init_conf(ngx_cycle_t *cycle, void *conf);
 static ngx_int_t ngx_event_module_init(ngx_cycle_t *cycle);
+#if (NGX_STAT_STUB)
+static ngx_int_t ngx_event_listening_stat_init(ngx_cycle_t *cycle,
+    ngx_uint_t shared);
+#endif
 static ngx_int_t ngx_event_process_init(ngx_cycle_t *cycle);
 static char *ngx_events_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
 
@@ -54,6 +58,7 @@ ngx_shmtx_t           ngx_accept_mutex;
 ngx_uint_t            ngx_use_accept_mutex;
 ngx_uint_t            ngx_accept_events;
 ngx_uint_t            ngx_accept_mutex_held;
+ngx_uint_t            ngx_use_exclusive_accept;
 ngx_msec_t            ngx_accept_mutex_delay;
 ngx_int_t             ngx_accept_disabled;
 ngx_file_t            ngx_accept_mutex_lock_file;
@@ -127,6 +132,13 @@ ngx_module_t  ngx_events_module = {
 static ngx_str_t  event_core_name = ngx_string("event_core");
 
 
+static ngx_conf_enum_t  ngx_event_timer_engines[] = {
+    { ngx_string("rbtree"), NGX_EVENT_TIMER_RBTREE },
+    { ngx_string("wheel"), NGX_EVENT_TIMER_WHEEL },
+    { ngx_null_string, 0 }
+};
+
+
 static ngx_command_t  ngx_event_core_commands[] = {
 
     { ngx_string("worker_connections"),
@@ -157,6 +169,13 @@ static ngx_command_t  ngx_event_core_commands[] = {
       offsetof(ngx_event_conf_t, multi_accept),
       NULL },
 
+    { ngx_string("accept_batch"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      0,
+      offsetof(ngx_event_conf_t, accept_batch),
+      NULL },
+
     { ngx_string("accept_mutex"),
       NGX_EVENT_CONF|NGX_CONF_FLAG,
       ngx_conf_set_flag_slot,
@@ -171,6 +190,13 @@ static ngx_command_t  ngx_event_core_commands[] = {
       offsetof(ngx_event_conf_t, accept_mutex_delay),
       NULL },
 
+    { ngx_string("timer_engine"),
+      NGX_EVENT_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_enum_slot,
+      0,
+      offsetof(ngx_event_conf_t, timer_engine),
+      &ngx_event_timer_engines },
+
     { ngx_string("debug_connection"),
       NGX_EVENT_CONF|NGX_CONF_TAKE1,
       ngx_event_debug_connection,
@@ -187,7 +213,7 @@ ngx_event_module_t  ngx_event_core_module_ctx = {
     ngx_event_core_create_conf,            /* create configuration */
     ngx_event_core_init_conf,              /* init configuration */
 
-    { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL }
+    { NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL }
 };
 
 
@@ -293,6 +319,8 @@ ngx_process_events_and_timers(ngx_cycle_t *cycle)
             ngx_event_process_posted(cycle, &ngx_posted_events);
         }
     }
+
+    ngx_pool_cache_sync(0);
 }
 
 
@@ -505,6 +533,13 @@ ngx_event_module_init(ngx_cycle_t *cycle)
     }
 #endif /* !(NGX_WIN32) */
 
+#if (NGX_STAT_STUB)
+
+    if (ngx_event_listening_stat_init(cycle, ccf->master) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+#endif
 
     if (ccf->master == 0) {
         return NGX_OK;
@@ -535,7 +570,10 @@ ngx_event_module_init(ngx_cycle_t *cycle)
            + cl          /* ngx_stat_active */
            + cl          /* ngx_stat_reading */
            + cl          /* ngx_stat_writing */
-           + cl;         /* ngx_stat_waiting */
+           + cl          /* ngx_stat_waiting */
+           + cl          /* ngx_stat_pool_hits */
+           + cl          /* ngx_stat_pool_misses */
+           + cl;         /* ngx_stat_pool_cached */
 
 #endif
 
@@ -587,6 +625,9 @@ ngx_event_module_init(ngx_cycle_t *cycle)
     ngx_stat_reading = (ngx_atomic_t *) (shared + 7 * cl);
     ngx_stat_writing = (ngx_atomic_t *) (shared + 8 * cl);
     ngx_stat_waiting = (ngx_atomic_t *) (shared + 9 * cl);
+    ngx_stat_pool_hits = (ngx_atomic_t *) (shared + 10 * cl);
+    ngx_stat_pool_misses = (ngx_atomic_t *) (shared + 11 * cl);
+    ngx_stat_pool_cached = (ngx_atomic_t *) (shared + 12 * cl);
 
 #endif
 
@@ -594,6 +635,82 @@ ngx_event_module_init(ngx_cycle_t *cycle)
 }
 
 
+#if (NGX_STAT_STUB)
+
+static ngx_int_t
+ngx_event_listening_stat_init(ngx_cycle_t *cycle, ngx_uint_t shared)
+{
+    u_char            *p;
+    size_t             cl, size;
+    ngx_uint_t         i;
+    ngx_shm_t          shm;
+    ngx_listening_t   *ls, *prev;
+    static ngx_shm_t   stat_shm;
+
+    /*
+     * the listening sockets may change on reload, so the counters
+     * are allocated for each cycle, and the counters of the kept
+     * sockets are carried over from the previous cycle
+     */
+
+    if (cycle->listening.nelts == 0) {
+        return NGX_OK;
+    }
+
+    /* the workers update the counters of a socket, so they take a line */
+
+    cl = 128;
+
+    size = cl * cycle->listening.nelts;
+
+    if (shared) {
+        shm.size = size;
+        shm.name.len = sizeof("nginx_listening_zone");
+        shm.name.data = (u_char *) "nginx_listening_zone";
+        shm.log = cycle->log;
+
+        if (ngx_shm_alloc(&shm) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        p = shm.addr;
+
+    } else {
+        p = ngx_pcalloc(cycle->pool, size);
+        if (p == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    ls = cycle->listening.elts;
+
+    for (i = 0; i < cycle->listening.nelts; i++) {
+        ls[i].stat_accepted = (ngx_atomic_t *) (p + i * cl);
+        ls[i].stat_dropped = ls[i].stat_accepted + 1;
+
+        prev = ls[i].previous;
+
+        if (prev && prev->stat_accepted) {
+            *ls[i].stat_accepted = *prev->stat_accepted;
+            *ls[i].stat_dropped = *prev->stat_dropped;
+        }
+    }
+
+    if (stat_shm.addr) {
+        ngx_shm_free(&stat_shm);
+        stat_shm.addr = NULL;
+    }
+
+    if (shared) {
+        stat_shm = shm;
+    }
+
+    return NGX_OK;
+}
+
+#endif
+
+
 #if !(NGX_WIN32)
 
 static void
@@ -613,9 +730,9 @@ static ngx_int_t
 ngx_event_process_init(ngx_cycle_t *cycle)
 {
     ngx_uint_t           m, i;
-    ngx_event_t         *rev, *wev;
+    ngx_event_t         *rev;
     ngx_listening_t     *ls;
-    ngx_connection_t    *c, *next, *old;
+    ngx_connection_t    *c, *old;
     ngx_core_conf_t     *ccf;
     ngx_event_conf_t    *ecf;
     ngx_event_module_t  *module;
@@ -650,6 +767,8 @@ ngx_event_process_init(ngx_cycle_t *cycle)
     }
 #endif
 
+    ngx_event_timer_wheel = (ecf->timer_engine == NGX_EVENT_TIMER_WHEEL);
+
     if (ngx_event_timer_init(cycle->log) == NGX_ERROR) {
         return NGX_ERROR;
     }
@@ -674,6 +793,26 @@ ngx_event_process_init(ngx_cycle_t *cycle)
         break;
     }
 
+#if (NGX_HAVE_EPOLLEXCLUSIVE)
+
+    /*
+     * without the accept mutex all workers wait on the same listening
+     * sockets, EPOLLEXCLUSIVE lets the kernel wake up only one of them
+     */
+
+    if ((ngx_event_flags & NGX_USE_EPOLL_EVENT)
+        && !ngx_use_accept_mutex
+        && ccf->master
+        && ccf->worker_processes > 1)
+    {
+        ngx_use_exclusive_accept = 1;
+
+    } else {
+        ngx_use_exclusive_accept = 0;
+    }
+
+#endif
+
 #if !(NGX_WIN32)
     // 从配置文件中控制时间精度
     if (ngx_timer_resolution && !(ngx_event_flags & NGX_USE_TIMER_EVENT)) {
@@ -722,75 +861,22 @@ ngx_event_process_init(ngx_cycle_t *cycle)
 
 #endif
 
-    // 预分配connections连接池，因为事件驱动就是直接驱动connection的
-    cycle->connections =
-        ngx_alloc(sizeof(ngx_connection_t) * cycle->connection_n, cycle->log);
-    if (cycle->connections == NULL) {
-        return NGX_ERROR;
-    }
-
-    c = cycle->connections;
-
-    // 预分配读事件
-    cycle->read_events = ngx_alloc(sizeof(ngx_event_t) * cycle->connection_n,
-                                   cycle->log);
-    if (cycle->read_events == NULL) {
-        return NGX_ERROR;
-    }
-
-    rev = cycle->read_events;
-    for (i = 0; i < cycle->connection_n; i++) {
-        rev[i].closed = 1;
-        rev[i].instance = 1;
-#if (NGX_THREADS)
-        rev[i].lock = &c[i].lock;
-        rev[i].own_lock = &c[i].lock;
-#endif
-    }
-
-    // 预分配写事件
-    cycle->write_events = ngx_alloc(sizeof(ngx_event_t) * cycle->connection_n,
-                                    cycle->log);
-    if (cycle->write_events == NULL) {
+    if (ngx_event_connections_init(cycle) != NGX_OK) {
         return NGX_ERROR;
     }
 
-    wev = cycle->write_events;
-    for (i = 0; i < cycle->connection_n; i++) {
-        wev[i].closed = 1;
-#if (NGX_THREADS)
-        wev[i].lock = &c[i].lock;
-        wev[i].own_lock = &c[i].lock;
-#endif
-    }
-
-    i = cycle->connection_n;
-    next = NULL;
-
-    // 每个connection都分配一个read和一个write事件
-    do {
-        i--;
-
-        c[i].data = next;
-        c[i].read = &cycle->read_events[i];
-        c[i].write = &cycle->write_events[i];
-        c[i].fd = (ngx_socket_t) -1;
-
-        next = &c[i];
-
-#if (NGX_THREADS)
-        c[i].lock = 0;
-#endif
-    } while (i);
-
-    cycle->free_connections = next;
-    cycle->free_connection_n = cycle->connection_n;
-
     /* for each listening socket */
 
     ls = cycle->listening.elts;
     for (i = 0; i < cycle->listening.nelts; i++) {
 
+#if (NGX_HAVE_REUSEPORT)
+        // reuseport的socket每个worker一个，只处理属于自己的那个
+        if (ls[i].reuseport && ls[i].worker != ngx_worker) {
+            continue;
+        }
+#endif
+
         // 获取一个空闲连接，刚开始的话，都是空闲的
         c = ngx_get_connection(ls[i].fd, cycle->log);
 
@@ -800,7 +886,7 @@ ngx_event_process_init(ngx_cycle_t *cycle)
 
         c->log = &ls[i].log;
 
-        c->listening = &ls[i];
+        c->cold->listening = &ls[i];
         ls[i].connection = c;
 
         rev = c->read;
@@ -872,12 +958,35 @@ ngx_event_process_init(ngx_cycle_t *cycle)
         // ls 的回调是这个，要建立连接的
         rev->handler = ngx_event_accept;
 
+#if (NGX_HAVE_REUSEPORT)
+        // 只有本进程监听这个socket，不需要accept锁，直接加入epoll
+        if (ls[i].reuseport) {
+            if (ngx_add_event(rev, NGX_READ_EVENT, 0) == NGX_ERROR) {
+                return NGX_ERROR;
+            }
+
+            continue;
+        }
+#endif
+
         // 使用负载均衡的话，这里不会将ls读事件添加到epoll，
         // 会在ngx_process_events_and_timers进行处理
         if (ngx_use_accept_mutex) {
             continue;
         }
 
+#if (NGX_HAVE_EPOLLEXCLUSIVE)
+        if (ngx_use_exclusive_accept) {
+            if (ngx_add_event(rev, NGX_READ_EVENT, NGX_EXCLUSIVE_EVENT)
+                == NGX_ERROR)
+            {
+                return NGX_ERROR;
+            }
+
+            continue;
+        }
+#endif
+
         if (ngx_event_flags & NGX_USE_RTSIG_EVENT) {
             if (ngx_add_conn(c) == NGX_ERROR) {
                 return NGX_ERROR;
@@ -899,6 +1008,101 @@ ngx_event_process_init(ngx_cycle_t *cycle)
 }
 
 
+/*
+ * the connections and their events are preallocated for the whole
+ * worker_connections, the function is also used by the benchmark
+ */
+
+ngx_int_t
+ngx_event_connections_init(ngx_cycle_t *cycle)
+{
+    ngx_uint_t         i;
+    ngx_event_t       *rev, *wev;
+    ngx_connection_t  *c, *next;
+
+    // 预分配connections连接池，因为事件驱动就是直接驱动connection的
+    cycle->connections = ngx_memalign(ngx_cacheline_size,
+                             sizeof(ngx_connection_t) * cycle->connection_n,
+                             cycle->log);
+    if (cycle->connections == NULL) {
+        return NGX_ERROR;
+    }
+
+    c = cycle->connections;
+
+    /*
+     * the cold parts are not initialized here, so their pages are
+     * not touched until the connections are used
+     */
+
+    cycle->connections_cold = ngx_alloc(sizeof(ngx_connection_cold_t)
+                                        * cycle->connection_n, cycle->log);
+    if (cycle->connections_cold == NULL) {
+        return NGX_ERROR;
+    }
+
+    // 预分配读事件
+    cycle->read_events = ngx_memalign(ngx_cacheline_size,
+                                      sizeof(ngx_event_t) * cycle->connection_n,
+                                      cycle->log);
+    if (cycle->read_events == NULL) {
+        return NGX_ERROR;
+    }
+
+    rev = cycle->read_events;
+    for (i = 0; i < cycle->connection_n; i++) {
+        rev[i].closed = 1;
+        rev[i].instance = 1;
+#if (NGX_THREADS)
+        rev[i].lock = &c[i].lock;
+        rev[i].own_lock = &c[i].lock;
+#endif
+    }
+
+    // 预分配写事件
+    cycle->write_events = ngx_memalign(ngx_cacheline_size,
+                                  sizeof(ngx_event_t) * cycle->connection_n,
+                                  cycle->log);
+    if (cycle->write_events == NULL) {
+        return NGX_ERROR;
+    }
+
+    wev = cycle->write_events;
+    for (i = 0; i < cycle->connection_n; i++) {
+        wev[i].closed = 1;
+#if (NGX_THREADS)
+        wev[i].lock = &c[i].lock;
+        wev[i].own_lock = &c[i].lock;
+#endif
+    }
+
+    i = cycle->connection_n;
+    next = NULL;
+
+    // 每个connection都分配一个read和一个write事件
+    do {
+        i--;
+
+        c[i].data = next;
+        c[i].read = &cycle->read_events[i];
+        c[i].write = &cycle->write_events[i];
+        c[i].fd = (ngx_socket_t) -1;
+        c[i].cold = &cycle->connections_cold[i];
+
+        next = &c[i];
+
+#if (NGX_THREADS)
+        c[i].lock = 0;
+#endif
+    } while (i);
+
+    cycle->free_connections = next;
+    cycle->free_connection_n = cycle->connection_n;
+
+    return NGX_OK;
+}
+
+
 ngx_int_t
 ngx_send_lowat(ngx_connection_t *c, size_t lowat)
 {
@@ -1230,8 +1434,10 @@ ngx_event_core_create_conf(ngx_cycle_t *cycle)
     ecf->connections = NGX_CONF_UNSET_UINT;
     ecf->use = NGX_CONF_UNSET_UINT;
     ecf->multi_accept = NGX_CONF_UNSET;
+    ecf->accept_batch = NGX_CONF_UNSET_UINT;
     ecf->accept_mutex = NGX_CONF_UNSET;
     ecf->accept_mutex_delay = NGX_CONF_UNSET_MSEC;
+    ecf->timer_engine = NGX_CONF_UNSET_UINT;
     ecf->name = (void *) NGX_CONF_UNSET;
 
 #if (NGX_DEBUG)
@@ -1345,8 +1551,10 @@ ngx_event_core_init_conf(ngx_cycle_t *cycle, void *conf)
     ngx_conf_init_ptr_value(ecf->name, event_module->name->data);
 
     ngx_conf_init_value(ecf->multi_accept, 0);
+    ngx_conf_init_uint_value(ecf->accept_batch, 64);
     ngx_conf_init_value(ecf->accept_mutex, 1);
     ngx_conf_init_msec_value(ecf->accept_mutex_delay, 500);
+    ngx_conf_init_uint_value(ecf->timer_engine, NGX_EVENT_TIMER_RBTREE);
 
 
 #if (NGX_HAVE_RTSIG)
@@ -87,6 +87,12 @@ struct ngx_event_s {
     unsigned         accept_context_updated:1;
 #endif
 
+    unsigned         closed:1;
+
+    /* to test on worker exit */
+    unsigned         channel:1;
+    unsigned         resolver:1;
+
 #if (NGX_HAVE_KQUEUE)
     unsigned         kq_vnode:1;
 
@@ -116,29 +122,17 @@ struct ngx_event_s {
 
     ngx_event_handler_pt  handler;
 
+    /*
+     * the fields above and the timer are used on every event,
+     * they share the first cache line on 64-bit platforms
+     */
 
-#if (NGX_HAVE_AIO)
-
-#if (NGX_HAVE_IOCP)
-    ngx_event_ovlp_t ovlp;
-#else
-    struct aiocb     aiocb;
-#endif
-
-#endif
+    ngx_rbtree_node_t   timer;
 
     ngx_uint_t       index;
 
     ngx_log_t       *log;
 
-    ngx_rbtree_node_t   timer;
-
-    unsigned         closed:1;
-
-    /* to test on worker exit */
-    unsigned         channel:1;
-    unsigned         resolver:1;
-
 #if (NGX_THREADS)
 
     unsigned         locked:1;
@@ -168,6 +162,17 @@ struct ngx_event_s {
     ngx_event_t    **prev; // 指向前一个事件的地址
 
 
+#if (NGX_HAVE_AIO)
+
+#if (NGX_HAVE_IOCP)
+    ngx_event_ovlp_t ovlp;
+#else
+    struct aiocb     aiocb;
+#endif
+
+#endif
+
+
 #if 0
 
     /* the threads support */
@@ -231,6 +236,8 @@ typedef struct {
     ngx_int_t  (*add_conn)(ngx_connection_t *c);
     ngx_int_t  (*del_conn)(ngx_connection_t *c, ngx_uint_t flags);
 
+    ngx_int_t  (*notify)(ngx_event_handler_pt handler);
+
     ngx_int_t  (*process_changes)(ngx_cycle_t *cycle, ngx_uint_t nowait);
     ngx_int_t  (*process_events)(ngx_cycle_t *cycle, ngx_msec_t timer,
                    ngx_uint_t flags);
@@ -406,6 +413,10 @@ extern ngx_event_actions_t   ngx_event_actions;
 #define NGX_ONESHOT_EVENT  EPOLLONESHOT
 #endif
 
+#if (NGX_HAVE_EPOLLEXCLUSIVE)
+#define NGX_EXCLUSIVE_EVENT  EPOLLEXCLUSIVE
+#endif
+
 
 #elif (NGX_HAVE_POLL)
 
@@ -439,6 +450,7 @@ extern ngx_event_actions_t   ngx_event_actions;
 #endif
 
 
+#define ngx_notify           ngx_event_actions.notify
 #define ngx_process_changes  ngx_event_actions.process_changes
 #define ngx_process_events   ngx_event_actions.process_events
 #define ngx_done_events      ngx_event_actions.done
@@ -465,15 +477,22 @@ extern ngx_os_io_t  ngx_io;
 #define NGX_EVENT_CONF        0x02000000
 
 
+#define NGX_EVENT_TIMER_RBTREE  0
+#define NGX_EVENT_TIMER_WHEEL   1
+
+
 typedef struct {
     ngx_uint_t    connections;
     ngx_uint_t    use;
 
     ngx_flag_t    multi_accept;
+    ngx_uint_t    accept_batch;
     ngx_flag_t    accept_mutex;
 
     ngx_msec_t    accept_mutex_delay;
 
+    ngx_uint_t    timer_engine;
+
     u_char       *name;
 
 #if (NGX_DEBUG)
@@ -499,6 +518,7 @@ extern ngx_shmtx_t            ngx_accept_mutex;
 extern ngx_uint_t             ngx_use_accept_mutex;
 extern ngx_uint_t             ngx_accept_events;
 extern ngx_uint_t             ngx_accept_mutex_held;
+extern ngx_uint_t             ngx_use_exclusive_accept;
 extern ngx_msec_t             ngx_accept_mutex_delay;
 extern ngx_int_t              ngx_accept_disabled;
 
@@ -538,6 +558,7 @@ u_char *ngx_accept_log_error(ngx_log_t *log, u_char *buf, size_t len);
 
 
 void ngx_process_events_and_timers(ngx_cycle_t *cycle);
+ngx_int_t ngx_event_connections_init(ngx_cycle_t *cycle);
 ngx_int_t ngx_handle_read_event(ngx_event_t *rev, ngx_uint_t flags);
 ngx_int_t ngx_handle_write_event(ngx_event_t *wev, size_t lowat);
 
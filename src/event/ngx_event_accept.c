@@ -11,7 +11,7 @@
 
 
 static ngx_int_t ngx_enable_accept_events(ngx_cycle_t *cycle);
-static ngx_int_t ngx_disable_accept_events(ngx_cycle_t *cycle);
+static ngx_int_t ngx_disable_accept_events(ngx_cycle_t *cycle, ngx_uint_t all);
 static void ngx_close_accepted_connection(ngx_connection_t *c);
 
 
@@ -21,7 +21,7 @@ ngx_event_accept(ngx_event_t *ev)
     socklen_t          socklen;
     ngx_err_t          err;
     ngx_log_t         *log;
-    ngx_uint_t         level;
+    ngx_uint_t         level, batch;
     ngx_socket_t       s;
     ngx_event_t       *rev, *wev;
     ngx_listening_t   *ls;
@@ -51,9 +51,11 @@ ngx_event_accept(ngx_event_t *ev)
     }
 
     lc = ev->data;
-    ls = lc->listening;
+    ls = lc->cold->listening;
     ev->ready = 0;
 
+    batch = ecf->accept_batch;
+
     ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
                    "accept on %V, ready: %d", &ls->addr_text, ev->available);
 
@@ -115,7 +117,7 @@ ngx_event_accept(ngx_event_t *ev)
             }
 
             if (err == NGX_EMFILE || err == NGX_ENFILE) {
-                if (ngx_disable_accept_events((ngx_cycle_t *) ngx_cycle)
+                if (ngx_disable_accept_events((ngx_cycle_t *) ngx_cycle, 1)
                         != NGX_OK)
                 {
                     return;
@@ -145,6 +147,7 @@ ngx_event_accept(ngx_event_t *ev)
 
 #if (NGX_STAT_STUB)
         (void) ngx_atomic_fetch_add(ngx_stat_accepted, 1);
+        (void) ngx_atomic_fetch_add(ls->stat_accepted, 1);
 #endif
 
         ngx_accept_disabled = ngx_cycle->connection_n / 8
@@ -153,6 +156,10 @@ ngx_event_accept(ngx_event_t *ev)
         c = ngx_get_connection(s, ev->log);
 
         if (c == NULL) {
+#if (NGX_STAT_STUB)
+            (void) ngx_atomic_fetch_add(ls->stat_dropped, 1);
+#endif
+
             if (ngx_close_socket(s) == -1) {
                 ngx_log_error(NGX_LOG_ALERT, ev->log, ngx_socket_errno,
                               ngx_close_socket_n " failed");
@@ -172,13 +179,13 @@ ngx_event_accept(ngx_event_t *ev)
             return;
         }
 
-        c->sockaddr = ngx_palloc(c->pool, socklen);
-        if (c->sockaddr == NULL) {
+        c->cold->sockaddr = ngx_palloc(c->pool, socklen);
+        if (c->cold->sockaddr == NULL) {
             ngx_close_accepted_connection(c);
             return;
         }
 
-        ngx_memcpy(c->sockaddr, sa, socklen);
+        ngx_memcpy(c->cold->sockaddr, sa, socklen);
 
         // 之后的内存都从c->poll上获取，方便错误处理，也防止内存碎片了
         log = ngx_palloc(c->pool, sizeof(ngx_log_t));
@@ -221,14 +228,14 @@ ngx_event_accept(ngx_event_t *ev)
         c->log = log;
         c->pool->log = log;
 
-        c->socklen = socklen;
-        c->listening = ls;
-        c->local_sockaddr = ls->sockaddr;
+        c->cold->socklen = socklen;
+        c->cold->listening = ls;
+        c->cold->local_sockaddr = ls->sockaddr;
 
         c->unexpected_eof = 1;
 
 #if (NGX_HAVE_UNIX_DOMAIN)
-        if (c->sockaddr->sa_family == AF_UNIX) {
+        if (c->cold->sockaddr->sa_family == AF_UNIX) {
             c->tcp_nopush = NGX_TCP_NOPUSH_DISABLED;
             c->tcp_nodelay = NGX_TCP_NODELAY_DISABLED;
 #if (NGX_SOLARIS)
@@ -269,7 +276,7 @@ ngx_event_accept(ngx_event_t *ev)
          *             or protection by critical section or light mutex
          */
 
-        c->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
+        c->cold->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
 
 #if (NGX_STAT_STUB)
         (void) ngx_atomic_fetch_add(ngx_stat_handled, 1);
@@ -283,15 +290,17 @@ ngx_event_accept(ngx_event_t *ev)
 #endif
 
         if (ls->addr_ntop) {
-            c->addr_text.data = ngx_pnalloc(c->pool, ls->addr_text_max_len);
-            if (c->addr_text.data == NULL) {
+            c->cold->addr_text.data = ngx_pnalloc(c->pool,
+                                                  ls->addr_text_max_len);
+            if (c->cold->addr_text.data == NULL) {
                 ngx_close_accepted_connection(c);
                 return;
             }
 
-            c->addr_text.len = ngx_sock_ntop(c->sockaddr, c->addr_text.data,
-                                             ls->addr_text_max_len, 0);
-            if (c->addr_text.len == 0) {
+            c->cold->addr_text.len = ngx_sock_ntop(c->cold->sockaddr,
+                                                   c->cold->addr_text.data,
+                                                   ls->addr_text_max_len, 0);
+            if (c->cold->addr_text.len == 0) {
                 ngx_close_accepted_connection(c);
                 return;
             }
@@ -310,7 +319,7 @@ ngx_event_accept(ngx_event_t *ev)
 
             cidr = ecf->debug_connection.elts;
             for (i = 0; i < ecf->debug_connection.nelts; i++) {
-                if (cidr[i].family != c->sockaddr->sa_family) {
+                if (cidr[i].family != c->cold->sockaddr->sa_family) {
                     goto next;
                 }
 
@@ -318,7 +327,7 @@ ngx_event_accept(ngx_event_t *ev)
 
 #if (NGX_HAVE_INET6)
                 case AF_INET6:
-                    sin6 = (struct sockaddr_in6 *) c->sockaddr;
+                    sin6 = (struct sockaddr_in6 *) c->cold->sockaddr;
                     for (n = 0; n < 16; n++) {
                         if ((sin6->sin6_addr.s6_addr[n]
                                 & cidr[i].u.in6.mask.s6_addr[n])
@@ -336,7 +345,7 @@ ngx_event_accept(ngx_event_t *ev)
 #endif
 
                 default: /* AF_INET */
-                    sin = (struct sockaddr_in *) c->sockaddr;
+                    sin = (struct sockaddr_in *) c->cold->sockaddr;
                     if ((sin->sin_addr.s_addr & cidr[i].u.in.mask)
                             != cidr[i].u.in.addr)
                     {
@@ -358,7 +367,8 @@ next:
         ngx_log_debug1(NGX_LOG_DEBUG_EVENT, log, 0,
                        "[lala] %V", &ls->log.file->name);
         ngx_log_debug3(NGX_LOG_DEBUG_EVENT, log, 0,
-                       "*%d accept: %V fd:%d", c->number, &c->addr_text, s);
+                       "*%d accept: %V fd:%d",
+                       c->cold->number, &c->cold->addr_text, s);
 
         if (ngx_add_conn && (ngx_event_flags & NGX_USE_EPOLL_EVENT) == 0) {
             if (ngx_add_conn(c) == NGX_ERROR) {
@@ -376,6 +386,31 @@ next:
             ev->available--;
         }
 
+        /*
+         * stop draining the listen queue once this worker is short of
+         * free connections: the socket is level-triggered, so the rest
+         * of the queue wakes up another worker
+         */
+
+        if (ngx_accept_disabled > 0
+            && !(ngx_event_flags & NGX_USE_KQUEUE_EVENT))
+        {
+            break;
+        }
+
+        /*
+         * a batch is bounded to let the other listening sockets and
+         * the connections run: the socket is level-triggered, so the rest
+         * of the queue is reported by the next iteration
+         */
+
+        if (--batch == 0 && !(ngx_event_flags & NGX_USE_KQUEUE_EVENT)) {
+            ngx_log_debug1(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                           "accept batch of %ui is done",
+                           ecf->accept_batch);
+            break;
+        }
+
     } while (ev->available);
 }
 
@@ -411,7 +446,7 @@ ngx_trylock_accept_mutex(ngx_cycle_t *cycle)
                    "accept mutex lock failed: %ui", ngx_accept_mutex_held);
 
     if (ngx_accept_mutex_held) {    // 没有抢到锁，但还占着ls socket，需要从epoll中去掉
-        if (ngx_disable_accept_events(cycle) == NGX_ERROR) {
+        if (ngx_disable_accept_events(cycle, 0) == NGX_ERROR) {
             return NGX_ERROR;
         }
 
@@ -434,7 +469,7 @@ ngx_enable_accept_events(ngx_cycle_t *cycle)
 
         c = ls[i].connection;
 
-        if (c->read->active) {
+        if (c == NULL || c->read->active) {
             continue;
         }
 
@@ -444,6 +479,20 @@ ngx_enable_accept_events(ngx_cycle_t *cycle)
                 return NGX_ERROR;
             }
 
+#if (NGX_HAVE_EPOLLEXCLUSIVE)
+        } else if (ngx_use_exclusive_accept
+#if (NGX_HAVE_REUSEPORT)
+                   && !ls[i].reuseport
+#endif
+                  )
+        {
+            if (ngx_add_event(c->read, NGX_READ_EVENT, NGX_EXCLUSIVE_EVENT)
+                == NGX_ERROR)
+            {
+                return NGX_ERROR;
+            }
+#endif
+
         } else {
             if (ngx_add_event(c->read, NGX_READ_EVENT, 0) == NGX_ERROR) {
                 return NGX_ERROR;
@@ -456,7 +505,7 @@ ngx_enable_accept_events(ngx_cycle_t *cycle)
 
 
 static ngx_int_t
-ngx_disable_accept_events(ngx_cycle_t *cycle)
+ngx_disable_accept_events(ngx_cycle_t *cycle, ngx_uint_t all)
 {
     ngx_uint_t         i;
     ngx_listening_t   *ls;
@@ -467,10 +516,23 @@ ngx_disable_accept_events(ngx_cycle_t *cycle)
 
         c = ls[i].connection;
 
-        if (!c->read->active) {
+        if (c == NULL || !c->read->active) {
             continue;
         }
 
+#if (NGX_HAVE_REUSEPORT)
+
+        /*
+         * do not disable accept on worker's own sockets
+         * when disabling accept events due to accept mutex
+         */
+
+        if (ls[i].reuseport && !all) {
+            continue;
+        }
+
+#endif
+
         if (ngx_event_flags & NGX_USE_RTSIG_EVENT) {
             if (ngx_del_conn(c, NGX_DISABLE_EVENT) == NGX_ERROR) {
                 return NGX_ERROR;
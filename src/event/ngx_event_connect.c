@@ -102,7 +102,7 @@ ngx_event_connect_peer(ngx_peer_connection_t *pc)
 
     pc->connection = c;
 
-    c->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
+    c->cold->number = ngx_atomic_fetch_add(ngx_connection_counter, 1);
 
 #if (NGX_THREADS)
 
@@ -122,7 +122,7 @@ ngx_event_connect_peer(ngx_peer_connection_t *pc)
     }
 
     ngx_log_debug3(NGX_LOG_DEBUG_EVENT, pc->log, 0,
-                   "connect to %V, fd:%d #%d", pc->name, s, c->number);
+                   "connect to %V, fd:%d #%d", pc->name, s, c->cold->number);
 
     rc = connect(s, pc->sockaddr, pc->socklen);
 
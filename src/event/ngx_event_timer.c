@@ -18,6 +18,41 @@ ngx_mutex_t  *ngx_event_timer_mutex;
 ngx_thread_volatile ngx_rbtree_t  ngx_event_timer_rbtree;
 static ngx_rbtree_node_t          ngx_event_timer_sentinel;
 
+
+/*
+ * the hierarchical timer wheel: 256 slots of 1ms, then 4 levels of
+ * 64 slots each covering 64 slots of the previous level, that is 2^32ms;
+ * a slot is a circular list of timers linked by timer.left and timer.right,
+ * timers of the upper levels are moved down when the lower level wraps
+ */
+
+#define NGX_TIMER_WHEEL_BITS0   8
+#define NGX_TIMER_WHEEL_BITS    6
+#define NGX_TIMER_WHEEL_LEVELS  5
+
+#define NGX_TIMER_WHEEL_SIZE0   (1 << NGX_TIMER_WHEEL_BITS0)
+#define NGX_TIMER_WHEEL_SIZE    (1 << NGX_TIMER_WHEEL_BITS)
+#define NGX_TIMER_WHEEL_MASK0   (NGX_TIMER_WHEEL_SIZE0 - 1)
+#define NGX_TIMER_WHEEL_MASK    (NGX_TIMER_WHEEL_SIZE - 1)
+
+#define NGX_TIMER_WHEEL_SLOTS                                                 \
+    (NGX_TIMER_WHEEL_SIZE0 + (NGX_TIMER_WHEEL_LEVELS - 1) * NGX_TIMER_WHEEL_SIZE)
+
+
+static ngx_rbtree_node_t *ngx_event_timer_wheel_slot(ngx_msec_t key);
+static void ngx_event_timer_wheel_cascade(void);
+static ngx_msec_t ngx_event_timer_wheel_find(void);
+static void ngx_event_timer_wheel_expire(void);
+
+
+ngx_uint_t                        ngx_event_timer_wheel;
+ngx_uint_t                        ngx_event_timer_wheel_n;
+
+/* the next tick to process, all earlier timers have expired */
+static ngx_msec_t                 ngx_event_timer_wheel_time;
+static ngx_msec_t                 ngx_event_timer_wheel_cascaded;
+static ngx_rbtree_node_t          ngx_event_timer_slots[NGX_TIMER_WHEEL_SLOTS];
+
 /*
  * the event timer rbtree may contain the duplicate keys, however,
  * it should not be a problem, because we use the rbtree to find
@@ -27,9 +62,22 @@ static ngx_rbtree_node_t          ngx_event_timer_sentinel;
 ngx_int_t
 ngx_event_timer_init(ngx_log_t *log)
 {
+    ngx_uint_t          i;
+    ngx_rbtree_node_t  *head;
+
     ngx_rbtree_init(&ngx_event_timer_rbtree, &ngx_event_timer_sentinel,
                     ngx_rbtree_insert_timer_value);
 
+    for (i = 0; i < NGX_TIMER_WHEEL_SLOTS; i++) {
+        head = &ngx_event_timer_slots[i];
+        head->left = head;
+        head->right = head;
+    }
+
+    ngx_event_timer_wheel_n = 0;
+    ngx_event_timer_wheel_time = ngx_current_msec;
+    ngx_event_timer_wheel_cascaded = ngx_current_msec - 1;
+
 #if (NGX_THREADS)
 
     if (ngx_event_timer_mutex) {
@@ -54,6 +102,10 @@ ngx_event_find_timer(void)
     ngx_msec_int_t      timer;
     ngx_rbtree_node_t  *node, *root, *sentinel;
 
+    if (ngx_event_timer_wheel) {
+        return ngx_event_timer_wheel_find();
+    }
+
     if (ngx_event_timer_rbtree.root == &ngx_event_timer_sentinel) {
         return NGX_TIMER_INFINITE;
     }
@@ -79,6 +131,11 @@ ngx_event_expire_timers(void)
     ngx_event_t        *ev;
     ngx_rbtree_node_t  *node, *root, *sentinel;
 
+    if (ngx_event_timer_wheel) {
+        ngx_event_timer_wheel_expire();
+        return;
+    }
+
     sentinel = ngx_event_timer_rbtree.sentinel;
 
     for ( ;; ) {
@@ -156,3 +213,242 @@ ngx_event_expire_timers(void)
 
     ngx_mutex_unlock(ngx_event_timer_mutex);
 }
+
+
+void
+ngx_event_timer_wheel_add(ngx_event_t *ev)
+{
+    ngx_rbtree_node_t  *head, *node;
+
+    head = ngx_event_timer_wheel_slot(ev->timer.key);
+    node = &ev->timer;
+
+    node->right = head;
+    node->left = head->left;
+    head->left->right = node;
+    head->left = node;
+
+    ngx_event_timer_wheel_n++;
+}
+
+
+static ngx_rbtree_node_t *
+ngx_event_timer_wheel_slot(ngx_msec_t key)
+{
+    ngx_uint_t  level, shift;
+    ngx_msec_t  delta;
+
+    delta = key - ngx_event_timer_wheel_time;
+
+    if ((ngx_msec_int_t) delta < 0) {
+
+        /* the timer has already expired, run it on the next tick */
+
+        key = ngx_event_timer_wheel_time;
+        delta = 0;
+    }
+
+    if (delta < NGX_TIMER_WHEEL_SIZE0) {
+        return &ngx_event_timer_slots[key & NGX_TIMER_WHEEL_MASK0];
+    }
+
+    shift = NGX_TIMER_WHEEL_BITS0;
+
+    for (level = 1; level < NGX_TIMER_WHEEL_LEVELS - 1; level++) {
+
+        if ((delta >> (shift + NGX_TIMER_WHEEL_BITS)) == 0) {
+            break;
+        }
+
+        shift += NGX_TIMER_WHEEL_BITS;
+    }
+
+    return &ngx_event_timer_slots[NGX_TIMER_WHEEL_SIZE0
+                                  + (level - 1) * NGX_TIMER_WHEEL_SIZE
+                                  + ((key >> shift) & NGX_TIMER_WHEEL_MASK)];
+}
+
+
+static void
+ngx_event_timer_wheel_cascade(void)
+{
+    ngx_uint_t          level, shift, i;
+    ngx_event_t        *ev;
+    ngx_rbtree_node_t  *head, *node, *next;
+
+    /* called when the first level wraps around */
+
+    shift = NGX_TIMER_WHEEL_BITS0;
+
+    for (level = 1; level < NGX_TIMER_WHEEL_LEVELS; level++) {
+
+        i = (ngx_event_timer_wheel_time >> shift) & NGX_TIMER_WHEEL_MASK;
+
+        head = &ngx_event_timer_slots[NGX_TIMER_WHEEL_SIZE0
+                                      + (level - 1) * NGX_TIMER_WHEEL_SIZE
+                                      + i];
+
+        node = head->right;
+
+        head->left = head;
+        head->right = head;
+
+        while (node != head) {
+            next = node->right;
+
+            ev = (ngx_event_t *) ((char *) node - offsetof(ngx_event_t, timer));
+
+            ngx_event_timer_wheel_n--;
+            ngx_event_timer_wheel_add(ev);
+
+            node = next;
+        }
+
+        if (i != 0) {
+            break;
+        }
+
+        shift += NGX_TIMER_WHEEL_BITS;
+    }
+}
+
+
+static ngx_msec_t
+ngx_event_timer_wheel_find(void)
+{
+    ngx_uint_t       i, n, current;
+    ngx_msec_t       t;
+    ngx_msec_int_t   timer;
+
+    if (ngx_event_timer_wheel_n == 0) {
+        return NGX_TIMER_INFINITE;
+    }
+
+    t = ngx_event_timer_wheel_time & ~((ngx_msec_t) NGX_TIMER_WHEEL_MASK0);
+    current = ngx_event_timer_wheel_time & NGX_TIMER_WHEEL_MASK0;
+
+    for (i = current; i < NGX_TIMER_WHEEL_SIZE0; i++) {
+        if (ngx_event_timer_slots[i].right != &ngx_event_timer_slots[i]) {
+            t += i;
+            goto found;
+        }
+    }
+
+    t += NGX_TIMER_WHEEL_SIZE0;
+
+    /* the slots before the current one hold timers of the next round */
+
+    for (i = 0; i < current; i++) {
+        if (ngx_event_timer_slots[i].right != &ngx_event_timer_slots[i]) {
+            goto found;
+        }
+    }
+
+    /*
+     * the first level is empty, so wake up on the first wrap around
+     * that moves down some timers or may move down the upper levels
+     */
+
+    for (n = 0; n < NGX_TIMER_WHEEL_SIZE; n++) {
+
+        i = (t >> NGX_TIMER_WHEEL_BITS0) & NGX_TIMER_WHEEL_MASK;
+
+        if (i == 0) {
+            break;
+        }
+
+        i += NGX_TIMER_WHEEL_SIZE0;
+
+        if (ngx_event_timer_slots[i].right != &ngx_event_timer_slots[i]) {
+            break;
+        }
+
+        t += NGX_TIMER_WHEEL_SIZE0;
+    }
+
+found:
+
+    timer = (ngx_msec_int_t) (t - ngx_current_msec);
+
+    return (ngx_msec_t) (timer > 0 ? timer : 0);
+}
+
+
+static void
+ngx_event_timer_wheel_expire(void)
+{
+    ngx_uint_t          i;
+    ngx_msec_t          t;
+    ngx_event_t        *ev;
+    ngx_rbtree_node_t  *head, *node;
+
+    if (ngx_event_timer_wheel_n == 0) {
+        ngx_event_timer_wheel_time = ngx_current_msec;
+        return;
+    }
+
+    while ((ngx_msec_int_t) (ngx_current_msec - ngx_event_timer_wheel_time)
+           >= 0)
+    {
+        i = ngx_event_timer_wheel_time & NGX_TIMER_WHEEL_MASK0;
+
+        if (i == 0
+            && ngx_event_timer_wheel_cascaded != ngx_event_timer_wheel_time)
+        {
+            ngx_event_timer_wheel_cascade();
+            ngx_event_timer_wheel_cascaded = ngx_event_timer_wheel_time;
+        }
+
+        head = &ngx_event_timer_slots[i];
+
+        while (head->right != head) {
+            node = head->right;
+
+            node->left->right = node->right;
+            node->right->left = node->left;
+            ngx_event_timer_wheel_n--;
+
+            ev = (ngx_event_t *) ((char *) node - offsetof(ngx_event_t, timer));
+
+            ngx_log_debug2(NGX_LOG_DEBUG_EVENT, ev->log, 0,
+                           "event timer del: %d: %M",
+                           ngx_event_ident(ev->data), ev->timer.key);
+
+#if (NGX_DEBUG)
+            ev->timer.left = NULL;
+            ev->timer.right = NULL;
+            ev->timer.parent = NULL;
+#endif
+
+            ev->timer_set = 0;
+
+            ev->timedout = 1;
+
+            ev->handler(ev);
+        }
+
+        /* skip the empty slots up to the current time or the wrap around */
+
+        for (i++; i < NGX_TIMER_WHEEL_SIZE0; i++) {
+            if (ngx_event_timer_slots[i].right != &ngx_event_timer_slots[i]) {
+                break;
+            }
+        }
+
+        t = (ngx_event_timer_wheel_time
+             & ~((ngx_msec_t) NGX_TIMER_WHEEL_MASK0)) + i;
+
+        if ((ngx_msec_int_t) (t - ngx_current_msec) > 0) {
+
+            /*
+             * the current tick is processed again on the next call
+             * to run the timers added with a zero or negative timeout
+             */
+
+            ngx_event_timer_wheel_time = ngx_current_msec;
+            break;
+        }
+
+        ngx_event_timer_wheel_time = t;
+    }
+}
@@ -23,6 +23,8 @@ ngx_int_t ngx_event_timer_init(ngx_log_t *log);
 ngx_msec_t ngx_event_find_timer(void);
 void ngx_event_expire_timers(void);
 
+void ngx_event_timer_wheel_add(ngx_event_t *ev);
+
 
 #if (NGX_THREADS)
 extern ngx_mutex_t  *ngx_event_timer_mutex;
@@ -31,6 +33,25 @@ extern ngx_mutex_t  *ngx_event_timer_mutex;
 
 extern ngx_thread_volatile ngx_rbtree_t  ngx_event_timer_rbtree;
 
+extern ngx_uint_t                         ngx_event_timer_wheel;
+extern ngx_uint_t                         ngx_event_timer_wheel_n;
+
+
+/*
+ * with "timer_engine wheel" an event is linked to its wheel slot
+ * through timer.left and timer.right instead of the rbtree
+ */
+
+static ngx_inline ngx_uint_t
+ngx_event_timers_empty(void)
+{
+    if (ngx_event_timer_wheel) {
+        return (ngx_event_timer_wheel_n == 0);
+    }
+
+    return (ngx_event_timer_rbtree.root == ngx_event_timer_rbtree.sentinel);
+}
+
 
 static ngx_inline void
 ngx_event_del_timer(ngx_event_t *ev)
@@ -39,11 +60,18 @@ ngx_event_del_timer(ngx_event_t *ev)
                    "event timer del: %d: %M",
                     ngx_event_ident(ev->data), ev->timer.key);
 
-    ngx_mutex_lock(ngx_event_timer_mutex);
+    if (ngx_event_timer_wheel) {
+        ev->timer.left->right = ev->timer.right;
+        ev->timer.right->left = ev->timer.left;
+        ngx_event_timer_wheel_n--;
 
-    ngx_rbtree_delete(&ngx_event_timer_rbtree, &ev->timer);
+    } else {
+        ngx_mutex_lock(ngx_event_timer_mutex);
 
-    ngx_mutex_unlock(ngx_event_timer_mutex);
+        ngx_rbtree_delete(&ngx_event_timer_rbtree, &ev->timer);
+
+        ngx_mutex_unlock(ngx_event_timer_mutex);
+    }
 
 #if (NGX_DEBUG)
     ev->timer.left = NULL;
@@ -89,11 +117,16 @@ ngx_event_add_timer(ngx_event_t *ev, ngx_msec_t timer)
                    "event timer add: %d: %M:%M",
                     ngx_event_ident(ev->data), timer, ev->timer.key);
 
-    ngx_mutex_lock(ngx_event_timer_mutex);
+    if (ngx_event_timer_wheel) {
+        ngx_event_timer_wheel_add(ev);
+
+    } else {
+        ngx_mutex_lock(ngx_event_timer_mutex);
 
-    ngx_rbtree_insert(&ngx_event_timer_rbtree, &ev->timer);
+        ngx_rbtree_insert(&ngx_event_timer_rbtree, &ev->timer);
 
-    ngx_mutex_unlock(ngx_event_timer_mutex);
+        ngx_mutex_unlock(ngx_event_timer_mutex);
+    }
 
     ev->timer_set = 1;
 }
@@ -117,11 +117,11 @@ ngx_http_access_handler(ngx_http_request_t *r)
 
     alcf = ngx_http_get_module_loc_conf(r, ngx_http_access_module);
 
-    switch (r->connection->sockaddr->sa_family) {
+    switch (r->connection->cold->sockaddr->sa_family) {
 
     case AF_INET:
         if (alcf->rules) {
-            sin = (struct sockaddr_in *) r->connection->sockaddr;
+            sin = (struct sockaddr_in *) r->connection->cold->sockaddr;
             return ngx_http_access_inet(r, alcf, sin->sin_addr.s_addr);
         }
         break;
@@ -129,7 +129,7 @@ ngx_http_access_handler(ngx_http_request_t *r)
 #if (NGX_HAVE_INET6)
 
     case AF_INET6:
-        sin6 = (struct sockaddr_in6 *) r->connection->sockaddr;
+        sin6 = (struct sockaddr_in6 *) r->connection->cold->sockaddr;
         p = sin6->sin6_addr.s6_addr;
 
         if (alcf->rules && IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr)) {
@@ -339,11 +339,11 @@ ngx_http_geo_real_addr(ngx_http_request_t *r, ngx_http_geo_ctx_t *ctx,
 
     if (ctx->index == -1) {
         ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
-                       "http geo started: %V", &r->connection->addr_text);
+                       "http geo started: %V", &r->connection->cold->addr_text);
 
-        addr->sockaddr = r->connection->sockaddr;
-        addr->socklen = r->connection->socklen;
-        /* addr->name = r->connection->addr_text; */
+        addr->sockaddr = r->connection->cold->sockaddr;
+        addr->socklen = r->connection->cold->socklen;
+        /* addr->name = r->connection->cold->addr_text; */
 
         return NGX_OK;
     }
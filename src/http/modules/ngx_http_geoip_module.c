@@ -243,9 +243,9 @@ ngx_http_geoip_addr(ngx_http_request_t *r, ngx_http_geoip_conf_t *gcf)
     ngx_array_t         *xfwd;
     struct sockaddr_in  *sin;
 
-    addr.sockaddr = r->connection->sockaddr;
-    addr.socklen = r->connection->socklen;
-    /* addr.name = r->connection->addr_text; */
+    addr.sockaddr = r->connection->cold->sockaddr;
+    addr.socklen = r->connection->cold->socklen;
+    /* addr.name = r->connection->cold->addr_text; */
 
     xfwd = &r->headers_in.x_forwarded_for;
 
@@ -298,9 +298,9 @@ ngx_http_geoip_addr_v6(ngx_http_request_t *r, ngx_http_geoip_conf_t *gcf)
     struct sockaddr_in   *sin;
     struct sockaddr_in6  *sin6;
 
-    addr.sockaddr = r->connection->sockaddr;
-    addr.socklen = r->connection->socklen;
-    /* addr.name = r->connection->addr_text; */
+    addr.sockaddr = r->connection->cold->sockaddr;
+    addr.socklen = r->connection->cold->socklen;
+    /* addr.name = r->connection->cold->addr_text; */
 
     xfwd = &r->headers_in.x_forwarded_for;
 
@@ -297,7 +297,8 @@ ngx_http_map_block(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
         hash.hash = &map->map.hash.hash;
         hash.temp_pool = NULL;
 
-        if (ngx_hash_init(&hash, ctx.keys.keys.elts, ctx.keys.keys.nelts)
+        if (ngx_hash_perfect_init(&hash, ctx.keys.keys.elts,
+                                  ctx.keys.keys.nelts)
             != NGX_OK)
         {
             ngx_destroy_pool(pool);
@@ -2036,12 +2036,12 @@ ngx_http_proxy_add_x_forwarded_for_variable(ngx_http_request_t *r,
     }
 
     if (len == 0) {
-        v->len = r->connection->addr_text.len;
-        v->data = r->connection->addr_text.data;
+        v->len = r->connection->cold->addr_text.len;
+        v->data = r->connection->cold->addr_text.data;
         return NGX_OK;
     }
 
-    len += r->connection->addr_text.len;
+    len += r->connection->cold->addr_text.len;
 
     p = ngx_pnalloc(r->pool, len);
     if (p == NULL) {
@@ -2056,7 +2056,8 @@ ngx_http_proxy_add_x_forwarded_for_variable(ngx_http_request_t *r,
         *p++ = ','; *p++ = ' ';
     }
 
-    ngx_memcpy(p, r->connection->addr_text.data, r->connection->addr_text.len);
+    ngx_memcpy(p, r->connection->cold->addr_text.data,
+               r->connection->cold->addr_text.len);
 
     return NGX_OK;
 }
@@ -195,9 +195,9 @@ found:
 
     c = r->connection;
 
-    addr.sockaddr = c->sockaddr;
-    addr.socklen = c->socklen;
-    /* addr.name = c->addr_text; */
+    addr.sockaddr = c->cold->sockaddr;
+    addr.socklen = c->cold->socklen;
+    /* addr.name = c->cold->addr_text; */
 
     if (ngx_http_get_forwarded_addr(r, &addr, xfwd, value, rlcf->from,
                                     rlcf->recursive)
@@ -245,14 +245,14 @@ ngx_http_realip_set_addr(ngx_http_request_t *r, ngx_addr_t *addr)
     cln->handler = ngx_http_realip_cleanup;
 
     ctx->connection = c;
-    ctx->sockaddr = c->sockaddr;
-    ctx->socklen = c->socklen;
-    ctx->addr_text = c->addr_text;
+    ctx->sockaddr = c->cold->sockaddr;
+    ctx->socklen = c->cold->socklen;
+    ctx->addr_text = c->cold->addr_text;
 
-    c->sockaddr = addr->sockaddr;
-    c->socklen = addr->socklen;
-    c->addr_text.len = len;
-    c->addr_text.data = p;
+    c->cold->sockaddr = addr->sockaddr;
+    c->cold->socklen = addr->socklen;
+    c->cold->addr_text.len = len;
+    c->cold->addr_text.data = p;
 
     return NGX_DECLINED;
 }
@@ -267,9 +267,9 @@ ngx_http_realip_cleanup(void *data)
 
     c = ctx->connection;
 
-    c->sockaddr = ctx->sockaddr;
-    c->socklen = ctx->socklen;
-    c->addr_text = ctx->addr_text;
+    c->cold->sockaddr = ctx->sockaddr;
+    c->cold->socklen = ctx->socklen;
+    c->cold->addr_text = ctx->addr_text;
 }
 
 
@@ -0,0 +1,219 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+#define NGX_HTTP_SLAB_STATUS_MAX_SLOTS  16
+
+
+static ngx_int_t ngx_http_slab_status_handler(ngx_http_request_t *r);
+static char *ngx_http_slab_status(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+
+
+static ngx_command_t  ngx_http_slab_status_commands[] = {
+
+    { ngx_string("slab_status"),
+      NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_NOARGS,
+      ngx_http_slab_status,
+      0,
+      0,
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_http_module_t  ngx_http_slab_status_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    NULL,                                  /* postconfiguration */
+
+    NULL,                                  /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    NULL,                                  /* create server configuration */
+    NULL,                                  /* merge server configuration */
+
+    NULL,                                  /* create location configuration */
+    NULL                                   /* merge location configuration */
+};
+
+
+ngx_module_t  ngx_http_slab_status_module = {
+    NGX_MODULE_V1,
+    &ngx_http_slab_status_module_ctx,      /* module context */
+    ngx_http_slab_status_commands,         /* module directives */
+    NGX_HTTP_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+static ngx_int_t
+ngx_http_slab_status_handler(ngx_http_request_t *r)
+{
+    size_t             size;
+    ngx_int_t          rc;
+    ngx_buf_t         *b;
+    ngx_uint_t         i, n, nzones, nslots, pages, pfree;
+    ngx_chain_t        out;
+    ngx_cycle_t       *cycle;
+    ngx_list_part_t   *part;
+    ngx_shm_zone_t    *shm_zone;
+    ngx_slab_pool_t   *sp;
+    ngx_slab_stat_t    stats[NGX_HTTP_SLAB_STATUS_MAX_SLOTS];
+
+    if (r->method != NGX_HTTP_GET && r->method != NGX_HTTP_HEAD) {
+        return NGX_HTTP_NOT_ALLOWED;
+    }
+
+    rc = ngx_http_discard_request_body(r);
+
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    ngx_str_set(&r->headers_out.content_type, "text/plain");
+
+    if (r->method == NGX_HTTP_HEAD) {
+        r->headers_out.status = NGX_HTTP_OK;
+
+        rc = ngx_http_send_header(r);
+
+        if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+            return rc;
+        }
+    }
+
+    cycle = (ngx_cycle_t *) ngx_cycle;
+
+    size = 0;
+    nzones = 0;
+
+    part = &cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        size += sizeof("zone \"\" size: , pages: , free: \n") - 1
+                + shm_zone[i].shm.name.len + 3 * NGX_INT_T_LEN
+                + NGX_HTTP_SLAB_STATUS_MAX_SLOTS
+                  * (sizeof("  slot : pages: , total: , used: ,"
+                            " reqs: , fails: \n") - 1
+                     + 6 * NGX_INT_T_LEN);
+        nzones++;
+    }
+
+    if (nzones == 0) {
+        size = sizeof("no shared zones\n") - 1;
+    }
+
+    b = ngx_create_temp_buf(r->pool, size);
+    if (b == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    out.buf = b;
+    out.next = NULL;
+
+    if (nzones == 0) {
+        b->last = ngx_cpymem(b->last, "no shared zones\n",
+                             sizeof("no shared zones\n") - 1);
+    }
+
+    part = &cycle->shared_memory.part;
+    shm_zone = part->elts;
+
+    for (i = 0; /* void */ ; i++) {
+
+        if (i >= part->nelts) {
+            if (part->next == NULL) {
+                break;
+            }
+
+            part = part->next;
+            shm_zone = part->elts;
+            i = 0;
+        }
+
+        sp = (ngx_slab_pool_t *) shm_zone[i].shm.addr;
+
+        nslots = ngx_slab_slots(sp);
+
+        if (nslots > NGX_HTTP_SLAB_STATUS_MAX_SLOTS) {
+            nslots = NGX_HTTP_SLAB_STATUS_MAX_SLOTS;
+        }
+
+        /* take a consistent snapshot, the zone is changed by all workers */
+
+        ngx_shmtx_lock(&sp->mutex);
+
+        ngx_memcpy(stats, sp->stats, nslots * sizeof(ngx_slab_stat_t));
+        pages = (sp->end - sp->start) >> ngx_pagesize_shift;
+        pfree = sp->pfree;
+
+        ngx_shmtx_unlock(&sp->mutex);
+
+        b->last = ngx_sprintf(b->last,
+                              "zone \"%V\" size: %uz, pages: %ui, free: %ui\n",
+                              &shm_zone[i].shm.name, shm_zone[i].shm.size,
+                              pages, pfree);
+
+        for (n = 0; n < nslots; n++) {
+            b->last = ngx_sprintf(b->last,
+                                  "  slot %uz: pages: %ui, total: %ui, "
+                                  "used: %ui, reqs: %ui, fails: %ui\n",
+                                  sp->min_size << n, stats[n].pages,
+                                  stats[n].total, stats[n].used,
+                                  stats[n].reqs, stats[n].fails);
+        }
+    }
+
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = b->last - b->pos;
+
+    b->last_buf = (r == r->main) ? 1 : 0;
+
+    rc = ngx_http_send_header(r);
+
+    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+        return rc;
+    }
+
+    return ngx_http_output_filter(r, &out);
+}
+
+
+static char *
+ngx_http_slab_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_core_loc_conf_t  *clcf;
+
+    clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
+    clcf->handler = ngx_http_slab_status_handler;
+
+    return NGX_CONF_OK;
+}
@@ -85,8 +85,14 @@ static ngx_int_t ngx_http_status_handler(ngx_http_request_t *r)
     size_t             size;
     ngx_int_t          rc;
     ngx_buf_t         *b;
+    ngx_uint_t         i, n, queue, backlog;
     ngx_chain_t        out;
-    ngx_atomic_int_t   ap, hn, ac, rq, rd, wr, wa;
+    ngx_listening_t   *ls;
+    ngx_atomic_int_t   ap, hn, ac, rq, rd, wr, wa, ph, pm, pc, la, ld;
+#if (NGX_HAVE_TCP_INFO)
+    socklen_t          len;
+    struct tcp_info    ti;
+#endif
 
     if (r->method != NGX_HTTP_GET && r->method != NGX_HTTP_HEAD) {
         return NGX_HTTP_NOT_ALLOWED;
@@ -113,7 +119,22 @@ static ngx_int_t ngx_http_status_handler(ngx_http_request_t *r)
     size = sizeof("Active connections:  \n") + NGX_ATOMIC_T_LEN
            + sizeof("server accepts handled requests\n") - 1
            + 6 + 3 * NGX_ATOMIC_T_LEN
-           + sizeof("Reading:  Writing:  Waiting:  \n") + 3 * NGX_ATOMIC_T_LEN;
+           + sizeof("Reading:  Writing:  Waiting:  \n") + 3 * NGX_ATOMIC_T_LEN
+           + sizeof("Pool cache hits:  misses:  cached:  \n")
+           + 3 * NGX_ATOMIC_T_LEN;
+
+    ls = ngx_cycle->listening.elts;
+
+    for (i = 0; i < ngx_cycle->listening.nelts; i++) {
+
+        if (ls[i].worker) {
+            continue;
+        }
+
+        size += sizeof("Listen  accepted:  dropped:  queue:  backlog: \n")
+                + ls[i].addr_text.len + 2 * NGX_ATOMIC_T_LEN
+                + 2 * NGX_INT_T_LEN;
+    }
 
     b = ngx_create_temp_buf(r->pool, size);
     if (b == NULL) {
@@ -130,6 +151,9 @@ static ngx_int_t ngx_http_status_handler(ngx_http_request_t *r)
     rd = *ngx_stat_reading;
     wr = *ngx_stat_writing;
     wa = *ngx_stat_waiting;
+    ph = *ngx_stat_pool_hits;
+    pm = *ngx_stat_pool_misses;
+    pc = *ngx_stat_pool_cached;
 
     b->last = ngx_sprintf(b->last, "Active connections: %uA \n", ac);
 
@@ -141,6 +165,63 @@ static ngx_int_t ngx_http_status_handler(ngx_http_request_t *r)
     b->last = ngx_sprintf(b->last, "Reading: %uA Writing: %uA Waiting: %uA \n",
                           rd, wr, wa);
 
+    b->last = ngx_sprintf(b->last,
+                          "Pool cache hits: %uA misses: %uA cached: %uA \n",
+                          ph, pm, pc);
+
+    for (i = 0; i < ngx_cycle->listening.nelts; i++) {
+
+        /*
+         * the reuseport sockets of the other workers follow the socket
+         * of the first worker and are reported together with it
+         */
+
+        if (ls[i].worker) {
+            continue;
+        }
+
+        la = 0;
+        ld = 0;
+        queue = 0;
+        backlog = ls[i].backlog;
+
+        n = i;
+
+        do {
+            la += *ls[n].stat_accepted;
+            ld += *ls[n].stat_dropped;
+
+            /*
+             * the accept queue of a listening socket is reported by
+             * TCP_INFO: tcpi_unacked is the current length and tcpi_sacked
+             * is the backlog
+             */
+
+#if (NGX_HAVE_TCP_INFO)
+
+            if (ls[n].sockaddr->sa_family != AF_UNIX) {
+                len = sizeof(struct tcp_info);
+
+                if (getsockopt(ls[n].fd, IPPROTO_TCP, TCP_INFO, &ti, &len)
+                    != -1)
+                {
+                    queue += ti.tcpi_unacked;
+                    backlog = ti.tcpi_sacked;
+                }
+            }
+
+#endif
+
+            n++;
+
+        } while (n < ngx_cycle->listening.nelts && ls[n].worker);
+
+        b->last = ngx_sprintf(b->last,
+                              "Listen %V accepted: %uA dropped: %uA "
+                              "queue: %ui backlog: %ui\n",
+                              &ls[i].addr_text, la, ld, queue, backlog);
+    }
+
     r->headers_out.status = NGX_HTTP_OK;
     r->headers_out.content_length_n = b->last - b->pos;
 
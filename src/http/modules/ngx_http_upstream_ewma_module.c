@@ -0,0 +1,433 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+typedef struct {
+    ngx_msec_t                          decay;
+} ngx_http_upstream_ewma_srv_conf_t;
+
+
+typedef struct {
+    /* the round robin data must be first */
+    ngx_http_upstream_rr_peer_data_t    rrp;
+    ngx_http_upstream_ewma_srv_conf_t  *conf;
+
+    ngx_msec_t                          start;
+    ngx_uint_t                          tries;
+
+    unsigned                            counted:1;
+
+    ngx_event_get_peer_pt               get_rr_peer;
+} ngx_http_upstream_ewma_peer_data_t;
+
+
+static ngx_int_t ngx_http_upstream_init_ewma(ngx_conf_t *cf,
+    ngx_http_upstream_srv_conf_t *us);
+static ngx_int_t ngx_http_upstream_init_ewma_peer(ngx_http_request_t *r,
+    ngx_http_upstream_srv_conf_t *us);
+static ngx_int_t ngx_http_upstream_get_ewma_peer(ngx_peer_connection_t *pc,
+    void *data);
+static void ngx_http_upstream_free_ewma_peer(ngx_peer_connection_t *pc,
+    void *data, ngx_uint_t state);
+static uint64_t ngx_http_upstream_ewma_decay(uint64_t ewma, ngx_msec_t decay,
+    ngx_msec_t elapsed);
+
+static void *ngx_http_upstream_ewma_create_conf(ngx_conf_t *cf);
+static char *ngx_http_upstream_ewma(ngx_conf_t *cf, ngx_command_t *cmd,
+    void *conf);
+
+
+static ngx_command_t  ngx_http_upstream_ewma_commands[] = {
+
+    { ngx_string("ewma"),
+      NGX_HTTP_UPS_CONF|NGX_CONF_NOARGS|NGX_CONF_TAKE1,
+      ngx_http_upstream_ewma,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_http_module_t  ngx_http_upstream_ewma_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    NULL,                                  /* postconfiguration */
+
+    NULL,                                  /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    ngx_http_upstream_ewma_create_conf,    /* create server configuration */
+    NULL,                                  /* merge server configuration */
+
+    NULL,                                  /* create location configuration */
+    NULL                                   /* merge location configuration */
+};
+
+
+ngx_module_t  ngx_http_upstream_ewma_module = {
+    NGX_MODULE_V1,
+    &ngx_http_upstream_ewma_module_ctx,    /* module context */
+    ngx_http_upstream_ewma_commands,       /* module directives */
+    NGX_HTTP_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+static ngx_int_t
+ngx_http_upstream_init_ewma(ngx_conf_t *cf, ngx_http_upstream_srv_conf_t *us)
+{
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, cf->log, 0, "init ewma");
+
+    if (ngx_http_upstream_init_round_robin(cf, us) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    us->peer.init = ngx_http_upstream_init_ewma_peer;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_init_ewma_peer(ngx_http_request_t *r,
+    ngx_http_upstream_srv_conf_t *us)
+{
+    ngx_http_upstream_ewma_peer_data_t  *ep;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "init ewma peer");
+
+    ep = ngx_palloc(r->pool, sizeof(ngx_http_upstream_ewma_peer_data_t));
+    if (ep == NULL) {
+        return NGX_ERROR;
+    }
+
+    r->upstream->peer.data = &ep->rrp;
+
+    if (ngx_http_upstream_init_round_robin_peer(r, us) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    r->upstream->peer.get = ngx_http_upstream_get_ewma_peer;
+    r->upstream->peer.free = ngx_http_upstream_free_ewma_peer;
+
+    ep->conf = ngx_http_conf_upstream_srv_conf(us,
+                                               ngx_http_upstream_ewma_module);
+    ep->start = 0;
+    ep->tries = 0;
+    ep->counted = 0;
+    ep->get_rr_peer = ngx_http_upstream_get_round_robin_peer;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_get_ewma_peer(ngx_peer_connection_t *pc, void *data)
+{
+    ngx_http_upstream_ewma_peer_data_t  *ep = data;
+
+    time_t                         now;
+    uint64_t                       ewma[2], score[2];
+    uintptr_t                      m;
+    ngx_uint_t                     i, n, p, c, pick[2];
+    ngx_http_upstream_rr_peer_t   *peer, *best;
+    ngx_http_upstream_rr_peers_t  *peers;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, pc->log, 0,
+                   "get ewma peer, try: %ui", pc->tries);
+
+    peers = ep->rrp.peers;
+
+    if (ep->tries > 20 || peers->single) {
+        return ep->get_rr_peer(pc, &ep->rrp);
+    }
+
+    now = ngx_time();
+
+    pc->cached = 0;
+    pc->connection = NULL;
+
+    ngx_http_upstream_rr_peers_lock(peers);
+
+    /*
+     * the power of two choices: two distinct usable peers are taken
+     * at random, the one with the lower number of active connections
+     * multiplied by the response time average wins
+     */
+
+    c = 0;
+
+    for (i = 0; i < 20 && c < 2; i++) {
+
+        p = (ngx_uint_t) ngx_random() % peers->number;
+
+        if (c == 1 && pick[0] == p) {
+            continue;
+        }
+
+        n = p / (8 * sizeof(uintptr_t));
+        m = (uintptr_t) 1 << p % (8 * sizeof(uintptr_t));
+
+        if (ep->rrp.tried[n] & m) {
+            continue;
+        }
+
+        peer = &peers->peer[p];
+
+        if (peer->down) {
+            continue;
+        }
+
+        if (peer->max_fails
+            && peer->fails >= peer->max_fails
+            && now - peer->checked <= peer->fail_timeout)
+        {
+            continue;
+        }
+
+        if (peer->ewma_updated) {
+            ewma[c] = ngx_http_upstream_ewma_decay(peer->ewma,
+                                                   ep->conf->decay,
+                                                   ngx_current_msec
+                                                   - peer->ewma_updated);
+        } else {
+            ewma[c] = (uint64_t) -1;
+        }
+
+        pick[c++] = p;
+    }
+
+    if (c == 0) {
+        ngx_http_upstream_rr_peers_unlock(peers);
+
+        ep->tries = 21;
+
+        return ep->get_rr_peer(pc, &ep->rrp);
+    }
+
+    p = pick[0];
+
+    if (c == 2) {
+
+        /* a peer without responses yet is assumed to be as fast as the other */
+
+        if (ewma[0] == (uint64_t) -1) {
+            ewma[0] = (ewma[1] == (uint64_t) -1) ? 0 : ewma[1];
+        }
+
+        if (ewma[1] == (uint64_t) -1) {
+            ewma[1] = ewma[0];
+        }
+
+        score[0] = (peers->peer[pick[0]].conns + 1) * (ewma[0] + 1);
+        score[1] = (peers->peer[pick[1]].conns + 1) * (ewma[1] + 1);
+
+        ngx_log_debug4(NGX_LOG_DEBUG_HTTP, pc->log, 0,
+                       "get ewma peer, %ui:%uL or %ui:%uL",
+                       pick[0], score[0], pick[1], score[1]);
+
+        /* the scores are compared in relation to the weights */
+
+        if (score[1] * peers->peer[pick[0]].weight
+            < score[0] * peers->peer[pick[1]].weight)
+        {
+            p = pick[1];
+        }
+    }
+
+    best = &peers->peer[p];
+
+    if (best->max_fails && best->fails >= best->max_fails) {
+        best->checked = now;
+    }
+
+    best->conns++;
+
+    ep->rrp.current = p;
+
+    pc->sockaddr = best->sockaddr;
+    pc->socklen = best->socklen;
+    pc->name = &best->name;
+
+    ngx_http_upstream_rr_peers_unlock(peers);
+
+    n = p / (8 * sizeof(uintptr_t));
+    m = (uintptr_t) 1 << p % (8 * sizeof(uintptr_t));
+
+    ep->rrp.tried[n] |= m;
+    ep->tries++;
+
+    ep->start = ngx_current_msec;
+    ep->counted = 1;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_upstream_free_ewma_peer(ngx_peer_connection_t *pc,
+    void *data, ngx_uint_t state)
+{
+    ngx_http_upstream_ewma_peer_data_t  *ep = data;
+
+    uint64_t                      rt, ewma;
+    ngx_msec_t                    elapsed;
+    ngx_http_upstream_rr_peer_t  *peer;
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, pc->log, 0,
+                   "free ewma peer %ui %ui", pc->tries, state);
+
+    if (!ep->counted) {
+        ngx_http_upstream_free_round_robin_peer(pc, data, state);
+        return;
+    }
+
+    ep->counted = 0;
+
+    rt = (uint64_t) (ngx_current_msec - ep->start) * 1000;
+
+    /* a failed peer looks as slow as the decay time to not attract load */
+
+    if (state & NGX_PEER_FAILED) {
+        rt = ngx_max(rt, (uint64_t) ep->conf->decay * 1000);
+    }
+
+    peer = &ep->rrp.peers->peer[ep->rrp.current];
+
+    ngx_http_upstream_rr_peers_lock(ep->rrp.peers);
+
+    peer->conns--;
+
+    if (peer->ewma_updated == 0 || rt > peer->ewma) {
+
+        /* a slow response is taken at once, the average only decays */
+
+        ewma = rt;
+
+    } else {
+        elapsed = ngx_current_msec - peer->ewma_updated;
+
+        if (elapsed == 0) {
+            elapsed = 1;
+        }
+
+        /*
+         * the weight of the previous average fades with the time
+         * passed since its update, decay / (decay + elapsed)
+         */
+
+        ewma = (peer->ewma * ep->conf->decay + rt * elapsed)
+               / (ep->conf->decay + elapsed);
+    }
+
+    peer->ewma = ewma;
+    peer->ewma_updated = ngx_current_msec;
+
+    ngx_http_upstream_rr_peers_unlock(ep->rrp.peers);
+
+    ngx_log_debug3(NGX_LOG_DEBUG_HTTP, pc->log, 0,
+                   "free ewma peer, peer:%ui, rt:%uLus, ewma:%uLus",
+                   ep->rrp.current, rt, ewma);
+
+    ngx_http_upstream_free_round_robin_peer(pc, data, state);
+}
+
+
+static uint64_t
+ngx_http_upstream_ewma_decay(uint64_t ewma, ngx_msec_t decay,
+    ngx_msec_t elapsed)
+{
+    /*
+     * a peer that was slow but is not chosen any more gets
+     * its average lowered with time to be probed again
+     */
+
+    if ((ngx_msec_int_t) elapsed <= 0) {
+        return ewma;
+    }
+
+    return ewma * decay / (decay + elapsed);
+}
+
+
+static void *
+ngx_http_upstream_ewma_create_conf(ngx_conf_t *cf)
+{
+    ngx_http_upstream_ewma_srv_conf_t  *conf;
+
+    conf = ngx_palloc(cf->pool, sizeof(ngx_http_upstream_ewma_srv_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    conf->decay = NGX_CONF_UNSET_MSEC;
+
+    return conf;
+}
+
+
+static char *
+ngx_http_upstream_ewma(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_upstream_ewma_srv_conf_t  *ecf = conf;
+
+    ngx_str_t                     *value, s;
+    ngx_http_upstream_srv_conf_t  *uscf;
+
+    uscf = ngx_http_conf_get_module_srv_conf(cf, ngx_http_upstream_module);
+
+    if (uscf->peer.init_upstream) {
+        ngx_conf_log_error(NGX_LOG_WARN, cf, 0,
+                           "load balancing method redefined");
+    }
+
+    ecf->decay = 10000;
+
+    if (cf->args->nelts == 2) {
+        value = cf->args->elts;
+
+        if (ngx_strncmp(value[1].data, "decay=", 6) != 0) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid parameter \"%V\"", &value[1]);
+            return NGX_CONF_ERROR;
+        }
+
+        s.len = value[1].len - 6;
+        s.data = value[1].data + 6;
+
+        ecf->decay = ngx_parse_time(&s, 0);
+
+        if (ecf->decay == (ngx_msec_t) NGX_ERROR || ecf->decay == 0) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid decay time \"%V\"", &value[1]);
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    uscf->peer.init_upstream = ngx_http_upstream_init_ewma;
+
+    uscf->flags = NGX_HTTP_UPSTREAM_CREATE
+                  |NGX_HTTP_UPSTREAM_WEIGHT
+                  |NGX_HTTP_UPSTREAM_MAX_FAILS
+                  |NGX_HTTP_UPSTREAM_FAIL_TIMEOUT
+                  |NGX_HTTP_UPSTREAM_DOWN;
+
+    return NGX_CONF_OK;
+}
@@ -0,0 +1,710 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+typedef struct {
+    ngx_flag_t                         enable;
+
+    ngx_msec_t                         interval;
+    ngx_msec_t                         timeout;
+    ngx_uint_t                         fails;
+    ngx_uint_t                         passes;
+
+    ngx_uint_t                         status_min;
+    ngx_uint_t                         status_max;
+    ngx_str_t                          body;
+
+    ngx_str_t                          request;
+} ngx_http_upstream_hc_srv_conf_t;
+
+
+typedef struct {
+    ngx_http_upstream_hc_srv_conf_t   *conf;
+    ngx_http_upstream_rr_peers_t      *peers;
+    ngx_uint_t                         index;
+
+    ngx_event_t                        timer;
+    ngx_peer_connection_t              pc;
+
+    ngx_buf_t                          request;
+    ngx_buf_t                         *response;
+
+    /* the number of consecutive failed and passed checks */
+    ngx_uint_t                         fails;
+    ngx_uint_t                         passes;
+} ngx_http_upstream_hc_peer_t;
+
+
+static void ngx_http_upstream_hc_start(ngx_event_t *ev);
+static void ngx_http_upstream_hc_probe(ngx_event_t *ev);
+static void ngx_http_upstream_hc_write_handler(ngx_event_t *wev);
+static void ngx_http_upstream_hc_read_handler(ngx_event_t *rev);
+static void ngx_http_upstream_hc_dummy_handler(ngx_event_t *ev);
+static ngx_int_t ngx_http_upstream_hc_match(ngx_http_upstream_hc_peer_t *hp);
+static void ngx_http_upstream_hc_done(ngx_http_upstream_hc_peer_t *hp,
+    ngx_int_t rc);
+
+static void *ngx_http_upstream_hc_create_conf(ngx_conf_t *cf);
+static char *ngx_http_upstream_health_check(ngx_conf_t *cf,
+    ngx_command_t *cmd, void *conf);
+static ngx_int_t ngx_http_upstream_hc_init(ngx_conf_t *cf);
+
+
+static ngx_command_t  ngx_http_upstream_hc_commands[] = {
+
+    { ngx_string("health_check"),
+      NGX_HTTP_UPS_CONF|NGX_CONF_ANY,
+      ngx_http_upstream_health_check,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      0,
+      NULL },
+
+      ngx_null_command
+};
+
+
+static ngx_http_module_t  ngx_http_upstream_hc_module_ctx = {
+    NULL,                                  /* preconfiguration */
+    ngx_http_upstream_hc_init,             /* postconfiguration */
+
+    NULL,                                  /* create main configuration */
+    NULL,                                  /* init main configuration */
+
+    ngx_http_upstream_hc_create_conf,      /* create server configuration */
+    NULL,                                  /* merge server configuration */
+
+    NULL,                                  /* create location configuration */
+    NULL                                   /* merge location configuration */
+};
+
+
+ngx_module_t  ngx_http_upstream_health_check_module = {
+    NGX_MODULE_V1,
+    &ngx_http_upstream_hc_module_ctx,      /* module context */
+    ngx_http_upstream_hc_commands,         /* module directives */
+    NGX_HTTP_MODULE,                       /* module type */
+    NULL,                                  /* init master */
+    NULL,                                  /* init module */
+    NULL,                                  /* init process */
+    NULL,                                  /* init thread */
+    NULL,                                  /* exit thread */
+    NULL,                                  /* exit process */
+    NULL,                                  /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+/*
+ * the handler runs once in the health check helper process,
+ * then every peer is checked by its own timer
+ */
+
+static void
+ngx_http_upstream_hc_start(ngx_event_t *ev)
+{
+    ngx_uint_t                        i, n;
+    ngx_cycle_t                      *cycle;
+    ngx_http_upstream_hc_peer_t      *hp;
+    ngx_http_upstream_rr_peers_t     *peers;
+    ngx_http_upstream_srv_conf_t     *uscf, **uscfp;
+    ngx_http_upstream_hc_srv_conf_t  *hcf;
+    ngx_http_upstream_main_conf_t    *umcf;
+
+    cycle = (ngx_cycle_t *) ngx_cycle;
+
+    umcf = ngx_http_cycle_get_module_main_conf(cycle, ngx_http_upstream_module);
+    if (umcf == NULL) {
+        return;
+    }
+
+    uscfp = umcf->upstreams.elts;
+
+    for (i = 0; i < umcf->upstreams.nelts; i++) {
+        uscf = uscfp[i];
+
+        if (uscf->srv_conf == NULL) {
+            continue;
+        }
+
+        hcf = ngx_http_conf_upstream_srv_conf(uscf,
+                                        ngx_http_upstream_health_check_module);
+
+        if (!hcf->enable) {
+            continue;
+        }
+
+        for (peers = uscf->peer.data; peers; peers = peers->next) {
+
+            for (n = 0; n < peers->number; n++) {
+
+                hp = ngx_pcalloc(cycle->pool,
+                                 sizeof(ngx_http_upstream_hc_peer_t));
+                if (hp == NULL) {
+                    return;
+                }
+
+                hp->response = ngx_create_temp_buf(cycle->pool, ngx_pagesize);
+                if (hp->response == NULL) {
+                    return;
+                }
+
+                hp->conf = hcf;
+                hp->peers = peers;
+                hp->index = n;
+
+                hp->timer.handler = ngx_http_upstream_hc_probe;
+                hp->timer.data = hp;
+                hp->timer.log = cycle->log;
+
+                /* spread the checks over the interval */
+
+                ngx_add_timer(&hp->timer,
+                              (ngx_msec_t) ngx_random() % hcf->interval);
+            }
+        }
+    }
+}
+
+
+static void
+ngx_http_upstream_hc_probe(ngx_event_t *ev)
+{
+    ngx_int_t                     rc;
+    ngx_connection_t             *c;
+    ngx_http_upstream_rr_peer_t  *peer;
+    ngx_http_upstream_hc_peer_t  *hp;
+
+    if (ngx_exiting || ngx_quit || ngx_terminate) {
+        return;
+    }
+
+    hp = ev->data;
+    peer = &hp->peers->peer[hp->index];
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ev->log, 0,
+                   "health check peer %V", &peer->name);
+
+    ngx_memzero(&hp->pc, sizeof(ngx_peer_connection_t));
+
+    hp->pc.sockaddr = peer->sockaddr;
+    hp->pc.socklen = peer->socklen;
+    hp->pc.name = &peer->name;
+    hp->pc.get = ngx_event_get_peer;
+    hp->pc.log = ev->log;
+    hp->pc.log_error = NGX_ERROR_ERR;
+
+    rc = ngx_event_connect_peer(&hp->pc);
+
+    if (rc == NGX_ERROR) {
+
+        /*
+         * a local failure, such as no free connection or descriptor,
+         * says nothing about the peer, so the check is just repeated
+         */
+
+        ngx_log_error(NGX_LOG_WARN, ev->log, 0,
+                      "health check of %V postponed", &peer->name);
+
+        ngx_add_timer(&hp->timer, hp->conf->interval);
+        return;
+    }
+
+    if (rc == NGX_BUSY || rc == NGX_DECLINED) {
+        ngx_http_upstream_hc_done(hp, NGX_ERROR);
+        return;
+    }
+
+    c = hp->pc.connection;
+
+    c->data = hp;
+
+    c->read->handler = ngx_http_upstream_hc_read_handler;
+    c->write->handler = ngx_http_upstream_hc_write_handler;
+
+    hp->request.pos = hp->conf->request.data;
+    hp->request.last = hp->request.pos + hp->conf->request.len;
+
+    hp->response->pos = hp->response->start;
+    hp->response->last = hp->response->start;
+
+    ngx_add_timer(c->read, hp->conf->timeout);
+    ngx_add_timer(c->write, hp->conf->timeout);
+
+    if (rc == NGX_OK) {
+        ngx_http_upstream_hc_write_handler(c->write);
+    }
+}
+
+
+static void
+ngx_http_upstream_hc_write_handler(ngx_event_t *wev)
+{
+    ssize_t                       n, size;
+    ngx_connection_t             *c;
+    ngx_http_upstream_hc_peer_t  *hp;
+
+    c = wev->data;
+    hp = c->data;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, wev->log, 0,
+                   "health check write handler");
+
+    if (wev->timedout) {
+        ngx_log_error(NGX_LOG_ERR, wev->log, NGX_ETIMEDOUT,
+                      "health check of %V timed out", hp->pc.name);
+        ngx_http_upstream_hc_done(hp, NGX_ERROR);
+        return;
+    }
+
+    size = hp->request.last - hp->request.pos;
+
+    n = ngx_send(c, hp->request.pos, size);
+
+    if (n == NGX_ERROR) {
+        ngx_http_upstream_hc_done(hp, NGX_ERROR);
+        return;
+    }
+
+    if (n > 0) {
+        hp->request.pos += n;
+
+        if (n == size) {
+            wev->handler = ngx_http_upstream_hc_dummy_handler;
+
+            if (wev->timer_set) {
+                ngx_del_timer(wev);
+            }
+
+            if (ngx_handle_write_event(wev, 0) != NGX_OK) {
+                ngx_http_upstream_hc_done(hp, NGX_ERROR);
+            }
+
+            return;
+        }
+    }
+
+    if (!wev->timer_set) {
+        ngx_add_timer(wev, hp->conf->timeout);
+    }
+}
+
+
+static void
+ngx_http_upstream_hc_read_handler(ngx_event_t *rev)
+{
+    ssize_t                       n, size;
+    ngx_buf_t                    *b;
+    ngx_connection_t             *c;
+    ngx_http_upstream_hc_peer_t  *hp;
+
+    c = rev->data;
+    hp = c->data;
+    b = hp->response;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, rev->log, 0,
+                   "health check read handler");
+
+    if (rev->timedout) {
+        ngx_log_error(NGX_LOG_ERR, rev->log, NGX_ETIMEDOUT,
+                      "health check of %V timed out", hp->pc.name);
+        ngx_http_upstream_hc_done(hp, NGX_ERROR);
+        return;
+    }
+
+    /* the response is read till the close or the end of the buffer */
+
+    for ( ;; ) {
+
+        size = b->end - b->last;
+
+        if (size == 0) {
+            break;
+        }
+
+        n = ngx_recv(c, b->last, size);
+
+        if (n > 0) {
+            b->last += n;
+            continue;
+        }
+
+        if (n == NGX_AGAIN) {
+
+            if (ngx_handle_read_event(rev, 0) != NGX_OK) {
+                ngx_http_upstream_hc_done(hp, NGX_ERROR);
+            }
+
+            return;
+        }
+
+        if (n == NGX_ERROR) {
+            ngx_http_upstream_hc_done(hp, NGX_ERROR);
+            return;
+        }
+
+        break;
+    }
+
+    ngx_http_upstream_hc_done(hp, ngx_http_upstream_hc_match(hp));
+}
+
+
+static void
+ngx_http_upstream_hc_dummy_handler(ngx_event_t *ev)
+{
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ev->log, 0,
+                   "health check dummy handler");
+}
+
+
+static ngx_int_t
+ngx_http_upstream_hc_match(ngx_http_upstream_hc_peer_t *hp)
+{
+    u_char                           *p, *last;
+    ngx_int_t                         status;
+    ngx_http_upstream_hc_srv_conf_t  *hcf;
+
+    hcf = hp->conf;
+
+    p = hp->response->pos;
+    last = hp->response->last;
+
+    /* "HTTP/1.x NNN" */
+
+    if (last - p < 12 || ngx_strncmp(p, "HTTP/1.", 7) != 0 || p[8] != ' ') {
+        ngx_log_error(NGX_LOG_ERR, hp->timer.log, 0,
+                      "health check of %V got invalid response",
+                      hp->pc.name);
+        return NGX_ERROR;
+    }
+
+    status = ngx_atoi(p + 9, 3);
+
+    if (status == NGX_ERROR
+        || (ngx_uint_t) status < hcf->status_min
+        || (ngx_uint_t) status > hcf->status_max)
+    {
+        ngx_log_error(NGX_LOG_ERR, hp->timer.log, 0,
+                      "health check of %V got status \"%*s\"",
+                      hp->pc.name, (size_t) 3, p + 9);
+        return NGX_ERROR;
+    }
+
+    if (hcf->body.len == 0) {
+        return NGX_OK;
+    }
+
+    /* the body is looked up within the first buffer of the response */
+
+    for ( /* void */ ; p + 4 <= last; p++) {
+        if (ngx_strncmp(p, "\r\n\r\n", 4) == 0) {
+            break;
+        }
+    }
+
+    for (p += 4; p + hcf->body.len <= last; p++) {
+        if (ngx_memcmp(p, hcf->body.data, hcf->body.len) == 0) {
+            return NGX_OK;
+        }
+    }
+
+    ngx_log_error(NGX_LOG_ERR, hp->timer.log, 0,
+                  "health check of %V did not match body \"%V\"",
+                  hp->pc.name, &hcf->body);
+
+    return NGX_ERROR;
+}
+
+
+static void
+ngx_http_upstream_hc_done(ngx_http_upstream_hc_peer_t *hp, ngx_int_t rc)
+{
+    ngx_http_upstream_rr_peer_t      *peer;
+    ngx_http_upstream_hc_srv_conf_t  *hcf;
+
+    if (hp->pc.connection) {
+        ngx_close_connection(hp->pc.connection);
+        hp->pc.connection = NULL;
+    }
+
+    hcf = hp->conf;
+    peer = &hp->peers->peer[hp->index];
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, hp->timer.log, 0,
+                   "health check peer %V: %i", &peer->name, rc);
+
+    if (rc == NGX_OK) {
+        hp->fails = 0;
+        hp->passes++;
+
+        if ((peer->down & NGX_HTTP_UPSTREAM_HC_DOWN)
+            && hp->passes >= hcf->passes)
+        {
+            ngx_http_upstream_rr_peers_lock(hp->peers);
+            peer->down &= ~NGX_HTTP_UPSTREAM_HC_DOWN;
+            ngx_http_upstream_rr_peers_unlock(hp->peers);
+
+            ngx_log_error(NGX_LOG_NOTICE, hp->timer.log, 0,
+                          "upstream peer %V is up", &peer->name);
+        }
+
+    } else {
+        hp->passes = 0;
+        hp->fails++;
+
+        if (!(peer->down & NGX_HTTP_UPSTREAM_HC_DOWN)
+            && hp->fails >= hcf->fails)
+        {
+            ngx_http_upstream_rr_peers_lock(hp->peers);
+            peer->down |= NGX_HTTP_UPSTREAM_HC_DOWN;
+            ngx_http_upstream_rr_peers_unlock(hp->peers);
+
+            ngx_log_error(NGX_LOG_WARN, hp->timer.log, 0,
+                          "upstream peer %V is down", &peer->name);
+        }
+    }
+
+    ngx_add_timer(&hp->timer, hcf->interval);
+}
+
+
+static void *
+ngx_http_upstream_hc_create_conf(ngx_conf_t *cf)
+{
+    ngx_http_upstream_hc_srv_conf_t  *conf;
+
+    conf = ngx_pcalloc(cf->pool, sizeof(ngx_http_upstream_hc_srv_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    /*
+     * set by ngx_pcalloc():
+     *
+     *     conf->enable = 0;
+     *     conf->body = { 0, NULL };
+     *     conf->request = { 0, NULL };
+     */
+
+    return conf;
+}
+
+
+static char *
+ngx_http_upstream_health_check(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_upstream_hc_srv_conf_t *hcf = conf;
+
+    u_char                        *p, *dash;
+    size_t                         len;
+    ngx_int_t                      n, min, max;
+    ngx_str_t                     *value, s, uri;
+    ngx_uint_t                     i;
+    ngx_http_upstream_srv_conf_t  *uscf;
+
+    if (hcf->enable) {
+        return "is duplicate";
+    }
+
+    hcf->enable = 1;
+    hcf->interval = 5000;
+    hcf->timeout = 5000;
+    hcf->fails = 1;
+    hcf->passes = 1;
+    hcf->status_min = 200;
+    hcf->status_max = 399;
+
+    ngx_str_set(&uri, "/");
+
+    value = cf->args->elts;
+
+    for (i = 1; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "interval=", 9) == 0) {
+            s.len = value[i].len - 9;
+            s.data = value[i].data + 9;
+
+            hcf->interval = ngx_parse_time(&s, 0);
+            if (hcf->interval == (ngx_msec_t) NGX_ERROR
+                || hcf->interval == 0)
+            {
+                goto invalid;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "timeout=", 8) == 0) {
+            s.len = value[i].len - 8;
+            s.data = value[i].data + 8;
+
+            hcf->timeout = ngx_parse_time(&s, 0);
+            if (hcf->timeout == (ngx_msec_t) NGX_ERROR
+                || hcf->timeout == 0)
+            {
+                goto invalid;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "fails=", 6) == 0) {
+            n = ngx_atoi(value[i].data + 6, value[i].len - 6);
+            if (n == NGX_ERROR || n == 0) {
+                goto invalid;
+            }
+
+            hcf->fails = n;
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "passes=", 7) == 0) {
+            n = ngx_atoi(value[i].data + 7, value[i].len - 7);
+            if (n == NGX_ERROR || n == 0) {
+                goto invalid;
+            }
+
+            hcf->passes = n;
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "uri=", 4) == 0) {
+            uri.len = value[i].len - 4;
+            uri.data = value[i].data + 4;
+
+            if (uri.len == 0 || uri.data[0] != '/') {
+                goto invalid;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "status=", 7) == 0) {
+            p = value[i].data + 7;
+            len = value[i].len - 7;
+
+            dash = ngx_strlchr(p, p + len, '-');
+
+            if (dash) {
+                min = ngx_atoi(p, dash - p);
+                max = ngx_atoi(dash + 1, p + len - dash - 1);
+
+            } else {
+                min = ngx_atoi(p, len);
+                max = min;
+            }
+
+            if (min == NGX_ERROR || max == NGX_ERROR
+                || min < 100 || max > 599 || min > max)
+            {
+                goto invalid;
+            }
+
+            hcf->status_min = min;
+            hcf->status_max = max;
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "body=", 5) == 0) {
+            hcf->body.len = value[i].len - 5;
+            hcf->body.data = value[i].data + 5;
+
+            if (hcf->body.len == 0) {
+                goto invalid;
+            }
+
+            continue;
+        }
+
+        goto invalid;
+    }
+
+    uscf = ngx_http_conf_get_module_srv_conf(cf, ngx_http_upstream_module);
+
+    len = sizeof("GET  HTTP/1.0" CRLF) - 1 + uri.len
+          + sizeof("Host: " CRLF) - 1 + uscf->host.len
+          + sizeof("User-Agent: nginx health check" CRLF) - 1
+          + sizeof("Connection: close" CRLF) - 1
+          + sizeof(CRLF) - 1;
+
+    p = ngx_pnalloc(cf->pool, len);
+    if (p == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    hcf->request.data = p;
+    hcf->request.len = ngx_sprintf(p, "GET %V HTTP/1.0" CRLF
+                                      "Host: %V" CRLF
+                                      "User-Agent: nginx health check" CRLF
+                                      "Connection: close" CRLF CRLF,
+                                   &uri, &uscf->host)
+                       - p;
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "invalid parameter \"%V\"", &value[i]);
+
+    return NGX_CONF_ERROR;
+}
+
+
+static ngx_int_t
+ngx_http_upstream_hc_init(ngx_conf_t *cf)
+{
+    ngx_uint_t                        i;
+    ngx_http_upstream_rr_peers_t     *peers;
+    ngx_http_upstream_srv_conf_t     *uscf, **uscfp;
+    ngx_http_upstream_hc_srv_conf_t  *hcf;
+    ngx_http_upstream_main_conf_t    *umcf;
+
+    umcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_upstream_module);
+
+    uscfp = umcf->upstreams.elts;
+
+    for (i = 0; i < umcf->upstreams.nelts; i++) {
+        uscf = uscfp[i];
+
+        if (uscf->srv_conf == NULL) {
+            continue;
+        }
+
+        hcf = ngx_http_conf_upstream_srv_conf(uscf,
+                                        ngx_http_upstream_health_check_module);
+
+        if (!hcf->enable) {
+            continue;
+        }
+
+        /* the state must be seen by the workers */
+
+        if (uscf->shm_zone == NULL) {
+            ngx_log_error(NGX_LOG_EMERG, cf->log, 0,
+                          "\"health_check\" requires \"zone\" "
+                          "in upstream \"%V\" in %s:%ui",
+                          &uscf->host, uscf->file_name, uscf->line);
+            return NGX_ERROR;
+        }
+
+        cf->cycle->health_check = ngx_http_upstream_hc_start;
+
+        /* the process connections are sized by the number of checked peers */
+
+        for (peers = uscf->peer.data; peers; peers = peers->next) {
+            cf->cycle->health_check_peers += peers->number;
+        }
+    }
+
+    return NGX_OK;
+}
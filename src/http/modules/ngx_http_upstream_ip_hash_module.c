@@ -116,17 +116,17 @@ ngx_http_upstream_init_ip_hash_peer(ngx_http_request_t *r,
 
     r->upstream->peer.get = ngx_http_upstream_get_ip_hash_peer;
 
-    switch (r->connection->sockaddr->sa_family) {
+    switch (r->connection->cold->sockaddr->sa_family) {
 
     case AF_INET:
-        sin = (struct sockaddr_in *) r->connection->sockaddr;
+        sin = (struct sockaddr_in *) r->connection->cold->sockaddr;
         iphp->addr = (u_char *) &sin->sin_addr.s_addr;
         iphp->addrlen = 3;
         break;
 
 #if (NGX_HAVE_INET6)
     case AF_INET6:
-        sin6 = (struct sockaddr_in6 *) r->connection->sockaddr;
+        sin6 = (struct sockaddr_in6 *) r->connection->cold->sockaddr;
         iphp->addr = (u_char *) &sin6->sin6_addr.s6_addr;
         iphp->addrlen = 16;
         break;
@@ -204,7 +204,7 @@ ngx_http_upstream_get_ip_hash_peer(ngx_peer_connection_t *pc, void *data)
 
             peer = &iphp->rrp.peers->peer[p];
 
-            /* ngx_lock_mutex(iphp->rrp.peers->mutex); */
+            ngx_http_upstream_rr_peers_lock(iphp->rrp.peers);
 
             if (!peer->down) {
 
@@ -220,7 +220,7 @@ ngx_http_upstream_get_ip_hash_peer(ngx_peer_connection_t *pc, void *data)
 
             iphp->rrp.tried[n] |= m;
 
-            /* ngx_unlock_mutex(iphp->rrp.peers->mutex); */
+            ngx_http_upstream_rr_peers_unlock(iphp->rrp.peers);
 
             pc->tries--;
         }
@@ -236,7 +236,7 @@ ngx_http_upstream_get_ip_hash_peer(ngx_peer_connection_t *pc, void *data)
     pc->socklen = peer->socklen;
     pc->name = &peer->name;
 
-    /* ngx_unlock_mutex(iphp->rrp.peers->mutex); */
+    ngx_http_upstream_rr_peers_unlock(iphp->rrp.peers);
 
     iphp->rrp.tried[n] |= m;
     iphp->hash = hash;
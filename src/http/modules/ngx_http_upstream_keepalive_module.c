@@ -12,10 +12,20 @@
 
 typedef struct {
     ngx_uint_t                         max_cached;
+    ngx_msec_t                         timeout;
+    ngx_uint_t                         requests;
+    ngx_uint_t                         prewarm;
 
+    /* all the idle connections, the least recently used are at the tail */
     ngx_queue_t                        cache;
     ngx_queue_t                        free;
 
+    /* the idle connections of a peer, hashed by its address */
+    ngx_queue_t                       *buckets;
+    ngx_uint_t                         nbuckets;
+
+    ngx_http_upstream_srv_conf_t      *upstream;
+
     ngx_http_upstream_init_pt          original_init_upstream;
     ngx_http_upstream_init_peer_pt     original_init_peer;
 
@@ -44,6 +54,7 @@ typedef struct {
     ngx_http_upstream_keepalive_srv_conf_t  *conf;
 
     ngx_queue_t                        queue;
+    ngx_queue_t                        bucket;
     ngx_connection_t                  *connection;
 
     socklen_t                          socklen;
@@ -59,10 +70,22 @@ static ngx_int_t ngx_http_upstream_get_keepalive_peer(ngx_peer_connection_t *pc,
 static void ngx_http_upstream_free_keepalive_peer(ngx_peer_connection_t *pc,
     void *data, ngx_uint_t state);
 
+static ngx_queue_t *ngx_http_upstream_keepalive_bucket(
+    ngx_http_upstream_keepalive_srv_conf_t *kcf, struct sockaddr *sockaddr,
+    socklen_t socklen);
+static void ngx_http_upstream_keepalive_save(
+    ngx_http_upstream_keepalive_cache_t *item, ngx_connection_t *c);
+
 static void ngx_http_upstream_keepalive_dummy_handler(ngx_event_t *ev);
 static void ngx_http_upstream_keepalive_close_handler(ngx_event_t *ev);
 static void ngx_http_upstream_keepalive_close(ngx_connection_t *c);
 
+static ngx_int_t ngx_http_upstream_keepalive_init_process(ngx_cycle_t *cycle);
+static void ngx_http_upstream_keepalive_prewarm(
+    ngx_http_upstream_keepalive_srv_conf_t *kcf, ngx_addr_t *addr,
+    ngx_log_t *log);
+static void ngx_http_upstream_keepalive_prewarm_handler(ngx_event_t *ev);
+
 
 #if (NGX_HTTP_SSL)
 static ngx_int_t ngx_http_upstream_keepalive_set_session(
@@ -85,6 +108,27 @@ static ngx_command_t  ngx_http_upstream_keepalive_commands[] = {
       0,
       NULL },
 
+    { ngx_string("keepalive_timeout"),
+      NGX_HTTP_UPS_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_msec_slot,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      offsetof(ngx_http_upstream_keepalive_srv_conf_t, timeout),
+      NULL },
+
+    { ngx_string("keepalive_requests"),
+      NGX_HTTP_UPS_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      offsetof(ngx_http_upstream_keepalive_srv_conf_t, requests),
+      NULL },
+
+    { ngx_string("keepalive_prewarm"),
+      NGX_HTTP_UPS_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_SRV_CONF_OFFSET,
+      offsetof(ngx_http_upstream_keepalive_srv_conf_t, prewarm),
+      NULL },
+
       ngx_null_command
 };
 
@@ -111,7 +155,7 @@ ngx_module_t  ngx_http_upstream_keepalive_module = {
     NGX_HTTP_MODULE,                       /* module type */
     NULL,                                  /* init master */
     NULL,                                  /* init module */
-    NULL,                                  /* init process */
+    ngx_http_upstream_keepalive_init_process, /* init process */
     NULL,                                  /* init thread */
     NULL,                                  /* exit thread */
     NULL,                                  /* exit process */
@@ -124,7 +168,8 @@ static ngx_int_t
 ngx_http_upstream_init_keepalive(ngx_conf_t *cf,
     ngx_http_upstream_srv_conf_t *us)
 {
-    ngx_uint_t                               i;
+    ngx_uint_t                               i, n;
+    ngx_http_upstream_server_t              *server;
     ngx_http_upstream_keepalive_srv_conf_t  *kcf;
     ngx_http_upstream_keepalive_cache_t     *cached;
 
@@ -142,6 +187,37 @@ ngx_http_upstream_init_keepalive(ngx_conf_t *cf,
 
     us->peer.init = ngx_http_upstream_init_keepalive_peer;
 
+    ngx_conf_init_msec_value(kcf->timeout, 60000);
+    ngx_conf_init_uint_value(kcf->requests, 100);
+    ngx_conf_init_uint_value(kcf->prewarm, 0);
+
+    kcf->upstream = us;
+
+    /* a bucket per peer address, rounded up to a power of two */
+
+    n = 0;
+
+    if (us->servers) {
+        server = us->servers->elts;
+
+        for (i = 0; i < us->servers->nelts; i++) {
+            n += server[i].naddrs;
+        }
+    }
+
+    for (kcf->nbuckets = 1; kcf->nbuckets < n; kcf->nbuckets <<= 1) {
+        /* void */
+    }
+
+    kcf->buckets = ngx_palloc(cf->pool, sizeof(ngx_queue_t) * kcf->nbuckets);
+    if (kcf->buckets == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < kcf->nbuckets; i++) {
+        ngx_queue_init(&kcf->buckets[i]);
+    }
+
     /* allocate cache items and add to free queue */
 
     cached = ngx_pcalloc(cf->pool,
@@ -212,7 +288,7 @@ ngx_http_upstream_get_keepalive_peer(ngx_peer_connection_t *pc, void *data)
     ngx_http_upstream_keepalive_cache_t      *item;
 
     ngx_int_t          rc;
-    ngx_queue_t       *q, *cache;
+    ngx_queue_t       *q, *bucket;
     ngx_connection_t  *c;
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, pc->log, 0,
@@ -226,27 +302,33 @@ ngx_http_upstream_get_keepalive_peer(ngx_peer_connection_t *pc, void *data)
         return rc;
     }
 
-    /* search cache for suitable connection */
+    /* search the peer's bucket for a suitable connection */
 
-    cache = &kp->conf->cache;
+    bucket = ngx_http_upstream_keepalive_bucket(kp->conf, pc->sockaddr,
+                                                pc->socklen);
 
-    for (q = ngx_queue_head(cache);
-         q != ngx_queue_sentinel(cache);
+    for (q = ngx_queue_head(bucket);
+         q != ngx_queue_sentinel(bucket);
          q = ngx_queue_next(q))
     {
-        item = ngx_queue_data(q, ngx_http_upstream_keepalive_cache_t, queue);
+        item = ngx_queue_data(q, ngx_http_upstream_keepalive_cache_t, bucket);
         c = item->connection;
 
         if (ngx_memn2cmp((u_char *) &item->sockaddr, (u_char *) pc->sockaddr,
                          item->socklen, pc->socklen)
             == 0)
         {
-            ngx_queue_remove(q);
-            ngx_queue_insert_head(&kp->conf->free, q);
+            ngx_queue_remove(&item->bucket);
+            ngx_queue_remove(&item->queue);
+            ngx_queue_insert_head(&kp->conf->free, &item->queue);
 
             ngx_log_debug1(NGX_LOG_DEBUG_HTTP, pc->log, 0,
                            "get keepalive peer: using connection %p", c);
 
+            if (c->read->timer_set) {
+                ngx_del_timer(c->read);
+            }
+
             c->idle = 0;
             c->log = pc->log;
             c->read->log = pc->log;
@@ -298,6 +380,10 @@ ngx_http_upstream_free_keepalive_peer(ngx_peer_connection_t *pc, void *data,
         goto invalid;
     }
 
+    if (++c->requests >= kp->conf->requests) {
+        goto invalid;
+    }
+
     if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
         goto invalid;
     }
@@ -307,11 +393,15 @@ ngx_http_upstream_free_keepalive_peer(ngx_peer_connection_t *pc, void *data,
 
     if (ngx_queue_empty(&kp->conf->free)) {
 
+        /* evict the least recently used connection */
+
         q = ngx_queue_last(&kp->conf->cache);
         ngx_queue_remove(q);
 
         item = ngx_queue_data(q, ngx_http_upstream_keepalive_cache_t, queue);
 
+        ngx_queue_remove(&item->bucket);
+
         ngx_http_upstream_keepalive_close(item->connection);
 
     } else {
@@ -321,10 +411,46 @@ ngx_http_upstream_free_keepalive_peer(ngx_peer_connection_t *pc, void *data,
         item = ngx_queue_data(q, ngx_http_upstream_keepalive_cache_t, queue);
     }
 
+    pc->connection = NULL;
+
+    item->socklen = pc->socklen;
+    ngx_memcpy(&item->sockaddr, pc->sockaddr, pc->socklen);
+
+    ngx_http_upstream_keepalive_save(item, c);
+
+invalid:
+
+    kp->original_free_peer(pc, kp->data, state);
+}
+
+
+static ngx_queue_t *
+ngx_http_upstream_keepalive_bucket(ngx_http_upstream_keepalive_srv_conf_t *kcf,
+    struct sockaddr *sockaddr, socklen_t socklen)
+{
+    uint32_t  hash;
+
+    hash = ngx_crc32_short((u_char *) sockaddr, socklen);
+
+    return &kcf->buckets[hash & (kcf->nbuckets - 1)];
+}
+
+
+static void
+ngx_http_upstream_keepalive_save(ngx_http_upstream_keepalive_cache_t *item,
+    ngx_connection_t *c)
+{
+    ngx_http_upstream_keepalive_srv_conf_t  *kcf;
+
+    kcf = item->conf;
+
     item->connection = c;
-    ngx_queue_insert_head(&kp->conf->cache, q);
 
-    pc->connection = NULL;
+    ngx_queue_insert_head(&kcf->cache, &item->queue);
+    ngx_queue_insert_head(ngx_http_upstream_keepalive_bucket(kcf,
+                              (struct sockaddr *) item->sockaddr,
+                              item->socklen),
+                          &item->bucket);
 
     if (c->read->timer_set) {
         ngx_del_timer(c->read);
@@ -343,16 +469,11 @@ ngx_http_upstream_free_keepalive_peer(ngx_peer_connection_t *pc, void *data,
     c->write->log = ngx_cycle->log;
     c->pool->log = ngx_cycle->log;
 
-    item->socklen = pc->socklen;
-    ngx_memcpy(&item->sockaddr, pc->sockaddr, pc->socklen);
+    ngx_add_timer(c->read, kcf->timeout);
 
     if (c->read->ready) {
         ngx_http_upstream_keepalive_close_handler(c->read);
     }
-
-invalid:
-
-    kp->original_free_peer(pc, kp->data, state);
 }
 
 
@@ -379,7 +500,7 @@ ngx_http_upstream_keepalive_close_handler(ngx_event_t *ev)
 
     c = ev->data;
 
-    if (c->close) {
+    if (c->close || ev->timedout) {
         goto close;
     }
 
@@ -402,6 +523,7 @@ close:
 
     ngx_http_upstream_keepalive_close(c);
 
+    ngx_queue_remove(&item->bucket);
     ngx_queue_remove(&item->queue);
     ngx_queue_insert_head(&conf->free, &item->queue);
 }
@@ -430,6 +552,180 @@ ngx_http_upstream_keepalive_close(ngx_connection_t *c)
 }
 
 
+static ngx_int_t
+ngx_http_upstream_keepalive_init_process(ngx_cycle_t *cycle)
+{
+    ngx_uint_t                               i, j, k;
+    ngx_http_upstream_server_t              *server;
+    ngx_http_upstream_srv_conf_t            *uscf, **uscfp;
+    ngx_http_upstream_main_conf_t           *umcf;
+    ngx_http_upstream_keepalive_srv_conf_t  *kcf;
+
+    /* the helper processes do not proxy requests */
+
+    if (ngx_process != NGX_PROCESS_WORKER
+        && ngx_process != NGX_PROCESS_SINGLE)
+    {
+        return NGX_OK;
+    }
+
+    umcf = ngx_http_cycle_get_module_main_conf(cycle, ngx_http_upstream_module);
+    if (umcf == NULL) {
+        return NGX_OK;
+    }
+
+    uscfp = umcf->upstreams.elts;
+
+    for (i = 0; i < umcf->upstreams.nelts; i++) {
+        uscf = uscfp[i];
+
+        if (uscf->srv_conf == NULL) {
+            continue;
+        }
+
+        kcf = ngx_http_conf_upstream_srv_conf(uscf,
+                                          ngx_http_upstream_keepalive_module);
+
+        if (kcf->original_init_upstream == NULL || kcf->prewarm == 0) {
+            continue;
+        }
+
+        server = uscf->servers->elts;
+
+        for (j = 0; j < uscf->servers->nelts; j++) {
+
+            if (server[j].backup || server[j].down) {
+                continue;
+            }
+
+            for (k = 0; k < server[j].naddrs * kcf->prewarm; k++) {
+                ngx_http_upstream_keepalive_prewarm(kcf,
+                                    &server[j].addrs[k % server[j].naddrs],
+                                    cycle->log);
+            }
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_upstream_keepalive_prewarm(ngx_http_upstream_keepalive_srv_conf_t *kcf,
+    ngx_addr_t *addr, ngx_log_t *log)
+{
+    ngx_int_t                             rc;
+    ngx_queue_t                          *q;
+    ngx_connection_t                     *c;
+    ngx_peer_connection_t                 pc;
+    ngx_http_upstream_keepalive_cache_t  *item;
+
+    /* the prewarmed connections never evict the cached ones */
+
+    if (ngx_queue_empty(&kcf->free)) {
+        return;
+    }
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, log, 0,
+                   "keepalive prewarm %V", &addr->name);
+
+    ngx_memzero(&pc, sizeof(ngx_peer_connection_t));
+
+    pc.sockaddr = addr->sockaddr;
+    pc.socklen = addr->socklen;
+    pc.name = &addr->name;
+    pc.get = ngx_event_get_peer;
+    pc.log = log;
+    pc.log_error = NGX_ERROR_ERR;
+
+    rc = ngx_event_connect_peer(&pc);
+
+    if (rc == NGX_ERROR || rc == NGX_BUSY || rc == NGX_DECLINED) {
+        return;
+    }
+
+    c = pc.connection;
+
+    c->pool = ngx_create_pool(128, log);
+    if (c->pool == NULL) {
+        ngx_close_connection(c);
+        return;
+    }
+
+    q = ngx_queue_head(&kcf->free);
+    ngx_queue_remove(q);
+
+    item = ngx_queue_data(q, ngx_http_upstream_keepalive_cache_t, queue);
+
+    item->socklen = pc.socklen;
+    ngx_memcpy(&item->sockaddr, pc.sockaddr, pc.socklen);
+
+    if (rc == NGX_OK) {
+        ngx_http_upstream_keepalive_save(item, c);
+        return;
+    }
+
+    /* the item is kept aside till the connection is established */
+
+    item->connection = c;
+
+    c->data = item;
+    c->read->handler = ngx_http_upstream_keepalive_prewarm_handler;
+    c->write->handler = ngx_http_upstream_keepalive_prewarm_handler;
+
+    ngx_add_timer(c->write, kcf->timeout);
+}
+
+
+static void
+ngx_http_upstream_keepalive_prewarm_handler(ngx_event_t *ev)
+{
+    int                                   err;
+    socklen_t                             len;
+    ngx_connection_t                     *c;
+    ngx_http_upstream_keepalive_cache_t  *item;
+
+    c = ev->data;
+    item = c->data;
+
+    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ev->log, 0,
+                   "keepalive prewarm handler");
+
+    if (ev->timedout) {
+        ngx_log_error(NGX_LOG_ERR, ev->log, NGX_ETIMEDOUT,
+                      "keepalive prewarm connect() timed out");
+        goto failed;
+    }
+
+    err = 0;
+    len = sizeof(int);
+
+    if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, (void *) &err, &len) == -1) {
+        err = ngx_socket_errno;
+    }
+
+    if (err) {
+        ngx_log_error(NGX_LOG_ERR, ev->log, err,
+                      "keepalive prewarm connect() failed");
+        goto failed;
+    }
+
+    if (ngx_handle_write_event(c->write, 0) != NGX_OK) {
+        goto failed;
+    }
+
+    ngx_http_upstream_keepalive_save(item, c);
+
+    return;
+
+failed:
+
+    ngx_http_upstream_keepalive_close(c);
+
+    ngx_queue_insert_head(&item->conf->free, &item->queue);
+}
+
+
 #if (NGX_HTTP_SSL)
 
 static ngx_int_t
@@ -467,11 +763,16 @@ ngx_http_upstream_keepalive_create_conf(ngx_conf_t *cf)
     /*
      * set by ngx_pcalloc():
      *
+     *     conf->buckets = NULL;
+     *     conf->upstream = NULL;
      *     conf->original_init_upstream = NULL;
      *     conf->original_init_peer = NULL;
      */
 
     conf->max_cached = 1;
+    conf->timeout = NGX_CONF_UNSET_MSEC;
+    conf->requests = NGX_CONF_UNSET_UINT;
+    conf->prewarm = NGX_CONF_UNSET_UINT;
 
     return conf;
 }
@@ -526,11 +526,11 @@ ngx_http_userid_create_uid(ngx_http_request_t *r, ngx_http_userid_ctx_t *ctx,
                 return NGX_ERROR;
             }
 
-            switch (c->local_sockaddr->sa_family) {
+            switch (c->cold->local_sockaddr->sa_family) {
 
 #if (NGX_HAVE_INET6)
             case AF_INET6:
-                sin6 = (struct sockaddr_in6 *) c->local_sockaddr;
+                sin6 = (struct sockaddr_in6 *) c->cold->local_sockaddr;
 
                 p = (u_char *) &ctx->uid_set[0];
 
@@ -542,7 +542,7 @@ ngx_http_userid_create_uid(ngx_http_request_t *r, ngx_http_userid_ctx_t *ctx,
                 break;
 #endif
             default: /* AF_INET */
-                sin = (struct sockaddr_in *) c->local_sockaddr;
+                sin = (struct sockaddr_in *) c->cold->local_sockaddr;
                 ctx->uid_set[0] = sin->sin_addr.s_addr;
                 break;
             }
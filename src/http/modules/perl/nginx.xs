@@ -209,8 +209,8 @@ remote_addr(r)
     ngx_http_request_t  *r;
 
     ngx_http_perl_set_request(r);
-    ngx_http_perl_set_targ(r->connection->addr_text.data,
-                           r->connection->addr_text.len);
+    ngx_http_perl_set_targ(r->connection->cold->addr_text.data,
+                           r->connection->cold->addr_text.len);
 
     ST(0) = TARG;
 
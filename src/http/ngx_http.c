@@ -454,7 +454,9 @@ ngx_http_init_headers_in_hash(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf)
     hash.pool = cf->pool;
     hash.temp_pool = NULL;
 
-    if (ngx_hash_init(&hash, headers_in.elts, headers_in.nelts) != NGX_OK) {
+    if (ngx_hash_perfect_init(&hash, headers_in.elts, headers_in.nelts)
+        != NGX_OK)
+    {
         return NGX_ERROR;
     }
 
@@ -1573,7 +1575,9 @@ ngx_http_server_names(ngx_conf_t *cf, ngx_http_core_main_conf_t *cmcf,
 
         // hash.hash是个传出参数，会给addr->hash赋值
         // 用ha中的数据初始化hash.hash
-        if (ngx_hash_init(&hash, ha.keys.elts, ha.keys.nelts) != NGX_OK) {
+        if (ngx_hash_perfect_init(&hash, ha.keys.elts, ha.keys.nelts)
+            != NGX_OK)
+        {
             goto failed;
         }
     }
@@ -1777,6 +1781,11 @@ ngx_http_init_listening(ngx_conf_t *cf, ngx_http_conf_port_t *port)
             break;
         }
 
+        // reuseport: 为每个worker复制一份ls，servers等信息是共用的
+        if (ngx_clone_listening(cf, ls) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
         addr++;
         last--;
     }
@@ -1853,6 +1862,10 @@ ngx_http_add_listening(ngx_conf_t *cf, ngx_http_conf_addr_t *addr)
     ls->setfib = addr->opt.setfib;
 #endif
 
+#if (NGX_HAVE_REUSEPORT)
+    ls->reuseport = addr->opt.reuseport;
+#endif
+
     return ls;
 }
 
@@ -2082,7 +2095,9 @@ ngx_http_merge_types(ngx_conf_t *cf, ngx_array_t **keys, ngx_hash_t *types_hash,
         hash.pool = cf->pool;
         hash.temp_pool = NULL;
 
-        if (ngx_hash_init(&hash, (*keys)->elts, (*keys)->nelts) != NGX_OK) {
+        if (ngx_hash_perfect_init(&hash, (*keys)->elts, (*keys)->nelts)
+            != NGX_OK)
+        {
             return NGX_CONF_ERROR;
         }
 
@@ -2112,7 +2127,8 @@ ngx_http_merge_types(ngx_conf_t *cf, ngx_array_t **keys, ngx_hash_t *types_hash,
         hash.pool = cf->pool;
         hash.temp_pool = NULL;
 
-        if (ngx_hash_init(&hash, (*prev_keys)->elts, (*prev_keys)->nelts)
+        if (ngx_hash_perfect_init(&hash, (*prev_keys)->elts,
+                                  (*prev_keys)->nelts)
             != NGX_OK)
         {
             return NGX_CONF_ERROR;
@@ -25,6 +25,13 @@
 #define NGX_HTTP_CACHE_KEY_LEN       16
 
 
+/* the cache size is kept in a 64-bit atomic if there is one */
+
+#if (NGX_HAVE_ATOMIC_OPS && NGX_PTR_SIZE == 8)
+#define NGX_HTTP_FILE_CACHE_ATOMIC_SIZE  1
+#endif
+
+
 typedef struct {
     ngx_uint_t                       status;
     time_t                           valid;
@@ -45,7 +52,9 @@ typedef struct {
     unsigned                         exists:1;
     unsigned                         updating:1;
     unsigned                         deleting:1;
-                                     /* 11 unused bits */
+    /* loaded from the index, the file is not found on disk yet */
+    unsigned                         unverified:1;
+                                     /* 10 unused bits */
 
     ngx_file_uniq_t                  uniq;
     time_t                           expire;
@@ -85,6 +94,10 @@ struct ngx_http_cache_s {
 
     ngx_event_t                      wait_event;
 
+#if (NGX_THREAD_POOL)
+    ngx_thread_task_t               *thread_task;
+#endif
+
     unsigned                         lock:1;
     unsigned                         waiting:1;
 
@@ -92,6 +105,9 @@ struct ngx_http_cache_s {
     unsigned                         updating:1;
     unsigned                         exists:1;
     unsigned                         temp_file:1;
+
+    unsigned                         mem:1;
+    unsigned                         mem_store:1;
 };
 
 
@@ -106,13 +122,60 @@ typedef struct {
 } ngx_http_file_cache_header_t;
 
 
+/*
+ * the index is split into shards selected by the first byte of the key,
+ * each shard has its own lock, so hits on different shards do not contend;
+ * the slab pool mutex is only taken to allocate or free nodes
+ */
+
+typedef struct {
+    ngx_shmtx_sh_t                   lock;
+    ngx_shmtx_t                      mutex;
+    ngx_rbtree_t                     rbtree;
+    ngx_rbtree_node_t                sentinel;
+    ngx_queue_t                      queue;
+} ngx_http_file_cache_shard_t;
+
+
+/* small hot objects are also kept in the "mem_zone", the whole cache file */
+
+typedef struct {
+    ngx_rbtree_node_t                node;
+    ngx_queue_t                      queue;
+
+    u_char                           key[NGX_HTTP_CACHE_KEY_LEN
+                                         - sizeof(ngx_rbtree_key_t)];
+
+    ngx_file_uniq_t                  uniq;
+    size_t                           len;
+
+    /* the readers copy the data outside of the lock */
+    unsigned                         count:31;
+    unsigned                         deleted:1;
+
+    u_char                           data[1];
+} ngx_http_file_cache_mem_node_t;
+
+
 typedef struct {
     ngx_rbtree_t                     rbtree;
     ngx_rbtree_node_t                sentinel;
     ngx_queue_t                      queue;
+} ngx_http_file_cache_mem_sh_t;
+
+
+typedef struct {
+    ngx_http_file_cache_shard_t     *shard;
+    ngx_uint_t                       shards;
     ngx_atomic_t                     cold;
     ngx_atomic_t                     loading;
-    off_t                            size;
+    ngx_atomic_t                     loaded;     /* a bit per loader */
+    ngx_uint_t                       loaders;
+#if (NGX_HTTP_FILE_CACHE_ATOMIC_SIZE)
+    ngx_atomic_t                     size;
+#else
+    off_t                            size;       /* under shpool->mutex */
+#endif
 } ngx_http_file_cache_sh_t;
 
 
@@ -120,6 +183,8 @@ struct ngx_http_file_cache_s {
     ngx_http_file_cache_sh_t        *sh;
     ngx_slab_pool_t                 *shpool;
 
+    ngx_uint_t                       shards;
+
     ngx_path_t                      *path;
 
     off_t                            max_size;
@@ -133,7 +198,17 @@ struct ngx_http_file_cache_s {
     ngx_msec_t                       loader_sleep;
     ngx_msec_t                       loader_threshold;
 
+    ngx_str_t                        index;
+    time_t                           index_interval;
+    time_t                           index_time;
+
     ngx_shm_zone_t                  *shm_zone;
+
+    ngx_http_file_cache_mem_sh_t    *mem_sh;
+    ngx_slab_pool_t                 *mem_shpool;
+    size_t                           max_object;
+
+    ngx_shm_zone_t                  *mem_zone;
 };
 
 
@@ -21,30 +21,61 @@ static ssize_t ngx_http_file_cache_aio_read(ngx_http_request_t *r,
 #if (NGX_HAVE_FILE_AIO)
 static void ngx_http_cache_aio_event_handler(ngx_event_t *ev);
 #endif
+#if (NGX_THREAD_POOL)
+static ngx_int_t ngx_http_cache_thread_handler(ngx_thread_task_t *task,
+    ngx_file_t *file);
+static void ngx_http_cache_thread_event_handler(ngx_event_t *ev);
+#endif
 static ngx_int_t ngx_http_file_cache_exists(ngx_http_file_cache_t *cache,
     ngx_http_cache_t *c);
 static ngx_int_t ngx_http_file_cache_name(ngx_http_request_t *r,
     ngx_path_t *path);
 static ngx_http_file_cache_node_t *
-    ngx_http_file_cache_lookup(ngx_http_file_cache_t *cache, u_char *key);
+    ngx_http_file_cache_lookup(ngx_http_file_cache_shard_t *shard,
+    u_char *key);
 static void ngx_http_file_cache_rbtree_insert_value(ngx_rbtree_node_t *temp,
     ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel);
 static void ngx_http_file_cache_cleanup(void *data);
 static time_t ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache);
 static time_t ngx_http_file_cache_expire(ngx_http_file_cache_t *cache);
 static void ngx_http_file_cache_delete(ngx_http_file_cache_t *cache,
-    ngx_queue_t *q, u_char *name);
+    ngx_http_file_cache_shard_t *shard, ngx_queue_t *q, u_char *name);
 static void ngx_http_file_cache_loader_sleep(ngx_http_file_cache_t *cache);
 static ngx_int_t ngx_http_file_cache_noop(ngx_tree_ctx_t *ctx,
     ngx_str_t *path);
+static ngx_int_t ngx_http_file_cache_loader_dir(ngx_tree_ctx_t *ctx,
+    ngx_str_t *path);
 static ngx_int_t ngx_http_file_cache_manage_file(ngx_tree_ctx_t *ctx,
     ngx_str_t *path);
 static ngx_int_t ngx_http_file_cache_add_file(ngx_tree_ctx_t *ctx,
     ngx_str_t *path);
 static ngx_int_t ngx_http_file_cache_add(ngx_http_file_cache_t *cache,
-    ngx_http_cache_t *c);
+    ngx_http_cache_t *c, ngx_uint_t unverified);
 static ngx_int_t ngx_http_file_cache_delete_file(ngx_tree_ctx_t *ctx,
     ngx_str_t *path);
+static void ngx_http_file_cache_index_load(ngx_http_file_cache_t *cache,
+    ngx_log_t *log);
+static void ngx_http_file_cache_index_save(ngx_http_file_cache_t *cache);
+static void ngx_http_file_cache_index_sweep(ngx_http_file_cache_t *cache);
+static ngx_http_file_cache_node_t *ngx_http_file_cache_index_next(
+    ngx_http_file_cache_shard_t *shard, u_char *key, ngx_uint_t first);
+
+static ngx_int_t ngx_http_file_cache_mem_get(ngx_http_request_t *r,
+    ngx_http_cache_t *c);
+static void ngx_http_file_cache_mem_put(ngx_http_cache_t *c, u_char *data,
+    size_t len);
+static void ngx_http_file_cache_mem_free_locked(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_mem_node_t *mn);
+static void ngx_http_file_cache_mem_delete(ngx_http_file_cache_t *cache,
+    u_char *key);
+static ngx_http_file_cache_mem_node_t *
+    ngx_http_file_cache_mem_lookup(ngx_http_file_cache_t *cache, u_char *key);
+static void ngx_http_file_cache_mem_rbtree_insert_value(
+    ngx_rbtree_node_t *temp, ngx_rbtree_node_t *node,
+    ngx_rbtree_node_t *sentinel);
+static void ngx_http_file_cache_size_add(ngx_http_file_cache_t *cache,
+    off_t n);
+static off_t ngx_http_file_cache_size(ngx_http_file_cache_t *cache);
 
 
 ngx_str_t  ngx_http_cache_status[] = {
@@ -60,14 +91,49 @@ ngx_str_t  ngx_http_cache_status[] = {
 static u_char  ngx_http_file_cache_key[] = { LF, 'K', 'E', 'Y', ':', ' ' };
 
 
+#define ngx_http_file_cache_shard(cache, key)                                 \
+    (&(cache)->sh->shard[(key)[0] % (cache)->sh->shards])
+
+
+/* an object is copied to the memory zone on its second disk hit */
+#define NGX_HTTP_FILE_CACHE_MEM_USES     2
+
+/* evictions allowed to make room for one object */
+#define NGX_HTTP_FILE_CACHE_MEM_TRIES    16
+
+
+/*
+ * the index snapshot is a header followed by the keys and sizes
+ * of all existing entries, it is only valid for the same build and cache
+ */
+
+#define NGX_HTTP_FILE_CACHE_INDEX_MAGIC  0x5844494e     /* "NIDX" */
+#define NGX_HTTP_FILE_CACHE_INDEX_CHUNK  1024
+
+typedef struct {
+    uint32_t                         magic;
+    uint32_t                         entry_size;
+    size_t                           bsize;
+    ngx_uint_t                       entries;
+} ngx_http_file_cache_index_header_t;
+
+
+typedef struct {
+    u_char                           key[NGX_HTTP_CACHE_KEY_LEN];
+    off_t                            fs_size;
+} ngx_http_file_cache_index_entry_t;
+
+
 static ngx_int_t
 ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 {
     ngx_http_file_cache_t  *ocache = data;
 
-    size_t                  len;
-    ngx_uint_t              n;
-    ngx_http_file_cache_t  *cache;
+    u_char                       *file;
+    size_t                        len;
+    ngx_uint_t                    n;
+    ngx_http_file_cache_t        *cache;
+    ngx_http_file_cache_shard_t  *shard;
 
     cache = shm_zone->data;
 
@@ -91,6 +157,13 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
             }
         }
 
+        if (cache->shards != ocache->sh->shards) {
+            ngx_log_error(NGX_LOG_EMERG, shm_zone->shm.log, 0,
+                          "cache \"%V\" had previously different shards",
+                          &shm_zone->shm.name);
+            return NGX_ERROR;
+        }
+
         cache->sh = ocache->sh;
 
         cache->shpool = ocache->shpool;
@@ -100,6 +173,13 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 
         if (!cache->sh->cold || cache->sh->loading) {
             cache->path->loader = NULL;
+
+        } else if (cache->sh->loaders != cache->path->loaders) {
+
+            /* the directories are spread differently, start over */
+
+            cache->sh->loaded = 0;
+            cache->sh->loaders = cache->path->loaders;
         }
 
         return NGX_OK;
@@ -121,13 +201,51 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
 
     cache->shpool->data = cache->sh;
 
-    ngx_rbtree_init(&cache->sh->rbtree, &cache->sh->sentinel,
-                    ngx_http_file_cache_rbtree_insert_value);
+    len = cache->shards * sizeof(ngx_http_file_cache_shard_t);
+
+    cache->sh->shard = ngx_slab_alloc(cache->shpool, len);
+    if (cache->sh->shard == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memzero(cache->sh->shard, len);
+
+    cache->sh->shards = cache->shards;
+
+    for (n = 0; n < cache->shards; n++) {
+        shard = &cache->sh->shard[n];
 
-    ngx_queue_init(&cache->sh->queue);
+#if (NGX_HAVE_ATOMIC_OPS)
+
+        file = NULL;
+
+#else
+
+        len = ngx_strlen(cache->shpool->mutex.name) + 1 + NGX_INT_T_LEN + 1;
+
+        file = ngx_slab_alloc(cache->shpool, len);
+        if (file == NULL) {
+            return NGX_ERROR;
+        }
+
+        (void) ngx_sprintf(file, "%s.%ui%Z", cache->shpool->mutex.name, n);
+
+#endif
+
+        if (ngx_shmtx_create(&shard->mutex, &shard->lock, file) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        ngx_rbtree_init(&shard->rbtree, &shard->sentinel,
+                        ngx_http_file_cache_rbtree_insert_value);
+
+        ngx_queue_init(&shard->queue);
+    }
 
     cache->sh->cold = 1;
     cache->sh->loading = 0;
+    cache->sh->loaded = 0;
+    cache->sh->loaders = cache->path->loaders;
     cache->sh->size = 0;
 
     cache->bsize = ngx_fs_bsize(cache->path->name.data);
@@ -144,6 +262,66 @@ ngx_http_file_cache_init(ngx_shm_zone_t *shm_zone, void *data)
     ngx_sprintf(cache->shpool->log_ctx, " in cache keys zone \"%V\"%Z",
                 &shm_zone->shm.name);
 
+    if (cache->index.len) {
+        ngx_http_file_cache_index_load(cache, shm_zone->shm.log);
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_file_cache_mem_init(ngx_shm_zone_t *shm_zone, void *data)
+{
+    ngx_http_file_cache_t  *ocache = data;
+
+    size_t                  len;
+    ngx_http_file_cache_t  *cache;
+
+    cache = shm_zone->data;
+
+    if (ocache) {
+        cache->mem_sh = ocache->mem_sh;
+        cache->mem_shpool = ocache->mem_shpool;
+
+        return NGX_OK;
+    }
+
+    cache->mem_shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    if (shm_zone->shm.exists) {
+        cache->mem_sh = cache->mem_shpool->data;
+
+        return NGX_OK;
+    }
+
+    cache->mem_sh = ngx_slab_alloc(cache->mem_shpool,
+                                   sizeof(ngx_http_file_cache_mem_sh_t));
+    if (cache->mem_sh == NULL) {
+        return NGX_ERROR;
+    }
+
+    cache->mem_shpool->data = cache->mem_sh;
+
+    ngx_rbtree_init(&cache->mem_sh->rbtree, &cache->mem_sh->sentinel,
+                    ngx_http_file_cache_mem_rbtree_insert_value);
+
+    ngx_queue_init(&cache->mem_sh->queue);
+
+    /* the zone is always full, failed allocations just evict objects */
+
+    cache->mem_shpool->log_nomem = 0;
+
+    len = sizeof(" in cache memory zone \"\"") + shm_zone->shm.name.len;
+
+    cache->mem_shpool->log_ctx = ngx_slab_alloc(cache->mem_shpool, len);
+    if (cache->mem_shpool->log_ctx == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_sprintf(cache->mem_shpool->log_ctx, " in cache memory zone \"%V\"%Z",
+                &shm_zone->shm.name);
+
     return NGX_OK;
 }
 
@@ -238,6 +416,7 @@ ngx_http_file_cache_create_key(ngx_http_request_t *r)
 ngx_int_t
 ngx_http_file_cache_open(ngx_http_request_t *r)
 {
+    size_t                     len;
     ngx_int_t                  rc, rv;
     ngx_uint_t                 cold, test;
     ngx_http_cache_t          *c;
@@ -319,6 +498,19 @@ ngx_http_file_cache_open(ngx_http_request_t *r)
         goto done;
     }
 
+    if (c->exists && cache->mem_sh) {
+
+        rc = ngx_http_file_cache_mem_get(r, c);
+
+        if (rc == NGX_OK) {
+            return ngx_http_file_cache_read(r, c);
+        }
+
+        if (rc == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+    }
+
     clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
 
     ngx_memzero(&of, sizeof(ngx_open_file_info_t));
@@ -358,7 +550,22 @@ ngx_http_file_cache_open(ngx_http_request_t *r)
     c->length = of.size;
     c->fs_size = (of.fs_size + cache->bsize - 1) / cache->bsize;
 
-    c->buf = ngx_create_temp_buf(r->pool, c->body_start);
+    len = c->body_start;
+
+    if (cache->mem_sh
+        && c->length <= (off_t) cache->max_object
+        && c->node->uses >= NGX_HTTP_FILE_CACHE_MEM_USES)
+    {
+        /* read the whole file at once to copy it to the memory zone */
+
+        c->mem_store = 1;
+
+        if ((off_t) len < c->length) {
+            len = (size_t) c->length;
+        }
+    }
+
+    c->buf = ngx_create_temp_buf(r->pool, len);
     if (c->buf == NULL) {
         return NGX_ERROR;
     }
@@ -378,23 +585,25 @@ done:
 static ngx_int_t
 ngx_http_file_cache_lock(ngx_http_request_t *r, ngx_http_cache_t *c)
 {
-    ngx_msec_t                 now, timer;
-    ngx_http_file_cache_t     *cache;
+    ngx_msec_t                    now, timer;
+    ngx_http_file_cache_t        *cache;
+    ngx_http_file_cache_shard_t  *shard;
 
     if (!c->lock) {
         return NGX_DECLINED;
     }
 
     cache = c->file_cache;
+    shard = ngx_http_file_cache_shard(cache, c->key);
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    ngx_shmtx_lock(&shard->mutex);
 
     if (!c->node->updating) {
         c->node->updating = 1;
         c->updating = 1;
     }
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_shmtx_unlock(&shard->mutex);
 
     ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                    "http file cache lock u:%d wt:%M",
@@ -429,11 +638,12 @@ ngx_http_file_cache_lock(ngx_http_request_t *r, ngx_http_cache_t *c)
 static void
 ngx_http_file_cache_lock_wait_handler(ngx_event_t *ev)
 {
-    ngx_uint_t                 wait;
-    ngx_msec_t                 timer;
-    ngx_http_cache_t          *c;
-    ngx_http_request_t        *r;
-    ngx_http_file_cache_t     *cache;
+    ngx_uint_t                    wait;
+    ngx_msec_t                    timer;
+    ngx_http_cache_t             *c;
+    ngx_http_request_t           *r;
+    ngx_http_file_cache_t        *cache;
+    ngx_http_file_cache_shard_t  *shard;
 
     r = ev->data;
     c = r->cache;
@@ -452,15 +662,16 @@ ngx_http_file_cache_lock_wait_handler(ngx_event_t *ev)
     }
 
     cache = c->file_cache;
+    shard = ngx_http_file_cache_shard(cache, c->key);
     wait = 0;
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    ngx_shmtx_lock(&shard->mutex);
 
     if (c->node->updating) {
         wait = 1;
     }
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_shmtx_unlock(&shard->mutex);
 
     if (wait) {
         ngx_add_timer(ev, (timer > 500) ? 500 : timer);
@@ -482,12 +693,18 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
     ssize_t                        n;
     ngx_int_t                      rc;
     ngx_http_file_cache_t         *cache;
+    ngx_http_file_cache_shard_t   *shard;
     ngx_http_file_cache_header_t  *h;
 
-    n = ngx_http_file_cache_aio_read(r, c);
+    if (c->mem) {
+        n = (ssize_t) c->length;
 
-    if (n < 0) {
-        return n;
+    } else {
+        n = ngx_http_file_cache_aio_read(r, c);
+
+        if (n < 0) {
+            return n;
+        }
     }
 
     if ((size_t) n < c->header_start) {
@@ -523,10 +740,11 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
     r->cached = 1;
 
     cache = c->file_cache;
+    shard = ngx_http_file_cache_shard(cache, c->key);
 
     if (cache->sh->cold) {
 
-        ngx_shmtx_lock(&cache->shpool->mutex);
+        ngx_shmtx_lock(&shard->mutex);
 
         if (!c->node->exists) {
             c->node->uses = 1;
@@ -535,17 +753,23 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
             c->node->uniq = c->uniq;
             c->node->fs_size = c->fs_size;
 
-            cache->sh->size += c->fs_size;
+            ngx_http_file_cache_size_add(cache, c->fs_size);
+
+        } else if (c->node->unverified) {
+            c->node->unverified = 0;
+            c->node->fs_size = c->fs_size;
+
+            ngx_http_file_cache_size_add(cache, c->fs_size);
         }
 
-        ngx_shmtx_unlock(&cache->shpool->mutex);
+        ngx_shmtx_unlock(&shard->mutex);
     }
 
     now = ngx_time();
 
     if (c->valid_sec < now) {
 
-        ngx_shmtx_lock(&cache->shpool->mutex);
+        ngx_shmtx_lock(&shard->mutex);
 
         if (c->node->updating) {
             rc = NGX_HTTP_CACHE_UPDATING;
@@ -556,7 +780,7 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
             rc = NGX_HTTP_CACHE_STALE;
         }
 
-        ngx_shmtx_unlock(&cache->shpool->mutex);
+        ngx_shmtx_unlock(&shard->mutex);
 
         ngx_log_debug3(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                        "http file cache expired: %i %T %T",
@@ -565,6 +789,10 @@ ngx_http_file_cache_read(ngx_http_request_t *r, ngx_http_cache_t *c)
         return rc;
     }
 
+    if (c->mem_store && (off_t) n == c->length) {
+        ngx_http_file_cache_mem_put(c, c->buf->pos, n);
+    }
+
     return NGX_OK;
 }
 
@@ -574,19 +802,37 @@ ngx_http_file_cache_aio_read(ngx_http_request_t *r, ngx_http_cache_t *c)
 {
 #if (NGX_HAVE_FILE_AIO)
     ssize_t                    n;
+#endif
+#if (NGX_HAVE_FILE_AIO || NGX_THREAD_POOL)
     ngx_http_core_loc_conf_t  *clcf;
 
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+#endif
+
+#if (NGX_THREAD_POOL)
+
+    if (clcf->aio == NGX_HTTP_AIO_THREADS) {
+        c->file.thread_handler = ngx_http_cache_thread_handler;
+        c->file.thread_ctx = r;
+
+        return ngx_thread_read(&c->thread_task, &c->file, c->buf->pos,
+                               c->buf->end - c->buf->pos, 0, r->pool);
+    }
+
+#endif
+
+#if (NGX_HAVE_FILE_AIO)
+
     if (!ngx_file_aio) {
         goto noaio;
     }
 
-    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
-
-    if (!clcf->aio) {
+    if (clcf->aio != NGX_HTTP_AIO_ON && clcf->aio != NGX_HTTP_AIO_SENDFILE) {
         goto noaio;
     }
 
-    n = ngx_file_aio_read(&c->file, c->buf->pos, c->body_start, 0, r->pool);
+    n = ngx_file_aio_read(&c->file, c->buf->pos, c->buf->end - c->buf->pos, 0,
+                          r->pool);
 
     if (n != NGX_AGAIN) {
         return n;
@@ -604,7 +850,7 @@ noaio:
 
 #endif
 
-    return ngx_read_file(&c->file, c->buf->pos, c->body_start, 0);
+    return ngx_read_file(&c->file, c->buf->pos, c->buf->end - c->buf->pos, 0);
 }
 
 
@@ -628,18 +874,78 @@ ngx_http_cache_aio_event_handler(ngx_event_t *ev)
 #endif
 
 
+#if (NGX_THREAD_POOL)
+
+static ngx_int_t
+ngx_http_cache_thread_handler(ngx_thread_task_t *task, ngx_file_t *file)
+{
+    ngx_str_t                  name;
+    ngx_thread_pool_t         *tp;
+    ngx_http_request_t        *r;
+    ngx_http_core_loc_conf_t  *clcf;
+
+    r = file->thread_ctx;
+
+    clcf = ngx_http_get_module_loc_conf(r, ngx_http_core_module);
+    tp = clcf->thread_pool;
+
+    if (tp == NULL) {
+        ngx_str_set(&name, "default");
+
+        tp = ngx_thread_pool_get((ngx_cycle_t *) ngx_cycle, &name);
+
+        if (tp == NULL) {
+            ngx_log_error(NGX_LOG_ERR, r->connection->log, 0,
+                          "thread pool \"%V\" not found", &name);
+            return NGX_ERROR;
+        }
+    }
+
+    task->event.data = r;
+    task->event.handler = ngx_http_cache_thread_event_handler;
+
+    if (ngx_thread_task_post(tp, task) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    r->main->blocked++;
+    r->aio = 1;
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_cache_thread_event_handler(ngx_event_t *ev)
+{
+    ngx_http_request_t  *r;
+
+    r = ev->data;
+
+    r->main->blocked--;
+    r->aio = 0;
+
+    r->connection->write->handler(r->connection->write);
+}
+
+#endif
+
+
 static ngx_int_t
 ngx_http_file_cache_exists(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
 {
-    ngx_int_t                    rc;
-    ngx_http_file_cache_node_t  *fcn;
+    ngx_int_t                     rc;
+    ngx_http_file_cache_node_t   *fcn;
+    ngx_http_file_cache_shard_t  *shard;
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    shard = ngx_http_file_cache_shard(cache, c->key);
+
+    ngx_shmtx_lock(&shard->mutex);
 
     fcn = c->node;
 
     if (fcn == NULL) {
-        fcn = ngx_http_file_cache_lookup(cache, c->key);
+        fcn = ngx_http_file_cache_lookup(shard, c->key);
     }
 
     if (fcn) {
@@ -678,17 +984,16 @@ ngx_http_file_cache_exists(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
         goto done;
     }
 
-    fcn = ngx_slab_alloc_locked(cache->shpool,
-                                sizeof(ngx_http_file_cache_node_t));
+    fcn = ngx_slab_alloc(cache->shpool, sizeof(ngx_http_file_cache_node_t));
     if (fcn == NULL) {
-        ngx_shmtx_unlock(&cache->shpool->mutex);
+        ngx_shmtx_unlock(&shard->mutex);
 
         (void) ngx_http_file_cache_forced_expire(cache);
 
-        ngx_shmtx_lock(&cache->shpool->mutex);
+        ngx_shmtx_lock(&shard->mutex);
 
-        fcn = ngx_slab_alloc_locked(cache->shpool,
-                                    sizeof(ngx_http_file_cache_node_t));
+        fcn = ngx_slab_alloc(cache->shpool,
+                             sizeof(ngx_http_file_cache_node_t));
         if (fcn == NULL) {
             rc = NGX_ERROR;
             goto failed;
@@ -700,7 +1005,7 @@ ngx_http_file_cache_exists(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
     ngx_memcpy(fcn->key, &c->key[sizeof(ngx_rbtree_key_t)],
                NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
 
-    ngx_rbtree_insert(&cache->sh->rbtree, &fcn->node);
+    ngx_rbtree_insert(&shard->rbtree, &fcn->node);
 
     fcn->uses = 1;
     fcn->count = 1;
@@ -714,6 +1019,7 @@ renew:
     fcn->valid_msec = 0;
     fcn->error = 0;
     fcn->exists = 0;
+    fcn->unverified = 0;
     fcn->valid_sec = 0;
     fcn->uniq = 0;
     fcn->body_start = 0;
@@ -723,7 +1029,7 @@ done:
 
     fcn->expire = ngx_time() + cache->inactive;
 
-    ngx_queue_insert_head(&cache->sh->queue, &fcn->queue);
+    ngx_queue_insert_head(&shard->queue, &fcn->queue);
 
     c->uniq = fcn->uniq;
     c->error = fcn->error;
@@ -731,7 +1037,7 @@ done:
 
 failed:
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_shmtx_unlock(&shard->mutex);
 
     return rc;
 }
@@ -772,8 +1078,55 @@ ngx_http_file_cache_name(ngx_http_request_t *r, ngx_path_t *path)
 }
 
 
+/*
+ * the cache size is updated without the shard locks: atomically
+ * if ngx_atomic_t is 64-bit, and under the slab pool mutex otherwise
+ */
+
+static void
+ngx_http_file_cache_size_add(ngx_http_file_cache_t *cache, off_t n)
+{
+#if (NGX_HTTP_FILE_CACHE_ATOMIC_SIZE)
+
+    (void) ngx_atomic_fetch_add(&cache->sh->size, (ngx_atomic_int_t) n);
+
+#else
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    cache->sh->size += n;
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+#endif
+}
+
+
+static off_t
+ngx_http_file_cache_size(ngx_http_file_cache_t *cache)
+{
+#if (NGX_HTTP_FILE_CACHE_ATOMIC_SIZE)
+
+    return (off_t) (ngx_atomic_int_t) cache->sh->size;
+
+#else
+
+    off_t  size;
+
+    ngx_shmtx_lock(&cache->shpool->mutex);
+
+    size = cache->sh->size;
+
+    ngx_shmtx_unlock(&cache->shpool->mutex);
+
+    return size;
+
+#endif
+}
+
+
 static ngx_http_file_cache_node_t *
-ngx_http_file_cache_lookup(ngx_http_file_cache_t *cache, u_char *key)
+ngx_http_file_cache_lookup(ngx_http_file_cache_shard_t *shard, u_char *key)
 {
     ngx_int_t                    rc;
     ngx_rbtree_key_t             node_key;
@@ -782,8 +1135,8 @@ ngx_http_file_cache_lookup(ngx_http_file_cache_t *cache, u_char *key)
 
     ngx_memcpy((u_char *) &node_key, key, sizeof(ngx_rbtree_key_t));
 
-    node = cache->sh->rbtree.root;
-    sentinel = cache->sh->rbtree.sentinel;
+    node = shard->rbtree.root;
+    sentinel = shard->rbtree.sentinel;
 
     while (node != sentinel) {
 
@@ -899,13 +1252,14 @@ ngx_http_file_cache_set_header(ngx_http_request_t *r, u_char *buf)
 void
 ngx_http_file_cache_update(ngx_http_request_t *r, ngx_temp_file_t *tf)
 {
-    off_t                   fs_size;
-    ngx_int_t               rc;
-    ngx_file_uniq_t         uniq;
-    ngx_file_info_t         fi;
-    ngx_http_cache_t        *c;
-    ngx_ext_rename_file_t   ext;
-    ngx_http_file_cache_t  *cache;
+    off_t                         fs_size;
+    ngx_int_t                     rc;
+    ngx_file_uniq_t               uniq;
+    ngx_file_info_t               fi;
+    ngx_http_cache_t             *c;
+    ngx_ext_rename_file_t         ext;
+    ngx_http_file_cache_t        *cache;
+    ngx_http_file_cache_shard_t  *shard;
 
     c = r->cache;
 
@@ -951,13 +1305,23 @@ ngx_http_file_cache_update(ngx_http_request_t *r, ngx_temp_file_t *tf)
         }
     }
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    shard = ngx_http_file_cache_shard(cache, c->key);
+
+    ngx_shmtx_lock(&shard->mutex);
 
     c->node->count--;
     c->node->uniq = uniq;
     c->node->body_start = c->body_start;
 
-    cache->sh->size += fs_size - c->node->fs_size;
+    if (c->node->unverified) {
+
+        /* the size of the replaced file was never counted */
+
+        c->node->unverified = 0;
+        c->node->fs_size = 0;
+    }
+
+    ngx_http_file_cache_size_add(cache, fs_size - c->node->fs_size);
     c->node->fs_size = fs_size;
 
     if (rc == NGX_OK) {
@@ -966,7 +1330,11 @@ ngx_http_file_cache_update(ngx_http_request_t *r, ngx_temp_file_t *tf)
 
     c->node->updating = 0;
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_shmtx_unlock(&shard->mutex);
+
+    if (cache->mem_sh) {
+        ngx_http_file_cache_mem_delete(cache, c->key);
+    }
 }
 
 
@@ -994,9 +1362,11 @@ ngx_http_cache_send(ngx_http_request_t *r)
         return NGX_HTTP_INTERNAL_SERVER_ERROR;
     }
 
-    b->file = ngx_pcalloc(r->pool, sizeof(ngx_file_t));
-    if (b->file == NULL) {
-        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    if (!c->mem) {
+        b->file = ngx_pcalloc(r->pool, sizeof(ngx_file_t));
+        if (b->file == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
     }
 
     rc = ngx_http_send_header(r);
@@ -1005,6 +1375,23 @@ ngx_http_cache_send(ngx_http_request_t *r)
         return rc;
     }
 
+    if (c->mem) {
+
+        /* the whole file is in c->buf */
+
+        b->pos = c->buf->pos + c->body_start;
+        b->last = c->buf->pos + c->length;
+
+        b->memory = (c->length - c->body_start) ? 1: 0;
+        b->last_buf = (r == r->main) ? 1: 0;
+        b->last_in_chain = 1;
+
+        out.buf = b;
+        out.next = NULL;
+
+        return ngx_http_output_filter(r, &out);
+    }
+
     b->file_pos = c->body_start;
     b->file_last = c->length;
 
@@ -1026,19 +1413,21 @@ ngx_http_cache_send(ngx_http_request_t *r)
 void
 ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
 {
-    ngx_http_file_cache_t       *cache;
-    ngx_http_file_cache_node_t  *fcn;
+    ngx_http_file_cache_t        *cache;
+    ngx_http_file_cache_node_t   *fcn;
+    ngx_http_file_cache_shard_t  *shard;
 
     if (c->updated || c->node == NULL) {
         return;
     }
 
     cache = c->file_cache;
+    shard = ngx_http_file_cache_shard(cache, c->key);
 
     ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->file.log, 0,
                    "http file cache free, fd: %d", c->file.fd);
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    ngx_shmtx_lock(&shard->mutex);
 
     fcn = c->node;
     fcn->count--;
@@ -1057,12 +1446,12 @@ ngx_http_file_cache_free(ngx_http_cache_t *c, ngx_temp_file_t *tf)
 
     } else if (!fcn->exists && fcn->count == 0 && c->min_uses == 1) {
         ngx_queue_remove(&fcn->queue);
-        ngx_rbtree_delete(&cache->sh->rbtree, &fcn->node);
-        ngx_slab_free_locked(cache->shpool, fcn);
+        ngx_rbtree_delete(&shard->rbtree, &fcn->node);
+        ngx_slab_free(cache->shpool, fcn);
         c->node = NULL;
     }
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_shmtx_unlock(&shard->mutex);
 
     c->updated = 1;
     c->updating = 0;
@@ -1111,17 +1500,45 @@ ngx_http_file_cache_cleanup(void *data)
 static time_t
 ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
 {
-    u_char                      *name;
-    size_t                       len;
-    time_t                       wait;
-    ngx_uint_t                   tries;
-    ngx_path_t                  *path;
-    ngx_queue_t                 *q;
-    ngx_http_file_cache_node_t  *fcn;
+    u_char                       *name;
+    size_t                        len;
+    time_t                        wait, expire;
+    ngx_uint_t                    i, tries;
+    ngx_path_t                   *path;
+    ngx_queue_t                  *q;
+    ngx_http_file_cache_node_t   *fcn;
+    ngx_http_file_cache_shard_t  *shard, *sh;
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
                    "http file cache forced expire");
 
+    /* the shard with the least recently used entry */
+
+    shard = NULL;
+    expire = 0;
+
+    for (i = 0; i < cache->sh->shards; i++) {
+        sh = &cache->sh->shard[i];
+
+        ngx_shmtx_lock(&sh->mutex);
+
+        if (!ngx_queue_empty(&sh->queue)) {
+            q = ngx_queue_last(&sh->queue);
+            fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
+
+            if (shard == NULL || fcn->expire < expire) {
+                shard = sh;
+                expire = fcn->expire;
+            }
+        }
+
+        ngx_shmtx_unlock(&sh->mutex);
+    }
+
+    if (shard == NULL) {
+        return 10;
+    }
+
     path = cache->path;
     len = path->name.len + 1 + path->len + 2 * NGX_HTTP_CACHE_KEY_LEN;
 
@@ -1135,10 +1552,10 @@ ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
     wait = 10;
     tries = 20;
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    ngx_shmtx_lock(&shard->mutex);
 
-    for (q = ngx_queue_last(&cache->sh->queue);
-         q != ngx_queue_sentinel(&cache->sh->queue);
+    for (q = ngx_queue_last(&shard->queue);
+         q != ngx_queue_sentinel(&shard->queue);
          q = ngx_queue_prev(q))
     {
         fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
@@ -1149,7 +1566,7 @@ ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
                   fcn->key[0], fcn->key[1], fcn->key[2], fcn->key[3]);
 
         if (fcn->count == 0) {
-            ngx_http_file_cache_delete(cache, q, name);
+            ngx_http_file_cache_delete(cache, shard, q, name);
             wait = 0;
 
         } else {
@@ -1163,7 +1580,7 @@ ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
         break;
     }
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_shmtx_unlock(&shard->mutex);
 
     ngx_free(name);
 
@@ -1174,13 +1591,15 @@ ngx_http_file_cache_forced_expire(ngx_http_file_cache_t *cache)
 static time_t
 ngx_http_file_cache_expire(ngx_http_file_cache_t *cache)
 {
-    u_char                      *name, *p;
-    size_t                       len;
-    time_t                       now, wait;
-    ngx_path_t                  *path;
-    ngx_queue_t                 *q;
-    ngx_http_file_cache_node_t  *fcn;
-    u_char                       key[2 * NGX_HTTP_CACHE_KEY_LEN];
+    u_char                       *name, *p;
+    size_t                        len;
+    time_t                        now, wait, next;
+    ngx_uint_t                    i;
+    ngx_path_t                   *path;
+    ngx_queue_t                  *q;
+    ngx_http_file_cache_node_t   *fcn;
+    ngx_http_file_cache_shard_t  *shard;
+    u_char                        key[2 * NGX_HTTP_CACHE_KEY_LEN];
 
     ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
                    "http file cache expire");
@@ -1196,83 +1615,98 @@ ngx_http_file_cache_expire(ngx_http_file_cache_t *cache)
     ngx_memcpy(name, path->name.data, path->name.len);
 
     now = ngx_time();
+    next = 10;
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    for (i = 0; i < cache->sh->shards; i++) {
+        shard = &cache->sh->shard[i];
 
-    for ( ;; ) {
+        ngx_shmtx_lock(&shard->mutex);
 
-        if (ngx_queue_empty(&cache->sh->queue)) {
-            wait = 10;
-            break;
-        }
+        for ( ;; ) {
 
-        q = ngx_queue_last(&cache->sh->queue);
+            if (ngx_queue_empty(&shard->queue)) {
+                wait = 10;
+                break;
+            }
 
-        fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
+            q = ngx_queue_last(&shard->queue);
 
-        wait = fcn->expire - now;
+            fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
 
-        if (wait > 0) {
-            wait = wait > 10 ? 10 : wait;
-            break;
-        }
+            wait = fcn->expire - now;
 
-        ngx_log_debug6(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
-                       "http file cache expire: #%d %d %02xd%02xd%02xd%02xd",
-                       fcn->count, fcn->exists,
-                       fcn->key[0], fcn->key[1], fcn->key[2], fcn->key[3]);
+            if (wait > 0) {
+                wait = wait > 10 ? 10 : wait;
+                break;
+            }
 
-        if (fcn->count == 0) {
-            ngx_http_file_cache_delete(cache, q, name);
-            continue;
-        }
+            ngx_log_debug6(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
+                      "http file cache expire: #%d %d %02xd%02xd%02xd%02xd",
+                      fcn->count, fcn->exists,
+                      fcn->key[0], fcn->key[1], fcn->key[2], fcn->key[3]);
 
-        if (fcn->deleting) {
-            wait = 1;
-            break;
-        }
+            if (fcn->count == 0) {
+                ngx_http_file_cache_delete(cache, shard, q, name);
+                continue;
+            }
 
-        p = ngx_hex_dump(key, (u_char *) &fcn->node.key,
-                         sizeof(ngx_rbtree_key_t));
-        len = NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t);
-        (void) ngx_hex_dump(p, fcn->key, len);
+            if (fcn->deleting) {
+                wait = 1;
+                break;
+            }
 
-        /*
-         * abnormally exited workers may leave locked cache entries,
-         * and although it may be safe to remove them completely,
-         * we prefer to just move them to the top of the inactive queue
-         */
+            p = ngx_hex_dump(key, (u_char *) &fcn->node.key,
+                             sizeof(ngx_rbtree_key_t));
+            len = NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t);
+            (void) ngx_hex_dump(p, fcn->key, len);
 
-        ngx_queue_remove(q);
-        fcn->expire = ngx_time() + cache->inactive;
-        ngx_queue_insert_head(&cache->sh->queue, &fcn->queue);
+            /*
+             * abnormally exited workers may leave locked cache entries,
+             * and although it may be safe to remove them completely,
+             * we prefer to just move them to the top of the inactive queue
+             */
+
+            ngx_queue_remove(q);
+            fcn->expire = ngx_time() + cache->inactive;
+            ngx_queue_insert_head(&shard->queue, &fcn->queue);
 
-        ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
+            ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, 0,
                       "ignore long locked inactive cache entry %*s, count:%d",
                       2 * NGX_HTTP_CACHE_KEY_LEN, key, fcn->count);
-    }
+        }
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+        ngx_shmtx_unlock(&shard->mutex);
+
+        if (wait < next) {
+            next = wait;
+        }
+    }
 
     ngx_free(name);
 
-    return wait;
+    return next;
 }
 
 
 static void
-ngx_http_file_cache_delete(ngx_http_file_cache_t *cache, ngx_queue_t *q,
-    u_char *name)
+ngx_http_file_cache_delete(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_shard_t *shard, ngx_queue_t *q, u_char *name)
 {
     u_char                      *p;
     size_t                       len;
+    ngx_err_t                    err;
+    ngx_uint_t                   unverified;
     ngx_path_t                  *path;
     ngx_http_file_cache_node_t  *fcn;
 
     fcn = ngx_queue_data(q, ngx_http_file_cache_node_t, queue);
 
     if (fcn->exists) {
-        cache->sh->size -= fcn->fs_size;
+        unverified = fcn->unverified;
+
+        if (!unverified) {
+            ngx_http_file_cache_size_add(cache, - fcn->fs_size);
+        }
 
         path = cache->path;
         p = name + path->name.len + 1 + path->len;
@@ -1284,7 +1718,7 @@ ngx_http_file_cache_delete(ngx_http_file_cache_t *cache, ngx_queue_t *q,
 
         fcn->count++;
         fcn->deleting = 1;
-        ngx_shmtx_unlock(&cache->shpool->mutex);
+        ngx_shmtx_unlock(&shard->mutex);
 
         len = path->name.len + 1 + path->len + 2 * NGX_HTTP_CACHE_KEY_LEN;
         ngx_create_hashed_filename(path, name, len);
@@ -1293,19 +1727,25 @@ ngx_http_file_cache_delete(ngx_http_file_cache_t *cache, ngx_queue_t *q,
                        "http file cache expire: \"%s\"", name);
 
         if (ngx_delete_file(name) == NGX_FILE_ERROR) {
-            ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
-                          ngx_delete_file_n " \"%s\" failed", name);
+            err = ngx_errno;
+
+            /* the file of an entry from the index may be already gone */
+
+            if (!unverified || err != NGX_ENOENT) {
+                ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, err,
+                              ngx_delete_file_n " \"%s\" failed", name);
+            }
         }
 
-        ngx_shmtx_lock(&cache->shpool->mutex);
+        ngx_shmtx_lock(&shard->mutex);
         fcn->count--;
         fcn->deleting = 0;
     }
 
     if (fcn->count == 0) {
         ngx_queue_remove(q);
-        ngx_rbtree_delete(&cache->sh->rbtree, &fcn->node);
-        ngx_slab_free_locked(cache->shpool, fcn);
+        ngx_rbtree_delete(&shard->rbtree, &fcn->node);
+        ngx_slab_free(cache->shpool, fcn);
     }
 }
 
@@ -1316,19 +1756,36 @@ ngx_http_file_cache_manager(void *data)
     ngx_http_file_cache_t  *cache = data;
 
     off_t   size;
-    time_t  next, wait;
+    time_t  now, next, wait;
 
     next = ngx_http_file_cache_expire(cache);
 
+    if (cache->index_interval && !cache->sh->cold) {
+        now = ngx_time();
+
+        if (cache->index_time == 0) {
+            cache->index_time = now;
+        }
+
+        wait = cache->index_time + cache->index_interval - now;
+
+        if (wait <= 0) {
+            ngx_http_file_cache_index_save(cache);
+
+            ngx_time_update();
+
+            cache->index_time = ngx_time();
+            wait = cache->index_interval;
+        }
+
+        next = (wait < next) ? wait : next;
+    }
+
     cache->last = ngx_current_msec;
     cache->files = 0;
 
     for ( ;; ) {
-        ngx_shmtx_lock(&cache->shpool->mutex);
-
-        size = cache->sh->size;
-
-        ngx_shmtx_unlock(&cache->shpool->mutex);
+        size = ngx_http_file_cache_size(cache);
 
         ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
                        "http file cache size: %O", size);
@@ -1355,22 +1812,29 @@ ngx_http_file_cache_loader(void *data)
 {
     ngx_http_file_cache_t  *cache = data;
 
-    ngx_tree_ctx_t  tree;
+    ngx_tree_ctx_t      tree;
+    ngx_atomic_uint_t   bit, all;
 
-    if (!cache->sh->cold || cache->sh->loading) {
+    /* ngx_worker is the number of this loader process */
+
+    if (ngx_worker >= cache->path->loaders) {
         return;
     }
 
-    if (!ngx_atomic_cmp_set(&cache->sh->loading, 0, ngx_pid)) {
+    bit = (ngx_atomic_uint_t) 1 << ngx_worker;
+
+    if (!cache->sh->cold || (cache->sh->loaded & bit)) {
         return;
     }
 
-    ngx_log_debug0(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
-                   "http file cache loader");
+    (void) ngx_atomic_fetch_add(&cache->sh->loading, 1);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
+                   "http file cache loader #%ui", ngx_worker);
 
     tree.init_handler = NULL;
     tree.file_handler = ngx_http_file_cache_manage_file;
-    tree.pre_tree_handler = ngx_http_file_cache_noop;
+    tree.pre_tree_handler = ngx_http_file_cache_loader_dir;
     tree.post_tree_handler = ngx_http_file_cache_noop;
     tree.spec_handler = ngx_http_file_cache_delete_file;
     tree.data = cache;
@@ -1381,18 +1845,29 @@ ngx_http_file_cache_loader(void *data)
     cache->files = 0;
 
     if (ngx_walk_tree(&tree, &cache->path->name) == NGX_ABORT) {
-        cache->sh->loading = 0;
+        (void) ngx_atomic_fetch_add(&cache->sh->loading, -1);
         return;
     }
 
-    cache->sh->cold = 0;
-    cache->sh->loading = 0;
+    all = ((ngx_atomic_uint_t) 1 << cache->path->loaders) - 1;
+
+    if ((ngx_atomic_fetch_add(&cache->sh->loaded, bit) | bit) == all) {
 
-    ngx_log_error(NGX_LOG_NOTICE, ngx_cycle->log, 0,
-                  "http file cache: %V %.3fM, bsize: %uz",
-                  &cache->path->name,
-                  ((double) cache->sh->size * cache->bsize) / (1024 * 1024),
-                  cache->bsize);
+        if (cache->index.len) {
+            ngx_http_file_cache_index_sweep(cache);
+        }
+
+        cache->sh->cold = 0;
+
+        ngx_log_error(NGX_LOG_NOTICE, ngx_cycle->log, 0,
+                      "http file cache: %V %.3fM, bsize: %uz",
+                      &cache->path->name,
+                      ((double) ngx_http_file_cache_size(cache) * cache->bsize)
+                      / (1024 * 1024),
+                      cache->bsize);
+    }
+
+    (void) ngx_atomic_fetch_add(&cache->sh->loading, -1);
 }
 
 
@@ -1403,14 +1878,65 @@ ngx_http_file_cache_noop(ngx_tree_ctx_t *ctx, ngx_str_t *path)
 }
 
 
+static ngx_int_t
+ngx_http_file_cache_loader_dir(ngx_tree_ctx_t *ctx, ngx_str_t *path)
+{
+    size_t                  len;
+    ngx_int_t               n;
+    ngx_http_file_cache_t  *cache;
+
+    cache = ctx->data;
+
+    if (cache->path->loaders == 1) {
+        return NGX_OK;
+    }
+
+    /* the first level directories are spread among the loaders */
+
+    len = cache->path->level[0];
+
+    if (path->len != cache->path->name.len + 1 + len) {
+        return NGX_OK;
+    }
+
+    n = ngx_hextoi(path->data + path->len - len, len);
+
+    if (n == NGX_ERROR) {
+        n = 0;
+    }
+
+    return ((ngx_uint_t) n % cache->path->loaders == ngx_worker)
+           ? NGX_OK : NGX_DECLINED;
+}
+
+
 static ngx_int_t
 ngx_http_file_cache_manage_file(ngx_tree_ctx_t *ctx, ngx_str_t *path)
 {
+    u_char                 *p;
     ngx_msec_t              elapsed;
     ngx_http_file_cache_t  *cache;
 
     cache = ctx->data;
 
+    if (cache->index.len
+        && path->len >= cache->index.len
+        && ngx_strncmp(path->data, cache->index.data, cache->index.len) == 0)
+    {
+        return NGX_OK;
+    }
+
+    if (ngx_worker) {
+
+        /* the files in the cache directory itself belong to the first loader */
+
+        p = path->data + cache->path->name.len + 1;
+
+        if (ngx_strlchr(p, path->data + path->len, '/') == NULL) {
+            return NGX_OK;
+        }
+    }
+
     if (ngx_http_file_cache_add_file(ctx, path) != NGX_OK) {
         (void) ngx_http_file_cache_delete_file(ctx, path);
     }
@@ -1486,25 +2012,34 @@ ngx_http_file_cache_add_file(ngx_tree_ctx_t *ctx, ngx_str_t *name)
         c.key[i] = (u_char) n;
     }
 
-    return ngx_http_file_cache_add(cache, &c);
+    return ngx_http_file_cache_add(cache, &c, 0);
 }
 
 
+/*
+ * the entries loaded from the index are not counted in the cache size
+ * till their files are found by the loader, a request or an update
+ */
+
 static ngx_int_t
-ngx_http_file_cache_add(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
+ngx_http_file_cache_add(ngx_http_file_cache_t *cache, ngx_http_cache_t *c,
+    ngx_uint_t unverified)
 {
-    ngx_http_file_cache_node_t  *fcn;
+    ngx_http_file_cache_node_t   *fcn;
+    ngx_http_file_cache_shard_t  *shard;
 
-    ngx_shmtx_lock(&cache->shpool->mutex);
+    shard = ngx_http_file_cache_shard(cache, c->key);
 
-    fcn = ngx_http_file_cache_lookup(cache, c->key);
+    ngx_shmtx_lock(&shard->mutex);
+
+    fcn = ngx_http_file_cache_lookup(shard, c->key);
 
     if (fcn == NULL) {
 
-        fcn = ngx_slab_alloc_locked(cache->shpool,
-                                    sizeof(ngx_http_file_cache_node_t));
+        fcn = ngx_slab_alloc(cache->shpool,
+                             sizeof(ngx_http_file_cache_node_t));
         if (fcn == NULL) {
-            ngx_shmtx_unlock(&cache->shpool->mutex);
+            ngx_shmtx_unlock(&shard->mutex);
             return NGX_ERROR;
         }
 
@@ -1513,7 +2048,7 @@ ngx_http_file_cache_add(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
         ngx_memcpy(fcn->key, &c->key[sizeof(ngx_rbtree_key_t)],
                    NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
 
-        ngx_rbtree_insert(&cache->sh->rbtree, &fcn->node);
+        ngx_rbtree_insert(&shard->rbtree, &fcn->node);
 
         fcn->uses = 1;
         fcn->count = 0;
@@ -1522,27 +2057,683 @@ ngx_http_file_cache_add(ngx_http_file_cache_t *cache, ngx_http_cache_t *c)
         fcn->exists = 1;
         fcn->updating = 0;
         fcn->deleting = 0;
+        fcn->unverified = unverified;
         fcn->uniq = 0;
         fcn->valid_sec = 0;
         fcn->body_start = 0;
         fcn->fs_size = c->fs_size;
 
-        cache->sh->size += c->fs_size;
+        if (!unverified) {
+            ngx_http_file_cache_size_add(cache, c->fs_size);
+        }
 
     } else {
         ngx_queue_remove(&fcn->queue);
+
+        if (fcn->unverified && !unverified) {
+            fcn->unverified = 0;
+            fcn->fs_size = c->fs_size;
+
+            ngx_http_file_cache_size_add(cache, c->fs_size);
+        }
     }
 
     fcn->expire = ngx_time() + cache->inactive;
 
-    ngx_queue_insert_head(&cache->sh->queue, &fcn->queue);
+    ngx_queue_insert_head(&shard->queue, &fcn->queue);
 
-    ngx_shmtx_unlock(&cache->shpool->mutex);
+    ngx_shmtx_unlock(&shard->mutex);
 
     return NGX_OK;
 }
 
 
+static ngx_int_t
+ngx_http_file_cache_mem_get(ngx_http_request_t *r, ngx_http_cache_t *c)
+{
+    size_t                           len;
+    ngx_buf_t                       *b;
+    ngx_file_uniq_t                  uniq;
+    ngx_http_file_cache_t           *cache;
+    ngx_http_file_cache_mem_node_t  *mn;
+
+    cache = c->file_cache;
+
+    ngx_shmtx_lock(&cache->mem_shpool->mutex);
+
+    mn = ngx_http_file_cache_mem_lookup(cache, c->key);
+
+    if (mn == NULL) {
+        ngx_shmtx_unlock(&cache->mem_shpool->mutex);
+        return NGX_DECLINED;
+    }
+
+    if (c->uniq && mn->uniq != c->uniq) {
+
+        /* the file was replaced */
+
+        ngx_http_file_cache_mem_free_locked(cache, mn);
+
+        ngx_shmtx_unlock(&cache->mem_shpool->mutex);
+        return NGX_DECLINED;
+    }
+
+    /*
+     * the node is pinned while the data are copied without the lock,
+     * the node removed meanwhile is freed by the last reader
+     */
+
+    mn->count++;
+    uniq = mn->uniq;
+    len = mn->len;
+
+    ngx_queue_remove(&mn->queue);
+    ngx_queue_insert_head(&cache->mem_sh->queue, &mn->queue);
+
+    ngx_shmtx_unlock(&cache->mem_shpool->mutex);
+
+    b = ngx_create_temp_buf(r->pool, len);
+
+    if (b) {
+        ngx_memcpy(b->pos, mn->data, len);
+    }
+
+    ngx_shmtx_lock(&cache->mem_shpool->mutex);
+
+    mn->count--;
+
+    if (mn->count == 0 && mn->deleted) {
+        ngx_slab_free_locked(cache->mem_shpool, mn);
+    }
+
+    ngx_shmtx_unlock(&cache->mem_shpool->mutex);
+
+    if (b == NULL) {
+        return NGX_ERROR;
+    }
+
+    c->buf = b;
+    c->uniq = uniq;
+    c->length = len;
+    c->fs_size = (len + cache->bsize - 1) / cache->bsize;
+    c->mem = 1;
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
+                   "http file cache memory hit: %O", c->length);
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_file_cache_mem_put(ngx_http_cache_t *c, u_char *data, size_t len)
+{
+    size_t                           size;
+    ngx_uint_t                       tries;
+    ngx_queue_t                     *q;
+    ngx_http_file_cache_t           *cache;
+    ngx_http_file_cache_mem_node_t  *mn, *old;
+
+    cache = c->file_cache;
+
+    size = offsetof(ngx_http_file_cache_mem_node_t, data) + len;
+
+    ngx_shmtx_lock(&cache->mem_shpool->mutex);
+
+    old = ngx_http_file_cache_mem_lookup(cache, c->key);
+
+    if (old) {
+
+        if (old->uniq == c->uniq && old->len == len) {
+            ngx_queue_remove(&old->queue);
+            ngx_queue_insert_head(&cache->mem_sh->queue, &old->queue);
+            ngx_shmtx_unlock(&cache->mem_shpool->mutex);
+            return;
+        }
+
+        ngx_http_file_cache_mem_free_locked(cache, old);
+    }
+
+    for (tries = 0; /* void */ ; tries++) {
+
+        mn = ngx_slab_alloc_locked(cache->mem_shpool, size);
+
+        if (mn) {
+            break;
+        }
+
+        if (tries == NGX_HTTP_FILE_CACHE_MEM_TRIES
+            || ngx_queue_empty(&cache->mem_sh->queue))
+        {
+            ngx_shmtx_unlock(&cache->mem_shpool->mutex);
+            return;
+        }
+
+        /* evict the least recently used object */
+
+        q = ngx_queue_last(&cache->mem_sh->queue);
+        old = ngx_queue_data(q, ngx_http_file_cache_mem_node_t, queue);
+
+        ngx_http_file_cache_mem_free_locked(cache, old);
+    }
+
+    ngx_memcpy((u_char *) &mn->node.key, c->key, sizeof(ngx_rbtree_key_t));
+
+    ngx_memcpy(mn->key, &c->key[sizeof(ngx_rbtree_key_t)],
+               NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+    mn->uniq = c->uniq;
+    mn->len = len;
+    mn->count = 0;
+    mn->deleted = 0;
+
+    ngx_memcpy(mn->data, data, len);
+
+    ngx_rbtree_insert(&cache->mem_sh->rbtree, &mn->node);
+    ngx_queue_insert_head(&cache->mem_sh->queue, &mn->queue);
+
+    ngx_shmtx_unlock(&cache->mem_shpool->mutex);
+
+    ngx_log_debug1(NGX_LOG_DEBUG_HTTP, c->file.log, 0,
+                   "http file cache memory store: %uz", len);
+}
+
+
+static void
+ngx_http_file_cache_mem_delete(ngx_http_file_cache_t *cache, u_char *key)
+{
+    ngx_http_file_cache_mem_node_t  *mn;
+
+    ngx_shmtx_lock(&cache->mem_shpool->mutex);
+
+    mn = ngx_http_file_cache_mem_lookup(cache, key);
+
+    if (mn) {
+        ngx_http_file_cache_mem_free_locked(cache, mn);
+    }
+
+    ngx_shmtx_unlock(&cache->mem_shpool->mutex);
+}
+
+
+static void
+ngx_http_file_cache_mem_free_locked(ngx_http_file_cache_t *cache,
+    ngx_http_file_cache_mem_node_t *mn)
+{
+    ngx_queue_remove(&mn->queue);
+    ngx_rbtree_delete(&cache->mem_sh->rbtree, &mn->node);
+
+    if (mn->count) {
+        mn->deleted = 1;
+        return;
+    }
+
+    ngx_slab_free_locked(cache->mem_shpool, mn);
+}
+
+
+static ngx_http_file_cache_mem_node_t *
+ngx_http_file_cache_mem_lookup(ngx_http_file_cache_t *cache, u_char *key)
+{
+    ngx_int_t                        rc;
+    ngx_rbtree_key_t                 node_key;
+    ngx_rbtree_node_t               *node, *sentinel;
+    ngx_http_file_cache_mem_node_t  *mn;
+
+    ngx_memcpy((u_char *) &node_key, key, sizeof(ngx_rbtree_key_t));
+
+    node = cache->mem_sh->rbtree.root;
+    sentinel = cache->mem_sh->rbtree.sentinel;
+
+    while (node != sentinel) {
+
+        if (node_key < node->key) {
+            node = node->left;
+            continue;
+        }
+
+        if (node_key > node->key) {
+            node = node->right;
+            continue;
+        }
+
+        /* node_key == node->key */
+
+        mn = (ngx_http_file_cache_mem_node_t *) node;
+
+        rc = ngx_memcmp(&key[sizeof(ngx_rbtree_key_t)], mn->key,
+                        NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+        if (rc == 0) {
+            return mn;
+        }
+
+        node = (rc < 0) ? node->left : node->right;
+    }
+
+    /* not found */
+
+    return NULL;
+}
+
+
+static void
+ngx_http_file_cache_mem_rbtree_insert_value(ngx_rbtree_node_t *temp,
+    ngx_rbtree_node_t *node, ngx_rbtree_node_t *sentinel)
+{
+    ngx_rbtree_node_t               **p;
+    ngx_http_file_cache_mem_node_t   *mn, *mnt;
+
+    for ( ;; ) {
+
+        if (node->key < temp->key) {
+
+            p = &temp->left;
+
+        } else if (node->key > temp->key) {
+
+            p = &temp->right;
+
+        } else { /* node->key == temp->key */
+
+            mn = (ngx_http_file_cache_mem_node_t *) node;
+            mnt = (ngx_http_file_cache_mem_node_t *) temp;
+
+            p = (ngx_memcmp(mn->key, mnt->key,
+                            NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t))
+                 < 0)
+                    ? &temp->left : &temp->right;
+        }
+
+        if (*p == sentinel) {
+            break;
+        }
+
+        temp = *p;
+    }
+
+    *p = node;
+    node->parent = temp;
+    node->left = sentinel;
+    node->right = sentinel;
+    ngx_rbt_red(node);
+}
+
+
+static void
+ngx_http_file_cache_index_load(ngx_http_file_cache_t *cache, ngx_log_t *log)
+{
+    size_t                               size;
+    ssize_t                              n;
+    ngx_fd_t                             fd;
+    ngx_err_t                            err;
+    ngx_uint_t                           i, loaded;
+    ngx_file_info_t                      fi;
+    ngx_http_cache_t                     c;
+    ngx_http_file_cache_index_entry_t   *entry;
+    ngx_http_file_cache_index_header_t   h;
+
+    fd = ngx_open_file(cache->index.data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+
+    if (fd == NGX_INVALID_FILE) {
+        err = ngx_errno;
+
+        if (err != NGX_ENOENT) {
+            ngx_log_error(NGX_LOG_CRIT, log, err,
+                          ngx_open_file_n " \"%s\" failed",
+                          cache->index.data);
+        }
+
+        return;
+    }
+
+    entry = NULL;
+    loaded = 0;
+
+    if (ngx_fd_info(fd, &fi) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                      ngx_fd_info_n " \"%s\" failed", cache->index.data);
+        goto done;
+    }
+
+    n = ngx_read_fd(fd, &h, sizeof(ngx_http_file_cache_index_header_t));
+
+    if (n != sizeof(ngx_http_file_cache_index_header_t)
+        || h.magic != NGX_HTTP_FILE_CACHE_INDEX_MAGIC
+        || h.entry_size != sizeof(ngx_http_file_cache_index_entry_t)
+        || h.bsize != cache->bsize
+        || ngx_file_size(&fi) != (off_t) (sizeof(h) + h.entries * h.entry_size))
+    {
+        ngx_log_error(NGX_LOG_WARN, log, 0,
+                      "cache index \"%s\" is invalid, ignored",
+                      cache->index.data);
+        goto done;
+    }
+
+    size = NGX_HTTP_FILE_CACHE_INDEX_CHUNK
+           * sizeof(ngx_http_file_cache_index_entry_t);
+
+    entry = ngx_alloc(size, log);
+    if (entry == NULL) {
+        goto done;
+    }
+
+    ngx_memzero(&c, sizeof(ngx_http_cache_t));
+
+    while (loaded < h.entries) {
+
+        n = ngx_read_fd(fd, entry, size);
+
+        if (n <= 0) {
+            ngx_log_error(NGX_LOG_CRIT, log, ngx_errno,
+                          ngx_read_fd_n " \"%s\" failed", cache->index.data);
+            goto done;
+        }
+
+        n /= sizeof(ngx_http_file_cache_index_entry_t);
+
+        for (i = 0; i < (ngx_uint_t) n; i++) {
+            ngx_memcpy(c.key, entry[i].key, NGX_HTTP_CACHE_KEY_LEN);
+            c.fs_size = entry[i].fs_size;
+
+            if (ngx_http_file_cache_add(cache, &c, 1) != NGX_OK) {
+                goto done;
+            }
+
+            loaded++;
+        }
+    }
+
+done:
+
+    ngx_log_error(NGX_LOG_NOTICE, log, 0,
+                  "http file cache: %V %ui entries loaded from index",
+                  &cache->path->name, loaded);
+
+    if (entry) {
+        ngx_free(entry);
+    }
+
+    if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed", cache->index.data);
+    }
+}
+
+
+static void
+ngx_http_file_cache_index_save(ngx_http_file_cache_t *cache)
+{
+    u_char                              *temp;
+    off_t                                offset;
+    size_t                               size;
+    ngx_uint_t                           i, n, first;
+    ngx_file_t                           file;
+    ngx_pool_t                          *pool;
+    ngx_array_t                          entries;
+    ngx_http_file_cache_node_t          *fcn;
+    ngx_http_file_cache_shard_t         *shard;
+    ngx_http_file_cache_index_entry_t   *entry;
+    ngx_http_file_cache_index_header_t   h;
+    u_char                               key[NGX_HTTP_CACHE_KEY_LEN];
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, ngx_cycle->log);
+    if (pool == NULL) {
+        return;
+    }
+
+    if (ngx_array_init(&entries, pool, NGX_HTTP_FILE_CACHE_INDEX_CHUNK,
+                       sizeof(ngx_http_file_cache_index_entry_t))
+        != NGX_OK)
+    {
+        goto failed;
+    }
+
+    temp = ngx_pnalloc(pool, cache->index.len + sizeof(".tmp"));
+    if (temp == NULL) {
+        goto failed;
+    }
+
+    ngx_sprintf(temp, "%V.tmp%Z", &cache->index);
+
+    ngx_memzero(&file, sizeof(ngx_file_t));
+
+    file.name.data = temp;
+    file.name.len = cache->index.len + sizeof(".tmp") - 1;
+    file.log = ngx_cycle->log;
+
+    file.fd = ngx_open_file(temp, NGX_FILE_WRONLY, NGX_FILE_TRUNCATE,
+                            NGX_FILE_DEFAULT_ACCESS);
+
+    if (file.fd == NGX_INVALID_FILE) {
+        ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                      ngx_open_file_n " \"%s\" failed", temp);
+        goto failed;
+    }
+
+    offset = sizeof(ngx_http_file_cache_index_header_t);
+
+    h.magic = NGX_HTTP_FILE_CACHE_INDEX_MAGIC;
+    h.entry_size = sizeof(ngx_http_file_cache_index_entry_t);
+    h.bsize = cache->bsize;
+    h.entries = 0;
+
+    /*
+     * the entries are copied in batches under the shard lock
+     * and are written without it, see ngx_http_file_cache_index_next()
+     */
+
+    for (i = 0; i < cache->sh->shards; i++) {
+        shard = &cache->sh->shard[i];
+
+        first = 1;
+
+        do {
+            entries.nelts = 0;
+
+            ngx_shmtx_lock(&shard->mutex);
+
+            for (n = 0; n < NGX_HTTP_FILE_CACHE_INDEX_CHUNK; n++) {
+
+                fcn = ngx_http_file_cache_index_next(shard, key, first);
+                if (fcn == NULL) {
+                    break;
+                }
+
+                first = 0;
+
+                ngx_memcpy(key, &fcn->node.key, sizeof(ngx_rbtree_key_t));
+                ngx_memcpy(&key[sizeof(ngx_rbtree_key_t)], fcn->key,
+                           NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+                if (!fcn->exists || fcn->deleting || fcn->unverified) {
+                    continue;
+                }
+
+                entry = ngx_array_push(&entries);
+                if (entry == NULL) {
+                    ngx_shmtx_unlock(&shard->mutex);
+                    goto close;
+                }
+
+                ngx_memcpy(entry->key, key, NGX_HTTP_CACHE_KEY_LEN);
+                entry->fs_size = fcn->fs_size;
+            }
+
+            ngx_shmtx_unlock(&shard->mutex);
+
+            if (entries.nelts == 0) {
+                continue;
+            }
+
+            size = entries.nelts * sizeof(ngx_http_file_cache_index_entry_t);
+
+            if (ngx_write_file(&file, entries.elts, size, offset)
+                == NGX_ERROR)
+            {
+                goto close;
+            }
+
+            offset += size;
+            h.entries += entries.nelts;
+
+        } while (n == NGX_HTTP_FILE_CACHE_INDEX_CHUNK);
+    }
+
+    if (ngx_write_file(&file, (u_char *) &h, sizeof(h), 0) == NGX_ERROR) {
+        goto close;
+    }
+
+    if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed", temp);
+    }
+
+    if (ngx_rename_file(temp, cache->index.data) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                      ngx_rename_file_n " \"%s\" to \"%s\" failed",
+                      temp, cache->index.data);
+        goto delete;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, ngx_cycle->log, 0,
+                   "http file cache index: %ui entries, \"%s\"",
+                   h.entries, cache->index.data);
+
+    ngx_destroy_pool(pool);
+
+    return;
+
+close:
+
+    if (ngx_close_file(file.fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, ngx_cycle->log, ngx_errno,
+                      ngx_close_file_n " \"%s\" failed", temp);
+    }
+
+delete:
+
+    if (ngx_delete_file(temp) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_CRIT, ngx_cycle->log, ngx_errno,
+                      ngx_delete_file_n " \"%s\" failed", temp);
+    }
+
+failed:
+
+    ngx_destroy_pool(pool);
+}
+
+
+/*
+ * the entries loaded from the index whose files have not been found
+ * by the loaders are removed when the loading is finished
+ */
+
+static void
+ngx_http_file_cache_index_sweep(ngx_http_file_cache_t *cache)
+{
+    ngx_uint_t                    i, n, first, removed;
+    ngx_http_file_cache_node_t   *fcn;
+    ngx_http_file_cache_shard_t  *shard;
+    u_char                        key[NGX_HTTP_CACHE_KEY_LEN];
+
+    removed = 0;
+
+    for (i = 0; i < cache->sh->shards; i++) {
+        shard = &cache->sh->shard[i];
+
+        first = 1;
+
+        do {
+            ngx_shmtx_lock(&shard->mutex);
+
+            for (n = 0; n < NGX_HTTP_FILE_CACHE_INDEX_CHUNK; n++) {
+
+                fcn = ngx_http_file_cache_index_next(shard, key, first);
+                if (fcn == NULL) {
+                    break;
+                }
+
+                first = 0;
+
+                ngx_memcpy(key, &fcn->node.key, sizeof(ngx_rbtree_key_t));
+                ngx_memcpy(&key[sizeof(ngx_rbtree_key_t)], fcn->key,
+                           NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+
+                if (!fcn->unverified || fcn->count) {
+                    continue;
+                }
+
+                ngx_queue_remove(&fcn->queue);
+                ngx_rbtree_delete(&shard->rbtree, &fcn->node);
+                ngx_slab_free(cache->shpool, fcn);
+
+                removed++;
+            }
+
+            ngx_shmtx_unlock(&shard->mutex);
+
+        } while (n == NGX_HTTP_FILE_CACHE_INDEX_CHUNK);
+    }
+
+    if (removed) {
+        ngx_log_error(NGX_LOG_NOTICE, ngx_cycle->log, 0,
+                      "http file cache: %V %ui entries of index not found",
+                      &cache->path->name, removed);
+    }
+}
+
+
+/*
+ * the shard lock may be released between the calls, so the walk
+ * is resumed in the rbtree order from the key of the last node seen
+ * and not from the node itself that may be already freed
+ */
+
+static ngx_http_file_cache_node_t *
+ngx_http_file_cache_index_next(ngx_http_file_cache_shard_t *shard, u_char *key,
+    ngx_uint_t first)
+{
+    ngx_int_t                    rc;
+    ngx_rbtree_key_t             node_key;
+    ngx_rbtree_node_t           *node, *sentinel;
+    ngx_http_file_cache_node_t  *fcn, *next;
+
+    ngx_memcpy((u_char *) &node_key, key, sizeof(ngx_rbtree_key_t));
+
+    node = shard->rbtree.root;
+    sentinel = shard->rbtree.sentinel;
+
+    next = NULL;
+
+    while (node != sentinel) {
+
+        fcn = (ngx_http_file_cache_node_t *) node;
+
+        if (first) {
+            rc = 1;
+
+        } else if (node->key != node_key) {
+            rc = (node->key > node_key) ? 1 : -1;
+
+        } else {
+            rc = ngx_memcmp(fcn->key, &key[sizeof(ngx_rbtree_key_t)],
+                            NGX_HTTP_CACHE_KEY_LEN - sizeof(ngx_rbtree_key_t));
+        }
+
+        if (rc > 0) {
+            next = fcn;
+            node = node->left;
+
+        } else {
+            node = node->right;
+        }
+    }
+
+    return next;
+}
+
+
 static ngx_int_t
 ngx_http_file_cache_delete_file(ngx_tree_ctx_t *ctx, ngx_str_t *path)
 {
@@ -1589,10 +2780,10 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
 {
     off_t                   max_size;
     u_char                 *last, *p;
-    time_t                  inactive;
-    ssize_t                 size;
-    ngx_str_t               s, name, *value;
-    ngx_int_t               loader_files;
+    time_t                  inactive, index_interval;
+    ssize_t                 size, mem_size, max_object;
+    ngx_str_t               s, name, mem_name, *value;
+    ngx_int_t               loader_files, loaders, shards;
     ngx_msec_t              loader_sleep, loader_threshold;
     ngx_uint_t              i, n;
     ngx_http_file_cache_t  *cache;
@@ -1611,11 +2802,18 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     loader_files = 100;
     loader_sleep = 50;
     loader_threshold = 200;
+    loaders = 1;
+    shards = 1;
+    index_interval = 0;
 
     name.len = 0;
     size = 0;
     max_size = NGX_MAX_OFF_T_VALUE;
 
+    mem_name.len = 0;
+    mem_size = 0;
+    max_object = 64 * 1024;
+
     value = cf->args->elts;
 
     cache->path->name = value[1];
@@ -1692,6 +2890,47 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             return NGX_CONF_ERROR;
         }
 
+        if (ngx_strncmp(value[i].data, "mem_zone=", 9) == 0) {
+
+            mem_name.data = value[i].data + 9;
+
+            p = (u_char *) ngx_strchr(mem_name.data, ':');
+
+            if (p) {
+                mem_name.len = p - mem_name.data;
+
+                p++;
+
+                s.len = value[i].data + value[i].len - p;
+                s.data = p;
+
+                mem_size = ngx_parse_size(&s);
+                if (mem_size > 8191) {
+                    continue;
+                }
+            }
+
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "invalid memory zone size \"%V\"", &value[i]);
+            return NGX_CONF_ERROR;
+        }
+
+        if (ngx_strncmp(value[i].data, "max_object=", 11) == 0) {
+
+            s.len = value[i].len - 11;
+            s.data = value[i].data + 11;
+
+            max_object = ngx_parse_size(&s);
+            if (max_object == NGX_ERROR) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid max_object value \"%V\"",
+                                   &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
         if (ngx_strncmp(value[i].data, "inactive=", 9) == 0) {
 
             s.len = value[i].len - 9;
@@ -1764,6 +3003,45 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
             continue;
         }
 
+        if (ngx_strncmp(value[i].data, "loaders=", 8) == 0) {
+
+            loaders = ngx_atoi(value[i].data + 8, value[i].len - 8);
+            if (loaders < 1 || loaders > 16) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid loaders value \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "index_interval=", 15) == 0) {
+
+            s.len = value[i].len - 15;
+            s.data = value[i].data + 15;
+
+            index_interval = ngx_parse_time(&s, 1);
+            if (index_interval == (time_t) NGX_ERROR) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "invalid index_interval value \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "shards=", 7) == 0) {
+
+            shards = ngx_atoi(value[i].data + 7, value[i].len - 7);
+            if (shards < 1 || shards > 256) {
+                ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                                   "invalid shards value \"%V\"", &value[i]);
+                return NGX_CONF_ERROR;
+            }
+
+            continue;
+        }
+
         ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
                            "invalid parameter \"%V\"", &value[i]);
         return NGX_CONF_ERROR;
@@ -1784,6 +3062,21 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     cache->loader_files = loader_files;
     cache->loader_sleep = loader_sleep;
     cache->loader_threshold = loader_threshold;
+    cache->path->loaders = loaders;
+    cache->shards = shards;
+
+    if (index_interval) {
+        cache->index.len = cache->path->name.len + sizeof("/cache.index") - 1;
+        cache->index.data = ngx_pnalloc(cf->pool, cache->index.len + 1);
+        if (cache->index.data == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        ngx_sprintf(cache->index.data, "%V/cache.index%Z",
+                    &cache->path->name);
+
+        cache->index_interval = index_interval;
+    }
 
     if (ngx_add_path(cf, &cache->path) != NGX_OK) {
         return NGX_CONF_ERROR;
@@ -1804,6 +3097,25 @@ ngx_http_file_cache_set_slot(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
     cache->shm_zone->init = ngx_http_file_cache_init;
     cache->shm_zone->data = cache;
 
+    if (mem_name.len) {
+        cache->mem_zone = ngx_shared_memory_add(cf, &mem_name, mem_size,
+                                                cmd->post);
+        if (cache->mem_zone == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        if (cache->mem_zone->data) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "duplicate zone \"%V\"", &mem_name);
+            return NGX_CONF_ERROR;
+        }
+
+        cache->mem_zone->init = ngx_http_file_cache_mem_init;
+        cache->mem_zone->data = cache;
+    }
+
+    cache->max_object = max_object;
+
     cache->inactive = inactive;
     cache->max_size = max_size;
 
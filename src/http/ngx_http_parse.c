@@ -9,6 +9,16 @@
 #include <ngx_core.h>
 #include <ngx_http.h>
 
+#if (NGX_HAVE_SSE2)
+#include <emmintrin.h>
+#endif
+
+
+#if (NGX_HAVE_SSE2)
+static ngx_inline u_char *ngx_http_parse_skip_value(u_char *p, u_char *last);
+static ngx_inline size_t ngx_http_parse_usual_len(u_char *p, u_char *last);
+#endif
+
 
 static uint32_t  usual[] = {
     0xffffdbfe, /* 1111 1111 1111 1111  1101 1011 1111 1110 */
@@ -982,6 +992,14 @@ ngx_http_parse_header_line(ngx_http_request_t *r, ngx_buf_t *b,
 
         /* header value */
         case sw_value:
+
+#if (NGX_HAVE_SSE2)
+            if (b->last - p > 16) {
+                p = ngx_http_parse_skip_value(p, b->last);
+                ch = *p;
+            }
+#endif
+
             switch (ch) {
             case ' ':
                 r->header_end = p;
@@ -1076,6 +1094,102 @@ header_done:
 }
 
 
+#if (NGX_HAVE_SSE2)
+
+/*
+ * skips the header value 16 bytes at a time up to the first CR, LF or '\0',
+ * the trailing spaces and the bytes left are passed to the state machine;
+ * at least one byte after p is always left so p stays inside the buffer
+ */
+
+static ngx_inline u_char *
+ngx_http_parse_skip_value(u_char *p, u_char *last)
+{
+    int       mask;
+    u_char   *start;
+    __m128i   v, cr, lf, zero;
+
+    start = p;
+
+    cr = _mm_set1_epi8(CR);
+    lf = _mm_set1_epi8(LF);
+    zero = _mm_setzero_si128();
+
+    while (last - p > 16) {
+        v = _mm_loadu_si128((__m128i *) p);
+
+        mask = _mm_movemask_epi8(_mm_or_si128(
+                                     _mm_or_si128(_mm_cmpeq_epi8(v, cr),
+                                                  _mm_cmpeq_epi8(v, lf)),
+                                     _mm_cmpeq_epi8(v, zero)));
+
+        if (mask) {
+            p += __builtin_ctz(mask);
+            break;
+        }
+
+        p += 16;
+    }
+
+    /* the state machine sets r->header_end on the first trailing space */
+
+    while (p > start && p[-1] == ' ') {
+        p--;
+    }
+
+    return p;
+}
+
+
+/*
+ * returns the length of the prefix that ngx_http_parse_complex_uri()
+ * copies as is in the sw_usual state; the bytes up to ' ' are checked
+ * as a whole, so a usual control character just ends the prefix earlier
+ */
+
+static ngx_inline size_t
+ngx_http_parse_usual_len(u_char *p, u_char *last)
+{
+    int       mask;
+    u_char   *start;
+    __m128i   v, m, space, hash, percent, plus, dot, slash, question;
+
+    start = p;
+
+    space = _mm_set1_epi8(' ');
+    hash = _mm_set1_epi8('#');
+    percent = _mm_set1_epi8('%');
+    plus = _mm_set1_epi8('+');
+    dot = _mm_set1_epi8('.');
+    slash = _mm_set1_epi8('/');
+    question = _mm_set1_epi8('?');
+
+    while (last - p >= 16) {
+        v = _mm_loadu_si128((__m128i *) p);
+
+        m = _mm_cmpeq_epi8(_mm_min_epu8(v, space), v);
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, hash));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, percent));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, plus));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, dot));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, slash));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, question));
+
+        mask = _mm_movemask_epi8(m);
+
+        if (mask) {
+            return p - start + __builtin_ctz(mask);
+        }
+
+        p += 16;
+    }
+
+    return p - start;
+}
+
+#endif
+
+
 ngx_int_t
 ngx_http_parse_uri(ngx_http_request_t *r)
 {
@@ -1228,6 +1342,9 @@ ngx_int_t
 ngx_http_parse_complex_uri(ngx_http_request_t *r, ngx_uint_t merge_slashes)
 {
     u_char  c, ch, decoded, *p, *u;
+#if (NGX_HAVE_SSE2)
+    size_t  n;
+#endif
     enum {
         sw_usual = 0,
         sw_slash,
@@ -1267,6 +1384,15 @@ ngx_http_parse_complex_uri(ngx_http_request_t *r, ngx_uint_t merge_slashes)
 
             if (usual[ch >> 5] & (1 << (ch & 0x1f))) {
                 *u++ = ch;
+
+#if (NGX_HAVE_SSE2)
+                if (r->uri_end - p >= 16) {
+                    n = ngx_http_parse_usual_len(p, r->uri_end);
+                    u = ngx_cpymem(u, p, n);
+                    p += n;
+                }
+#endif
+
                 ch = *p++;
                 break;
             }
@@ -63,6 +63,39 @@ static void ngx_http_ssl_handshake(ngx_event_t *rev);
 static void ngx_http_ssl_handshake_handler(ngx_connection_t *c);
 #endif
 
+static ssize_t ngx_http_recv_idle(ngx_connection_t *c, size_t size);
+
+static u_char *ngx_http_alloc_header_block(size_t size, ngx_log_t *log);
+static void ngx_http_free_header_block(ngx_buf_t *b);
+static void ngx_http_header_buffers_cleanup(void *data);
+
+
+/*
+ * the memory of the large header buffers is kept in a per worker list
+ * and is reused by all connections instead of being allocated and freed
+ * for every request with long headers
+ */
+
+#define NGX_HTTP_HEADER_BLOCKS  64
+
+
+typedef struct ngx_http_header_block_s  ngx_http_header_block_t;
+
+struct ngx_http_header_block_s {
+    ngx_http_header_block_t          *next;
+    size_t                            size;
+};
+
+
+static ngx_http_header_block_t  *ngx_http_header_blocks;
+static ngx_uint_t                ngx_http_header_nblocks;
+
+
+/* the per worker buffer the idle connections read into */
+
+static u_char                   *ngx_http_idle_buffer;
+static size_t                    ngx_http_idle_buffer_size;
+
 
 static char *ngx_http_client_errors[] = {
 
@@ -217,7 +250,7 @@ ngx_http_init_connection(ngx_connection_t *c)
 
     /* find the server configuration for the address:port */
     // 根据 addr:port查找server配置信息
-    port = c->listening->servers;
+    port = c->cold->listening->servers;
 
     if (port->naddrs > 1) {
 
@@ -232,11 +265,11 @@ ngx_http_init_connection(ngx_connection_t *c)
             return;
         }
 
-        switch (c->local_sockaddr->sa_family) {
+        switch (c->cold->local_sockaddr->sa_family) {
 
 #if (NGX_HAVE_INET6)
         case AF_INET6:
-            sin6 = (struct sockaddr_in6 *) c->local_sockaddr;
+            sin6 = (struct sockaddr_in6 *) c->cold->local_sockaddr;
 
             addr6 = port->addrs;
 
@@ -254,7 +287,7 @@ ngx_http_init_connection(ngx_connection_t *c)
 #endif
 
         default: /* AF_INET */
-            sin = (struct sockaddr_in *) c->local_sockaddr;
+            sin = (struct sockaddr_in *) c->cold->local_sockaddr;
 
             addr = port->addrs;
 
@@ -273,7 +306,7 @@ ngx_http_init_connection(ngx_connection_t *c)
 
     } else {
 
-        switch (c->local_sockaddr->sa_family) {
+        switch (c->cold->local_sockaddr->sa_family) {
 
 #if (NGX_HAVE_INET6)
         case AF_INET6:
@@ -302,7 +335,7 @@ ngx_http_init_connection(ngx_connection_t *c)
     ctx->request = NULL;
     ctx->current_request = NULL;
 
-    c->log->connection = c->number;
+    c->log->connection = c->cold->number;
     c->log->handler = ngx_http_log_error;
     c->log->data = ctx;
     c->log->action = "waiting for request";
@@ -360,7 +393,7 @@ ngx_http_init_connection(ngx_connection_t *c)
         return;
     }
 
-    ngx_add_timer(rev, c->listening->post_accept_timeout);
+    ngx_add_timer(rev, c->cold->listening->post_accept_timeout);
     // 设置为可重用，也就是说如果连接池中没有空闲连接，就可以把这个拿来用，因为还没有数据
     // 到来
     ngx_reusable_connection(c, 1);
@@ -405,39 +438,21 @@ ngx_http_wait_request_handler(ngx_event_t *rev)
 
     size = cscf->client_header_buffer_size;
 
-    b = c->buffer;
-
-    if (b == NULL) {
-        // 从ngx_connection_t的内存池分配内存，
-        b = ngx_create_temp_buf(c->pool, size);
-        if (b == NULL) {
+    if (c->buffer == NULL) {
+        // 只分配ngx_buf_t，内存在收到数据后才分配
+        c->buffer = ngx_calloc_buf(c->pool);
+        if (c->buffer == NULL) {
             ngx_http_close_connection(c);
             return;
         }
-
-        c->buffer = b;
-
-    } else if (b->start == NULL) {
-        // 如果该连接被复用，就不用重新给b分配内存，直接拿来用就可以了，这就是为什么要在
-        // ngx_connection_t 的内存池分配内存，而不在 ngx_http_request_t的内存池分配
-        // 的原因
-        b->start = ngx_palloc(c->pool, size);
-        if (b->start == NULL) {
-            ngx_http_close_connection(c);
-            return;
-        }
-
-        b->pos = b->start;
-        b->last = b->start;
-        b->end = b->last + size;
     }
 
-    n = c->recv(c, b->last, size);
+    n = ngx_http_recv_idle(c, size);
 
     if (n == NGX_AGAIN) {
 
 #if (NGX_HAVE_DEFERRED_ACCEPT && defined TCP_DEFER_ACCEPT)
-        if (c->listening->deferred_accept
+        if (c->cold->listening->deferred_accept
 #if (NGX_HTTP_SSL)
             && c->ssl == NULL
 #endif
@@ -451,7 +466,7 @@ ngx_http_wait_request_handler(ngx_event_t *rev)
 #endif
 
         if (!rev->timer_set) {
-            ngx_add_timer(rev, c->listening->post_accept_timeout);
+            ngx_add_timer(rev, c->cold->listening->post_accept_timeout);
             ngx_reusable_connection(c, 1);
         }
 
@@ -460,14 +475,6 @@ ngx_http_wait_request_handler(ngx_event_t *rev)
             return;
         }
 
-        /*
-         * We are trying to not hold c->buffer's memory for an idle connection.
-         */
-
-        if (ngx_pfree(c->pool, b->start) == NGX_OK) {
-            b->start = NULL;
-        }
-
         return;
     }
 
@@ -483,8 +490,6 @@ ngx_http_wait_request_handler(ngx_event_t *rev)
         return;
     }
 
-    b->last += n;
-
     c->log->action = "reading client request line";
 
     ngx_reusable_connection(c, 0);
@@ -500,6 +505,76 @@ ngx_http_wait_request_handler(ngx_event_t *rev)
 }
 
 
+/*
+ * an idle connection reads into the worker buffer and gets the c->buffer
+ * memory only when some data have arrived; a complete request header
+ * gets a buffer of its size
+ */
+
+static ssize_t
+ngx_http_recv_idle(ngx_connection_t *c, size_t size)
+{
+    u_char     *p;
+    size_t      len;
+    ssize_t     n;
+    ngx_buf_t  *b;
+
+    if (ngx_http_idle_buffer_size < size) {
+        p = ngx_alloc(size, c->log);
+        if (p == NULL) {
+            return NGX_ERROR;
+        }
+
+        if (ngx_http_idle_buffer) {
+            ngx_free(ngx_http_idle_buffer);
+        }
+
+        ngx_http_idle_buffer = p;
+        ngx_http_idle_buffer_size = size;
+    }
+
+    p = ngx_http_idle_buffer;
+
+    n = c->recv(c, p, size);
+
+    if (n <= 0) {
+        return n;
+    }
+
+    len = size;
+
+    if ((size_t) n < size
+        && n > 4
+        && p[n - 4] == CR && p[n - 3] == LF && p[n - 2] == CR && p[n - 1] == LF)
+    {
+        len = n;
+    }
+
+    ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0,
+                   "http idle recv: %z, buffer: %uz", n, len);
+
+    /*
+     * the memory is freed by ngx_http_set_keepalive() or
+     * ngx_http_close_connection(), it is not allocated from c->pool
+     * as the pool would keep a large allocation link for every request
+     */
+
+    b = c->buffer;
+
+    b->start = ngx_alloc(len, c->log);
+    if (b->start == NULL) {
+        return NGX_ERROR;
+    }
+
+    b->pos = b->start;
+    b->last = ngx_cpymem(b->start, p, n);
+    b->end = b->start + len;
+    b->temporary = 1;
+
+    return n;
+}
+
+
 ngx_http_request_t *
 ngx_http_create_request(ngx_connection_t *c)
 {
@@ -653,7 +728,7 @@ ngx_http_ssl_handshake(ngx_event_t *rev)
         if (err == NGX_EAGAIN) {
 
 #if (NGX_HAVE_DEFERRED_ACCEPT && defined TCP_DEFER_ACCEPT)
-            if (c->listening->deferred_accept) {
+            if (c->cold->listening->deferred_accept) {
                 ngx_log_error(NGX_LOG_INFO, c->log, NGX_ETIMEDOUT,
                               "client timed out in deferred accept");
                 ngx_http_close_connection(c);
@@ -662,7 +737,7 @@ ngx_http_ssl_handshake(ngx_event_t *rev)
 #endif
 
             if (!rev->timer_set) {
-                ngx_add_timer(rev, c->listening->post_accept_timeout);
+                ngx_add_timer(rev, c->cold->listening->post_accept_timeout);
                 ngx_reusable_connection(c, 1);
             }
 
@@ -700,7 +775,7 @@ ngx_http_ssl_handshake(ngx_event_t *rev)
             if (rc == NGX_AGAIN) {
 
                 if (!rev->timer_set) {
-                    ngx_add_timer(rev, c->listening->post_accept_timeout);
+                    ngx_add_timer(rev, c->cold->listening->post_accept_timeout);
                 }
 
                 ngx_reusable_connection(c, 0);
@@ -1391,6 +1466,7 @@ ngx_http_alloc_large_header_buffer(ngx_http_request_t *r,
 {
     u_char                    *old, *new;
     ngx_buf_t                 *b;
+    ngx_pool_cleanup_t        *cln;
     ngx_http_connection_t     *hc;
     ngx_http_core_srv_conf_t  *cscf;
 
@@ -1430,19 +1506,38 @@ ngx_http_alloc_large_header_buffer(ngx_http_request_t *r,
     } else if (hc->nbusy < cscf->large_client_header_buffers.num) {
 
         if (hc->busy == NULL) {
+            cln = ngx_pool_cleanup_add(r->connection->pool, 0);
+            if (cln == NULL) {
+                return NGX_ERROR;
+            }
+
             hc->busy = ngx_palloc(r->connection->pool,
                   cscf->large_client_header_buffers.num * sizeof(ngx_buf_t *));
             if (hc->busy == NULL) {
                 return NGX_ERROR;
             }
+
+            cln->handler = ngx_http_header_buffers_cleanup;
+            cln->data = hc;
         }
 
-        b = ngx_create_temp_buf(r->connection->pool,
-                                cscf->large_client_header_buffers.size);
+        b = ngx_calloc_buf(r->connection->pool);
         if (b == NULL) {
             return NGX_ERROR;
         }
 
+        b->start = ngx_http_alloc_header_block(
+                                        cscf->large_client_header_buffers.size,
+                                        r->connection->log);
+        if (b->start == NULL) {
+            return NGX_ERROR;
+        }
+
+        b->pos = b->start;
+        b->last = b->start;
+        b->end = b->start + cscf->large_client_header_buffers.size;
+        b->temporary = 1;
+
         ngx_log_debug2(NGX_LOG_DEBUG_HTTP, r->connection->log, 0,
                        "http large header alloc: %p %uz",
                        b->pos, b->end - b->last);
@@ -1529,6 +1624,71 @@ ngx_http_alloc_large_header_buffer(ngx_http_request_t *r,
 }
 
 
+static u_char *
+ngx_http_alloc_header_block(size_t size, ngx_log_t *log)
+{
+    ngx_http_header_block_t  *hb, **prev;
+
+    for (prev = &ngx_http_header_blocks, hb = ngx_http_header_blocks;
+         hb;
+         prev = &hb->next, hb = hb->next)
+    {
+        if (hb->size == size) {
+            *prev = hb->next;
+            ngx_http_header_nblocks--;
+
+            ngx_log_debug1(NGX_LOG_DEBUG_HTTP, log, 0,
+                           "http large header reuse: %p", hb);
+
+            return (u_char *) hb;
+        }
+    }
+
+    return ngx_alloc(size, log);
+}
+
+
+static void
+ngx_http_free_header_block(ngx_buf_t *b)
+{
+    ngx_http_header_block_t  *hb;
+
+    if (ngx_http_header_nblocks == NGX_HTTP_HEADER_BLOCKS) {
+        ngx_free(b->start);
+        return;
+    }
+
+    hb = (ngx_http_header_block_t *) b->start;
+
+    hb->size = b->end - b->start;
+    hb->next = ngx_http_header_blocks;
+
+    ngx_http_header_blocks = hb;
+    ngx_http_header_nblocks++;
+}
+
+
+static void
+ngx_http_header_buffers_cleanup(void *data)
+{
+    ngx_http_connection_t *hc = data;
+
+    ngx_int_t  i;
+
+    for (i = 0; i < hc->nfree; i++) {
+        ngx_http_free_header_block(hc->free[i]);
+    }
+
+    hc->nfree = 0;
+
+    for (i = 0; i < hc->nbusy; i++) {
+        ngx_http_free_header_block(hc->busy[i]);
+    }
+
+    hc->nbusy = 0;
+}
+
+
 static ngx_int_t
 ngx_http_process_header_line(ngx_http_request_t *r, ngx_table_elt_t *h,
     ngx_uint_t offset)
@@ -2894,25 +3054,20 @@ ngx_http_set_keepalive(ngx_http_request_t *r)
 
     /*
      * To keep a memory footprint as small as possible for an idle keepalive
-     * connection we try to free c->buffer's memory if it was allocated outside
-     * the c->pool.  The large header buffers are always allocated outside the
-     * c->pool and are freed too.
+     * connection we free c->buffer's memory, it is always allocated outside
+     * the c->pool by ngx_http_recv_idle().  The large header buffers are
+     * always allocated outside the c->pool and are returned to the worker list.
      */
 
     b = c->buffer;
 
-    if (ngx_pfree(c->pool, b->start) == NGX_OK) {
-
-        /*
-         * the special note for ngx_http_keepalive_handler() that
-         * c->buffer's memory was freed
-         */
+    if (b->start) {
+        ngx_free(b->start);
 
+        b->start = NULL;
         b->pos = NULL;
-
-    } else {
-        b->pos = b->start;
-        b->last = b->start;
+        b->last = NULL;
+        b->end = NULL;
     }
 
     ngx_log_debug2(NGX_LOG_DEBUG_HTTP, c->log, 0, "hc free: %p %d",
@@ -2920,7 +3075,7 @@ ngx_http_set_keepalive(ngx_http_request_t *r)
 
     if (hc->free) {
         for (i = 0; i < hc->nfree; i++) {
-            ngx_pfree(c->pool, hc->free[i]->start);
+            ngx_http_free_header_block(hc->free[i]);
             hc->free[i] = NULL;
         }
 
@@ -2932,7 +3087,7 @@ ngx_http_set_keepalive(ngx_http_request_t *r)
 
     if (hc->busy) {
         for (i = 0; i < hc->nbusy; i++) {
-            ngx_pfree(c->pool, hc->busy[i]->start);
+            ngx_http_free_header_block(hc->busy[i]);
             hc->busy[i] = NULL;
         }
 
@@ -3015,10 +3170,10 @@ ngx_http_set_keepalive(ngx_http_request_t *r)
 static void
 ngx_http_keepalive_handler(ngx_event_t *rev)
 {
-    size_t             size;
-    ssize_t            n;
-    ngx_buf_t         *b;
-    ngx_connection_t  *c;
+    ssize_t                    n;
+    ngx_connection_t          *c;
+    ngx_http_connection_t     *hc;
+    ngx_http_core_srv_conf_t  *cscf;
 
     c = rev->data;
 
@@ -3036,7 +3191,7 @@ ngx_http_keepalive_handler(ngx_event_t *rev)
             c->log->handler = NULL;
             ngx_log_error(NGX_LOG_INFO, c->log, rev->kq_errno,
                           "kevent() reported that client %V closed "
-                          "keepalive connection", &c->addr_text);
+                          "keepalive connection", &c->cold->addr_text);
 #if (NGX_HTTP_SSL)
             if (c->ssl) {
                 c->ssl->no_send_shutdown = 1;
@@ -3049,27 +3204,8 @@ ngx_http_keepalive_handler(ngx_event_t *rev)
 
 #endif
 
-    b = c->buffer;
-    size = b->end - b->start;
-
-    if (b->pos == NULL) {
-
-        /*
-         * The c->buffer's memory was freed by ngx_http_set_keepalive().
-         * However, the c->buffer->start and c->buffer->end were not changed
-         * to keep the buffer size.
-         */
-
-        b->pos = ngx_palloc(c->pool, size);
-        if (b->pos == NULL) {
-            ngx_http_close_connection(c);
-            return;
-        }
-
-        b->start = b->pos;
-        b->last = b->pos;
-        b->end = b->pos + size;
-    }
+    hc = c->data;
+    cscf = ngx_http_get_module_srv_conf(hc->conf_ctx, ngx_http_core_module);
 
     /*
      * MSIE closes a keepalive connection with RST flag
@@ -3079,7 +3215,7 @@ ngx_http_keepalive_handler(ngx_event_t *rev)
     c->log_error = NGX_ERROR_IGNORE_ECONNRESET;
     ngx_set_socket_errno(0);
 
-    n = c->recv(c, b->last, size);
+    n = ngx_http_recv_idle(c, cscf->client_header_buffer_size);
     c->log_error = NGX_ERROR_INFO;
 
     if (n == NGX_AGAIN) {
@@ -3088,20 +3224,6 @@ ngx_http_keepalive_handler(ngx_event_t *rev)
             return;
         }
 
-        /*
-         * Like ngx_http_set_keepalive() we are trying to not hold
-         * c->buffer's memory for a keepalive connection.
-         */
-
-        if (ngx_pfree(c->pool, b->start) == NGX_OK) {
-
-            /*
-             * the special note that c->buffer's memory was freed
-             */
-
-            b->pos = NULL;
-        }
-
         return;
     }
 
@@ -3114,13 +3236,12 @@ ngx_http_keepalive_handler(ngx_event_t *rev)
 
     if (n == 0) {
         ngx_log_error(NGX_LOG_INFO, c->log, ngx_socket_errno,
-                      "client %V closed keepalive connection", &c->addr_text);
+                      "client %V closed keepalive connection",
+                      &c->cold->addr_text);
         ngx_http_close_connection(c);
         return;
     }
 
-    b->last += n;
-
     c->log->handler = ngx_http_log_error;
     c->log->action = "reading client request line";
 
@@ -3494,6 +3615,11 @@ ngx_http_close_connection(ngx_connection_t *c)
 
     c->destroyed = 1; // 给后续事件处理看的
 
+    if (c->buffer && c->buffer->start) {
+        ngx_free(c->buffer->start);
+        c->buffer->start = NULL;
+    }
+
     pool = c->pool;
 
     ngx_close_connection(c);
@@ -3518,7 +3644,8 @@ ngx_http_log_error(ngx_log_t *log, u_char *buf, size_t len)
 
     ctx = log->data;
 
-    p = ngx_snprintf(buf, len, ", client: %V", &ctx->connection->addr_text);
+    p = ngx_snprintf(buf, len, ", client: %V",
+                     &ctx->connection->cold->addr_text);
     len -= p - buf;
 
     r = ctx->request;
@@ -3528,7 +3655,7 @@ ngx_http_log_error(ngx_log_t *log, u_char *buf, size_t len)
 
     } else {
         p = ngx_snprintf(p, len, ", server: %V",
-                         &ctx->connection->listening->addr_text);
+                         &ctx->connection->cold->listening->addr_text);
     }
 
     return p;
@@ -2735,7 +2735,7 @@ ngx_http_spdy_keepalive_handler(ngx_event_t *rev)
             c->log->handler = NULL;
             ngx_log_error(NGX_LOG_INFO, c->log, rev->kq_errno,
                           "kevent() reported that client %V closed "
-                          "keepalive connection", &c->addr_text);
+                          "keepalive connection", &c->cold->addr_text);
 #if (NGX_HTTP_SSL)
             if (c->ssl) {
                 c->ssl->no_send_shutdown = 1;
@@ -224,11 +224,11 @@ ngx_http_spdy_header_filter(ngx_http_request_t *r)
             }
         }
 
-        switch (c->local_sockaddr->sa_family) {
+        switch (c->cold->local_sockaddr->sa_family) {
 
 #if (NGX_HAVE_INET6)
         case AF_INET6:
-            sin6 = (struct sockaddr_in6 *) c->local_sockaddr;
+            sin6 = (struct sockaddr_in6 *) c->cold->local_sockaddr;
             port = ntohs(sin6->sin6_port);
             break;
 #endif
@@ -238,7 +238,7 @@ ngx_http_spdy_header_filter(ngx_http_request_t *r)
             break;
 #endif
         default: /* AF_INET */
-            sin = (struct sockaddr_in *) c->local_sockaddr;
+            sin = (struct sockaddr_in *) c->cold->local_sockaddr;
             port = ntohs(sin->sin_port);
             break;
         }
@@ -5129,7 +5129,9 @@ ngx_http_upstream_init_main_conf(ngx_conf_t *cf, void *conf)
     hash.pool = cf->pool;
     hash.temp_pool = NULL;
 
-    if (ngx_hash_init(&hash, headers_in.elts, headers_in.nelts) != NGX_OK) {
+    if (ngx_hash_perfect_init(&hash, headers_in.elts, headers_in.nelts)
+        != NGX_OK)
+    {
         return NGX_CONF_ERROR;
     }
 
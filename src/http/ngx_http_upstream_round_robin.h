@@ -14,6 +14,11 @@
 #include <ngx_http.h>
 
 
+/* the peer->down bits, any of them excludes the peer from the selection */
+#define NGX_HTTP_UPSTREAM_CONF_DOWN     0x01
+#define NGX_HTTP_UPSTREAM_HC_DOWN       0x02
+
+
 typedef struct {
     struct sockaddr                *sockaddr;
     socklen_t                       socklen;
@@ -23,6 +28,12 @@ typedef struct {
     ngx_int_t                       effective_weight;
     ngx_int_t                       weight;
 
+    ngx_uint_t                      conns;
+
+    /* the response time average in microseconds and its last update */
+    uint64_t                        ewma;
+    ngx_msec_t                      ewma_updated;
+
     ngx_uint_t                      fails;
     time_t                          accessed;
     time_t                          checked;
@@ -30,7 +41,7 @@ typedef struct {
     ngx_uint_t                      max_fails;
     time_t                          fail_timeout;
 
-    ngx_uint_t                      down;          /* unsigned  down:1; */
+    ngx_uint_t                      down;
 
 #if (NGX_HTTP_SSL)
     ngx_ssl_session_t              *ssl_session;   /* local to a process */
@@ -43,7 +54,11 @@ typedef struct ngx_http_upstream_rr_peers_s  ngx_http_upstream_rr_peers_t;
 struct ngx_http_upstream_rr_peers_s {
     ngx_uint_t                      number;
 
- /* ngx_mutex_t                    *mutex; */
+#if (NGX_HTTP_UPSTREAM_ZONE)
+    ngx_slab_pool_t                *shpool;
+    ngx_atomic_t                    lock;
+    ngx_http_upstream_rr_peers_t   *zone_next;
+#endif
 
     ngx_uint_t                      total_weight;
 
@@ -58,6 +73,33 @@ struct ngx_http_upstream_rr_peers_s {
 };
 
 
+#if (NGX_HTTP_UPSTREAM_ZONE)
+
+/*
+ * the peers in an upstream zone are shared by all workers,
+ * the lock is taken by a worker only for a selection or a state update
+ */
+
+#define ngx_http_upstream_rr_peers_lock(peers)                                \
+                                                                              \
+    if (peers->shpool) {                                                      \
+        ngx_spinlock(&peers->lock, ngx_pid, 1024);                            \
+    }
+
+#define ngx_http_upstream_rr_peers_unlock(peers)                              \
+                                                                              \
+    if (peers->shpool) {                                                      \
+        (void) ngx_atomic_cmp_set(&peers->lock, ngx_pid, 0);                  \
+    }
+
+#else
+
+#define ngx_http_upstream_rr_peers_lock(peers)
+#define ngx_http_upstream_rr_peers_unlock(peers)
+
+#endif
+
+
 typedef struct {
     ngx_http_upstream_rr_peers_t   *peers;
     ngx_uint_t                      current;
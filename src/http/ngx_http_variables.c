@@ -1117,11 +1117,11 @@ ngx_http_variable_binary_remote_addr(ngx_http_request_t *r,
     struct sockaddr_in6  *sin6;
 #endif
 
-    switch (r->connection->sockaddr->sa_family) {
+    switch (r->connection->cold->sockaddr->sa_family) {
 
 #if (NGX_HAVE_INET6)
     case AF_INET6:
-        sin6 = (struct sockaddr_in6 *) r->connection->sockaddr;
+        sin6 = (struct sockaddr_in6 *) r->connection->cold->sockaddr;
 
         v->len = sizeof(struct in6_addr);
         v->valid = 1;
@@ -1133,7 +1133,7 @@ ngx_http_variable_binary_remote_addr(ngx_http_request_t *r,
 #endif
 
     default: /* AF_INET */
-        sin = (struct sockaddr_in *) r->connection->sockaddr;
+        sin = (struct sockaddr_in *) r->connection->cold->sockaddr;
 
         v->len = sizeof(in_addr_t);
         v->valid = 1;
@@ -1152,11 +1152,11 @@ static ngx_int_t
 ngx_http_variable_remote_addr(ngx_http_request_t *r,
     ngx_http_variable_value_t *v, uintptr_t data)
 {
-    v->len = r->connection->addr_text.len;
+    v->len = r->connection->cold->addr_text.len;
     v->valid = 1;
     v->no_cacheable = 0;
     v->not_found = 0;
-    v->data = r->connection->addr_text.data;
+    v->data = r->connection->cold->addr_text.data;
 
     return NGX_OK;
 }
@@ -1182,17 +1182,17 @@ ngx_http_variable_remote_port(ngx_http_request_t *r,
         return NGX_ERROR;
     }
 
-    switch (r->connection->sockaddr->sa_family) {
+    switch (r->connection->cold->sockaddr->sa_family) {
 
 #if (NGX_HAVE_INET6)
     case AF_INET6:
-        sin6 = (struct sockaddr_in6 *) r->connection->sockaddr;
+        sin6 = (struct sockaddr_in6 *) r->connection->cold->sockaddr;
         port = ntohs(sin6->sin6_port);
         break;
 #endif
 
     default: /* AF_INET */
-        sin = (struct sockaddr_in *) r->connection->sockaddr;
+        sin = (struct sockaddr_in *) r->connection->cold->sockaddr;
         port = ntohs(sin->sin_port);
         break;
     }
@@ -1260,17 +1260,17 @@ ngx_http_variable_server_port(ngx_http_request_t *r,
         return NGX_ERROR;
     }
 
-    switch (r->connection->local_sockaddr->sa_family) {
+    switch (r->connection->cold->local_sockaddr->sa_family) {
 
 #if (NGX_HAVE_INET6)
     case AF_INET6:
-        sin6 = (struct sockaddr_in6 *) r->connection->local_sockaddr;
+        sin6 = (struct sockaddr_in6 *) r->connection->cold->local_sockaddr;
         port = ntohs(sin6->sin6_port);
         break;
 #endif
 
     default: /* AF_INET */
-        sin = (struct sockaddr_in *) r->connection->local_sockaddr;
+        sin = (struct sockaddr_in *) r->connection->cold->local_sockaddr;
         port = ntohs(sin->sin_port);
         break;
     }
@@ -2015,7 +2015,7 @@ ngx_http_variable_connection(ngx_http_request_t *r,
         return NGX_ERROR;
     }
 
-    v->len = ngx_sprintf(p, "%uA", r->connection->number) - p;
+    v->len = ngx_sprintf(p, "%uA", r->connection->cold->number) - p;
     v->valid = 1;
     v->no_cacheable = 0;
     v->not_found = 0;
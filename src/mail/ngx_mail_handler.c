@@ -38,7 +38,7 @@ ngx_mail_init_connection(ngx_connection_t *c)
 
     /* find the server configuration for the address:port */
 
-    port = c->listening->servers;
+    port = c->cold->listening->servers;
 
     if (port->naddrs > 1) {
 
@@ -55,7 +55,7 @@ ngx_mail_init_connection(ngx_connection_t *c)
             return;
         }
 
-        sa = c->local_sockaddr;
+        sa = c->cold->local_sockaddr;
 
         switch (sa->sa_family) {
 
@@ -97,7 +97,7 @@ ngx_mail_init_connection(ngx_connection_t *c)
         }
 
     } else {
-        switch (c->local_sockaddr->sa_family) {
+        switch (c->cold->local_sockaddr->sa_family) {
 
 #if (NGX_HAVE_INET6)
         case AF_INET6:
@@ -128,7 +128,7 @@ ngx_mail_init_connection(ngx_connection_t *c)
     s->connection = c;
 
     ngx_log_error(NGX_LOG_INFO, c->log, 0, "*%ui client %V connected to %V",
-                  c->number, &c->addr_text, s->addr_text);
+                  c->cold->number, &c->cold->addr_text, s->addr_text);
 
     ctx = ngx_palloc(c->pool, sizeof(ngx_mail_log_ctx_t));
     if (ctx == NULL) {
@@ -136,10 +136,10 @@ ngx_mail_init_connection(ngx_connection_t *c)
         return;
     }
 
-    ctx->client = &c->addr_text;
+    ctx->client = &c->cold->addr_text;
     ctx->session = s;
 
-    c->log->connection = c->number;
+    c->log->connection = c->cold->number;
     c->log->handler = ngx_mail_log_error;
     c->log->data = ctx;
     c->log->action = "sending client greeting line";
@@ -540,7 +540,8 @@ ngx_mail_proxy_smtp_handler(ngx_event_t *rev)
 
         line.len = sizeof("XCLIENT ADDR= LOGIN= NAME="
                           CRLF) - 1
-                   + s->connection->addr_text.len + s->login.len + s->host.len;
+                   + s->connection->cold->addr_text.len + s->login.len
+                   + s->host.len;
 
         line.data = ngx_pnalloc(c->pool, line.len);
         if (line.data == NULL) {
@@ -550,7 +551,7 @@ ngx_mail_proxy_smtp_handler(ngx_event_t *rev)
 
         line.len = ngx_sprintf(line.data,
                        "XCLIENT ADDR=%V%s%V NAME=%V" CRLF,
-                       &s->connection->addr_text,
+                       &s->connection->cold->addr_text,
                        (s->login.len ? " LOGIN=" : ""), &s->login, &s->host)
                    - line.data;
 
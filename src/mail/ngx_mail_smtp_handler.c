@@ -67,7 +67,7 @@ ngx_mail_smtp_init_session(ngx_mail_session_t *s, ngx_connection_t *c)
         return;
     }
 
-    if (c->sockaddr->sa_family != AF_INET) {
+    if (c->cold->sockaddr->sa_family != AF_INET) {
         s->host = smtp_tempunavail;
         ngx_mail_smtp_greeting(s, c);
         return;
@@ -83,7 +83,7 @@ ngx_mail_smtp_init_session(ngx_mail_session_t *s, ngx_connection_t *c)
 
     /* AF_INET only */
 
-    sin = (struct sockaddr_in *) c->sockaddr;
+    sin = (struct sockaddr_in *) c->cold->sockaddr;
 
     ctx->addr = sin->sin_addr.s_addr;
     ctx->handler = ngx_mail_smtp_resolve_addr_handler;
@@ -108,7 +108,7 @@ ngx_mail_smtp_resolve_addr_handler(ngx_resolver_ctx_t *ctx)
     if (ctx->state) {
         ngx_log_error(NGX_LOG_ERR, c->log, 0,
                       "%V could not be resolved (%i: %s)",
-                      &c->addr_text, ctx->state,
+                      &c->cold->addr_text, ctx->state,
                       ngx_resolver_strerror(ctx->state));
 
         if (ctx->state == NGX_RESOLVE_NXDOMAIN) {
@@ -207,7 +207,7 @@ ngx_mail_smtp_resolve_name_handler(ngx_resolver_ctx_t *ctx)
 
         /* AF_INET only */
 
-        sin = (struct sockaddr_in *) c->sockaddr;
+        sin = (struct sockaddr_in *) c->cold->sockaddr;
 
         for (i = 0; i < ctx->naddrs; i++) {
 
@@ -0,0 +1,571 @@
+
+/*
+ * Copyright (C) Igor Sysoev
+ * Copyright (C) Nginx, Inc.
+ */
+
+
+/*
+ * a microbenchmark of the request processing hot paths,
+ * it is built by "make bench" and runs without sockets and configuration:
+ *
+ *     objs/nginx_bench [-n iterations] [-c connections] [request file]
+ *
+ * the request file is a recorded request header, it replaces the built-in
+ * synthetic request for the parser and hash benchmarks;
+ *
+ * the connection scale benchmark reports the resident memory taken by
+ * the connections and events preallocated by ngx_event_process_init(),
+ * once all connections are free and once all of them are in use
+ */
+
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+
+#define NGX_BENCH_ITERATIONS  1000000
+#define NGX_BENCH_MAX_HEADERS  64
+#define NGX_BENCH_CONNECTIONS  100000
+
+
+typedef struct {
+    ngx_http_request_t         r;
+    ngx_buf_t                  buf;
+
+    /* the request line is skipped by the header benchmark */
+    u_char                    *headers;
+
+    ngx_uint_t                 nnames;
+    ngx_str_t                  names[NGX_BENCH_MAX_HEADERS];
+    ngx_uint_t                 keys[NGX_BENCH_MAX_HEADERS];
+
+    ngx_hash_t                 hash;
+    ngx_hash_key_t            *hash_names;
+    ngx_uint_t                 hash_nelts;
+
+    ngx_pool_t                *pool;
+} ngx_bench_ctx_t;
+
+
+typedef ngx_int_t (*ngx_bench_pt)(ngx_bench_ctx_t *ctx, ngx_pool_t *pool);
+
+
+typedef struct {
+    char                      *name;
+    ngx_bench_pt               handler;
+} ngx_bench_t;
+
+
+static ngx_int_t ngx_bench_init(ngx_bench_ctx_t *ctx, char *file);
+static ngx_int_t ngx_bench_request_line(ngx_bench_ctx_t *ctx,
+    ngx_pool_t *pool);
+static ngx_int_t ngx_bench_header_lines(ngx_bench_ctx_t *ctx,
+    ngx_pool_t *pool);
+static ngx_int_t ngx_bench_hash_find(ngx_bench_ctx_t *ctx,
+    ngx_pool_t *pool);
+static ngx_int_t ngx_bench_hash_init(ngx_bench_ctx_t *ctx,
+    ngx_pool_t *pool);
+static ngx_int_t ngx_bench_sprintf(ngx_bench_ctx_t *ctx,
+    ngx_pool_t *pool);
+static ngx_int_t ngx_bench_connections(ngx_uint_t n);
+static size_t ngx_bench_rss(void);
+static size_t ngx_bench_pool_used(ngx_pool_t *pool, ngx_uint_t *nalloc);
+static uint64_t ngx_bench_now(void);
+
+
+static u_char  ngx_bench_request[] =
+    "GET /static/images/logo.png?v=20131119&lang=en HTTP/1.1" CRLF
+    "Host: www.example.com" CRLF
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:25.0) Gecko/20100101"
+    " Firefox/25.0" CRLF
+    "Accept: image/png,image/*;q=0.8,*/*;q=0.5" CRLF
+    "Accept-Language: en-US,en;q=0.5" CRLF
+    "Accept-Encoding: gzip, deflate" CRLF
+    "Referer: http://www.example.com/index.html" CRLF
+    "Cookie: session=0123456789abcdef; theme=dark" CRLF
+    "Connection: keep-alive" CRLF
+    "If-Modified-Since: Tue, 19 Nov 2013 15:50:54 GMT" CRLF
+    "Cache-Control: max-age=0" CRLF
+    CRLF;
+
+
+static ngx_bench_t  ngx_benches[] = {
+    { "parse_request_line", ngx_bench_request_line },
+    { "parse_header_line", ngx_bench_header_lines },
+    { "hash_find", ngx_bench_hash_find },
+    { "hash_init", ngx_bench_hash_init },
+    { "vslprintf", ngx_bench_sprintf },
+    { NULL, NULL }
+};
+
+
+static ngx_log_t         ngx_bench_log;
+static ngx_open_file_t   ngx_bench_log_file;
+
+
+int ngx_cdecl
+main(int argc, char *const *argv)
+{
+    char             *file;
+    size_t            used, empty;
+    uint64_t          start, elapsed;
+    ngx_int_t         n;
+    ngx_uint_t        i, k, iterations, connections, nalloc;
+    ngx_pool_t       *pool;
+    ngx_bench_t      *bench;
+    ngx_bench_ctx_t   ctx;
+
+    iterations = NGX_BENCH_ITERATIONS;
+    connections = NGX_BENCH_CONNECTIONS;
+    file = NULL;
+
+    for (i = 1; i < (ngx_uint_t) argc; i++) {
+
+        if (ngx_strcmp(argv[i], "-n") == 0 && i + 1 < (ngx_uint_t) argc) {
+            i++;
+
+            n = ngx_atoi((u_char *) argv[i], ngx_strlen(argv[i]));
+            if (n == NGX_ERROR || n == 0) {
+                fprintf(stderr, "invalid number of iterations \"%s\"\n",
+                        argv[i]);
+                return 1;
+            }
+
+            iterations = n;
+            continue;
+        }
+
+        if (ngx_strcmp(argv[i], "-c") == 0 && i + 1 < (ngx_uint_t) argc) {
+            i++;
+
+            n = ngx_atoi((u_char *) argv[i], ngx_strlen(argv[i]));
+            if (n == NGX_ERROR || n == 0) {
+                fprintf(stderr, "invalid number of connections \"%s\"\n",
+                        argv[i]);
+                return 1;
+            }
+
+            connections = n;
+            continue;
+        }
+
+        file = argv[i];
+    }
+
+    /* ngx_init_setproctitle() called by ngx_os_init() needs the argv */
+
+    ngx_os_argv = (char **) argv;
+
+    ngx_bench_log_file.fd = ngx_stderr;
+    ngx_bench_log.file = &ngx_bench_log_file;
+    ngx_bench_log.log_level = NGX_LOG_NOTICE;
+
+    if (ngx_strerror_init() != NGX_OK) {
+        return 1;
+    }
+
+    ngx_time_init();
+
+    if (ngx_os_init(&ngx_bench_log) != NGX_OK) {
+        return 1;
+    }
+
+    if (ngx_bench_init(&ctx, file) != NGX_OK) {
+        return 1;
+    }
+
+    pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, &ngx_bench_log);
+    if (pool == NULL) {
+        return 1;
+    }
+
+    empty = ngx_bench_pool_used(pool, &nalloc);
+
+    printf("%-20s %12s %12s %12s %12s\n",
+           "benchmark", "ops", "ns/op", "bytes/op", "mallocs/op");
+
+    for (bench = ngx_benches; bench->name; bench++) {
+
+        /* an untimed operation counts the pool memory it takes */
+
+        if (bench->handler(&ctx, pool) != NGX_OK) {
+            fprintf(stderr, "%s: failed\n", bench->name);
+            return 1;
+        }
+
+        used = ngx_bench_pool_used(pool, &nalloc) - empty;
+
+        ngx_reset_pool(pool);
+
+        start = ngx_bench_now();
+
+        for (k = 0; k < iterations; k++) {
+            (void) bench->handler(&ctx, pool);
+
+            if (used) {
+                ngx_reset_pool(pool);
+            }
+        }
+
+        elapsed = ngx_bench_now() - start;
+
+        printf("%-20s %12lu %12.1f %12lu %12lu\n",
+               bench->name, (unsigned long) iterations,
+               (double) elapsed / iterations,
+               (unsigned long) used, (unsigned long) nalloc);
+    }
+
+    ngx_destroy_pool(pool);
+    ngx_destroy_pool(ctx.pool);
+
+    if (ngx_bench_connections(connections) != NGX_OK) {
+        fprintf(stderr, "connections: failed\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+
+static ngx_int_t
+ngx_bench_init(ngx_bench_ctx_t *ctx, char *file)
+{
+    u_char              *p;
+    ssize_t              n;
+    ngx_fd_t             fd;
+    ngx_int_t            rc;
+    ngx_uint_t           i;
+    ngx_file_info_t      fi;
+    ngx_hash_init_t      hash;
+    ngx_http_header_t   *header;
+    ngx_http_request_t  *r;
+
+    ngx_memzero(ctx, sizeof(ngx_bench_ctx_t));
+
+    ctx->pool = ngx_create_pool(NGX_DEFAULT_POOL_SIZE, &ngx_bench_log);
+    if (ctx->pool == NULL) {
+        return NGX_ERROR;
+    }
+
+    if (file == NULL) {
+        ctx->buf.start = ngx_bench_request;
+        ctx->buf.last = ngx_bench_request + sizeof(ngx_bench_request) - 1;
+
+    } else {
+        fd = ngx_open_file(file, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+        if (fd == NGX_INVALID_FILE) {
+            ngx_log_error(NGX_LOG_EMERG, &ngx_bench_log, ngx_errno,
+                          ngx_open_file_n " \"%s\" failed", file);
+            return NGX_ERROR;
+        }
+
+        if (ngx_fd_info(fd, &fi) == NGX_FILE_ERROR) {
+            ngx_log_error(NGX_LOG_EMERG, &ngx_bench_log, ngx_errno,
+                          ngx_fd_info_n " \"%s\" failed", file);
+            return NGX_ERROR;
+        }
+
+        p = ngx_palloc(ctx->pool, ngx_file_size(&fi));
+        if (p == NULL) {
+            return NGX_ERROR;
+        }
+
+        n = ngx_read_fd(fd, p, ngx_file_size(&fi));
+        if (n == -1) {
+            ngx_log_error(NGX_LOG_EMERG, &ngx_bench_log, ngx_errno,
+                          ngx_read_fd_n " \"%s\" failed", file);
+            return NGX_ERROR;
+        }
+
+        ngx_close_file(fd);
+
+        ctx->buf.start = p;
+        ctx->buf.last = p + n;
+    }
+
+    ctx->buf.pos = ctx->buf.start;
+    ctx->buf.end = ctx->buf.last;
+    ctx->buf.temporary = 1;
+
+    /* check the input once and collect the header names for the hash */
+
+    r = &ctx->r;
+
+    rc = ngx_http_parse_request_line(r, &ctx->buf);
+
+    if (rc != NGX_OK) {
+        ngx_log_error(NGX_LOG_EMERG, &ngx_bench_log, 0,
+                      "invalid request line in the benchmark input");
+        return NGX_ERROR;
+    }
+
+    ctx->headers = ctx->buf.pos;
+
+    r->state = 0;
+
+    for ( ;; ) {
+        rc = ngx_http_parse_header_line(r, &ctx->buf, 1);
+
+        if (rc == NGX_HTTP_PARSE_HEADER_DONE) {
+            break;
+        }
+
+        if (rc != NGX_OK) {
+            ngx_log_error(NGX_LOG_EMERG, &ngx_bench_log, 0,
+                          "invalid header in the benchmark input");
+            return NGX_ERROR;
+        }
+
+        if (ctx->nnames == NGX_BENCH_MAX_HEADERS) {
+            continue;
+        }
+
+        i = ctx->nnames++;
+
+        ctx->names[i].len = r->header_name_end - r->header_name_start;
+        ctx->names[i].data = ngx_pnalloc(ctx->pool, ctx->names[i].len);
+        if (ctx->names[i].data == NULL) {
+            return NGX_ERROR;
+        }
+
+        ctx->keys[i] = ngx_hash_strlow(ctx->names[i].data,
+                                       r->header_name_start,
+                                       ctx->names[i].len);
+    }
+
+    /* the known request headers as in ngx_http_init_headers_in_hash() */
+
+    for (header = ngx_http_headers_in; header->name.len; header++) {
+        ctx->hash_nelts++;
+    }
+
+    ctx->hash_names = ngx_palloc(ctx->pool,
+                                 ctx->hash_nelts * sizeof(ngx_hash_key_t));
+    if (ctx->hash_names == NULL) {
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < ctx->hash_nelts; i++) {
+        header = &ngx_http_headers_in[i];
+
+        ctx->hash_names[i].key = header->name;
+        ctx->hash_names[i].key_hash = ngx_hash_key_lc(header->name.data,
+                                                      header->name.len);
+        ctx->hash_names[i].value = header;
+    }
+
+    hash.hash = &ctx->hash;
+    hash.key = ngx_hash_key_lc;
+    hash.max_size = 512;
+    hash.bucket_size = ngx_align(64, ngx_cacheline_size);
+    hash.name = "bench_headers_in_hash";
+    hash.pool = ctx->pool;
+    hash.temp_pool = NULL;
+
+    return ngx_hash_init(&hash, ctx->hash_names, ctx->hash_nelts);
+}
+
+
+static ngx_int_t
+ngx_bench_request_line(ngx_bench_ctx_t *ctx, ngx_pool_t *pool)
+{
+    ctx->r.state = 0;
+    ctx->buf.pos = ctx->buf.start;
+
+    return ngx_http_parse_request_line(&ctx->r, &ctx->buf);
+}
+
+
+static ngx_int_t
+ngx_bench_header_lines(ngx_bench_ctx_t *ctx, ngx_pool_t *pool)
+{
+    ngx_int_t  rc;
+
+    ctx->r.state = 0;
+    ctx->buf.pos = ctx->headers;
+
+    do {
+        rc = ngx_http_parse_header_line(&ctx->r, &ctx->buf, 1);
+    } while (rc == NGX_OK);
+
+    return (rc == NGX_HTTP_PARSE_HEADER_DONE) ? NGX_OK : NGX_ERROR;
+}
+
+
+static ngx_int_t
+ngx_bench_hash_find(ngx_bench_ctx_t *ctx, ngx_pool_t *pool)
+{
+    ngx_uint_t  i;
+
+    for (i = 0; i < ctx->nnames; i++) {
+        (void) ngx_hash_find(&ctx->hash, ctx->keys[i], ctx->names[i].data,
+                             ctx->names[i].len);
+    }
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_bench_hash_init(ngx_bench_ctx_t *ctx, ngx_pool_t *pool)
+{
+    ngx_hash_t       h;
+    ngx_hash_init_t  hash;
+
+    hash.hash = &h;
+    hash.key = ngx_hash_key_lc;
+    hash.max_size = 512;
+    hash.bucket_size = ngx_align(64, ngx_cacheline_size);
+    hash.name = "bench_headers_in_hash";
+    hash.pool = pool;
+    hash.temp_pool = NULL;
+
+    return ngx_hash_init(&hash, ctx->hash_names, ctx->hash_nelts);
+}
+
+
+static ngx_int_t
+ngx_bench_sprintf(ngx_bench_ctx_t *ctx, ngx_pool_t *pool)
+{
+    u_char                 buf[NGX_MAX_ERROR_STR];
+    static ngx_str_t       addr = ngx_string("192.168.1.1");
+    static ngx_str_t       request = ngx_string("GET / HTTP/1.1");
+
+    /* a typical access log line */
+
+    (void) ngx_snprintf(buf, sizeof(buf),
+                        "%V - - [%T] \"%V\" %ui %O \"%s\" %.3f",
+                        &addr, (time_t) 1384876254, &request,
+                        (ngx_uint_t) 200, (off_t) 6120, "-", 0.042);
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_bench_connections(ngx_uint_t n)
+{
+    size_t                 start, rss;
+    ngx_uint_t             i;
+    ngx_cycle_t            cycle;
+    ngx_connection_t      *c;
+    volatile ngx_cycle_t  *old;
+
+    ngx_memzero(&cycle, sizeof(ngx_cycle_t));
+
+    cycle.log = &ngx_bench_log;
+    cycle.connection_n = n;
+
+    /* ngx_get_connection() takes the free connections from ngx_cycle */
+
+    old = ngx_cycle;
+    ngx_cycle = &cycle;
+
+    start = ngx_bench_rss();
+
+    if (ngx_event_connections_init(&cycle) != NGX_OK) {
+        return NGX_ERROR;
+    }
+
+    rss = ngx_bench_rss();
+
+    printf("\n%-20s %12s %12s %12s\n",
+           "connections", "number", "rss", "bytes/conn");
+
+    printf("%-20s %12lu %12lu %12.1f\n",
+           "free", (unsigned long) n, (unsigned long) (rss - start),
+           (double) (rss - start) / n);
+
+    for (i = 0; i < n; i++) {
+        c = ngx_get_connection((ngx_socket_t) i, &ngx_bench_log);
+        if (c == NULL) {
+            return NGX_ERROR;
+        }
+    }
+
+    rss = ngx_bench_rss();
+
+    printf("%-20s %12lu %12lu %12.1f\n",
+           "used", (unsigned long) n, (unsigned long) (rss - start),
+           (double) (rss - start) / n);
+
+    printf("sizeof: connection %lu, cold part %lu, event %lu\n",
+           (unsigned long) sizeof(ngx_connection_t),
+           (unsigned long) sizeof(ngx_connection_cold_t),
+           (unsigned long) sizeof(ngx_event_t));
+
+    ngx_free(cycle.connections);
+    ngx_free(cycle.connections_cold);
+    ngx_free(cycle.read_events);
+    ngx_free(cycle.write_events);
+
+    ngx_cycle = old;
+
+    return NGX_OK;
+}
+
+
+/* the resident set size of the process, it is taken from /proc */
+
+static size_t
+ngx_bench_rss(void)
+{
+    FILE           *f;
+    unsigned long   size, resident;
+
+    f = fopen("/proc/self/statm", "r");
+    if (f == NULL) {
+        return 0;
+    }
+
+    if (fscanf(f, "%lu %lu", &size, &resident) != 2) {
+        resident = 0;
+    }
+
+    fclose(f);
+
+    return resident * ngx_pagesize;
+}
+
+
+/* the pool blocks and the large allocations are the heap allocations */
+
+static size_t
+ngx_bench_pool_used(ngx_pool_t *pool, ngx_uint_t *nalloc)
+{
+    size_t             used;
+    ngx_pool_t        *p;
+    ngx_pool_large_t  *l;
+
+    used = 0;
+    *nalloc = 0;
+
+    for (p = pool; p; p = p->d.next) {
+        used += p->d.last - (u_char *) p;
+
+        if (p != pool) {
+            (*nalloc)++;
+        }
+    }
+
+    for (l = pool->large; l; l = l->next) {
+        if (l->alloc) {
+            (*nalloc)++;
+        }
+    }
+
+    return used;
+}
+
+
+static uint64_t
+ngx_bench_now(void)
+{
+    struct timespec  ts;
+
+    (void) clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
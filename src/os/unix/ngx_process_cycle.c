@@ -15,6 +15,8 @@ static void ngx_start_worker_processes(ngx_cycle_t *cycle, ngx_int_t n,
                                        ngx_int_t type);
 static void ngx_start_cache_manager_processes(ngx_cycle_t *cycle,
         ngx_uint_t respawn);
+static void ngx_start_health_check_process(ngx_cycle_t *cycle,
+        ngx_uint_t respawn);
 static void ngx_pass_open_channel(ngx_cycle_t *cycle, ngx_channel_t *ch);
 static void ngx_signal_worker_processes(ngx_cycle_t *cycle, int signo);
 static ngx_uint_t ngx_reap_children(ngx_cycle_t *cycle);
@@ -34,6 +36,7 @@ static void ngx_cache_loader_process_handler(ngx_event_t *ev);
 
 ngx_uint_t    ngx_process;  // nginx处理信号标志
 ngx_pid_t     ngx_pid;
+ngx_uint_t    ngx_worker;   // worker进程的序号，reuseport据此选择自己的监听socket
 ngx_uint_t    ngx_threaded;
 
 sig_atomic_t  ngx_reap;
@@ -66,11 +69,20 @@ static u_char  master_process[] = "master process";
 
 
 static ngx_cache_manager_ctx_t  ngx_cache_manager_ctx = {
-    ngx_cache_manager_process_handler, "cache manager process", 0
+    ngx_cache_manager_process_handler, "cache manager process", 0, 512
 };
 
 static ngx_cache_manager_ctx_t  ngx_cache_loader_ctx = {
-    ngx_cache_loader_process_handler, "cache loader process", 60000
+    ngx_cache_loader_process_handler, "cache loader process", 60000, 512
+};
+
+/*
+ * the handler and the number of connections are taken from the cycle
+ * before the process is spawned
+ */
+
+static ngx_cache_manager_ctx_t  ngx_health_check_ctx = {
+    NULL, "health check process", 0, 0
 };
 
 
@@ -144,6 +156,7 @@ ngx_master_process_cycle(ngx_cycle_t *cycle)
 
     // 创建缓存管理进程
     ngx_start_cache_manager_processes(cycle, 0);
+    ngx_start_health_check_process(cycle, 0);
 
     ngx_new_binary = 0;
     delay = 0;
@@ -241,6 +254,7 @@ ngx_master_process_cycle(ngx_cycle_t *cycle)
                 ngx_start_worker_processes(cycle, ccf->worker_processes,
                                            NGX_PROCESS_RESPAWN);
                 ngx_start_cache_manager_processes(cycle, 0);
+                ngx_start_health_check_process(cycle, 0);
                 ngx_noaccepting = 0;
 
                 continue;
@@ -260,6 +274,7 @@ ngx_master_process_cycle(ngx_cycle_t *cycle)
             ngx_start_worker_processes(cycle, ccf->worker_processes,
                                        NGX_PROCESS_JUST_RESPAWN);
             ngx_start_cache_manager_processes(cycle, 1);
+            ngx_start_health_check_process(cycle, 1);
 
             /* allow new processes to start */
             ngx_msleep(100);
@@ -274,6 +289,7 @@ ngx_master_process_cycle(ngx_cycle_t *cycle)
             ngx_start_worker_processes(cycle, ccf->worker_processes,
                                        NGX_PROCESS_RESPAWN);
             ngx_start_cache_manager_processes(cycle, 0);
+            ngx_start_health_check_process(cycle, 0);
             live = 1;
         }
 
@@ -304,13 +320,18 @@ ngx_master_process_cycle(ngx_cycle_t *cycle)
 void
 ngx_single_process_cycle(ngx_cycle_t *cycle)
 {
-    ngx_uint_t  i;
+    ngx_uint_t        i;
+    ngx_core_conf_t  *ccf;
 
     if (ngx_set_environment(cycle, NULL) == NULL) {
         /* fatal */
         exit(2);
     }
 
+    ccf = (ngx_core_conf_t *) ngx_get_conf(cycle->conf_ctx, ngx_core_module);
+
+    ngx_pool_cache_init((ngx_uint_t) ccf->pool_cache);
+
     for (i = 0; ngx_modules[i]; i++) {
         if (ngx_modules[i]->init_process) {
             if (ngx_modules[i]->init_process(cycle) == NGX_ERROR) {
@@ -385,7 +406,7 @@ ngx_start_worker_processes(ngx_cycle_t *cycle, ngx_int_t n, ngx_int_t type)
 static void
 ngx_start_cache_manager_processes(ngx_cycle_t *cycle, ngx_uint_t respawn)
 {
-    ngx_uint_t       i, manager, loader;
+    ngx_uint_t       i, n, manager, loader;
     ngx_path_t     **path;
     ngx_channel_t    ch;
 
@@ -399,8 +420,8 @@ ngx_start_cache_manager_processes(ngx_cycle_t *cycle, ngx_uint_t respawn)
             manager = 1;
         }
 
-        if (path[i]->loader) {
-            loader = 1;
+        if (path[i]->loader && path[i]->loaders > loader) {
+            loader = path[i]->loaders;
         }
     }
 
@@ -419,13 +440,49 @@ ngx_start_cache_manager_processes(ngx_cycle_t *cycle, ngx_uint_t respawn)
 
     ngx_pass_open_channel(cycle, &ch);
 
-    if (loader == 0) {
+    /* a loader process inherits its number in ngx_worker */
+
+    for (n = 0; n < loader; n++) {
+        ngx_worker = n;
+
+        ngx_spawn_process(cycle, ngx_cache_manager_process_cycle,
+                          &ngx_cache_loader_ctx, "cache loader process",
+                          respawn ? NGX_PROCESS_JUST_SPAWN:
+                                    NGX_PROCESS_NORESPAWN);
+
+        ch.command = NGX_CMD_OPEN_CHANNEL;
+        ch.pid = ngx_processes[ngx_process_slot].pid;
+        ch.slot = ngx_process_slot;
+        ch.fd = ngx_processes[ngx_process_slot].channel[0];
+
+        ngx_pass_open_channel(cycle, &ch);
+    }
+
+    ngx_worker = 0;
+}
+
+
+static void
+ngx_start_health_check_process(ngx_cycle_t *cycle, ngx_uint_t respawn)
+{
+    ngx_channel_t  ch;
+
+    if (cycle->health_check == NULL) {
         return;
     }
 
+    ngx_health_check_ctx.handler = cycle->health_check;
+
+    /*
+     * a checked peer holds at most one connection at a time,
+     * the rest is left for the channel and the resolver
+     */
+
+    ngx_health_check_ctx.connections = cycle->health_check_peers + 32;
+
     ngx_spawn_process(cycle, ngx_cache_manager_process_cycle,
-                      &ngx_cache_loader_ctx, "cache loader process",
-                      respawn ? NGX_PROCESS_JUST_SPAWN : NGX_PROCESS_NORESPAWN);
+                      &ngx_health_check_ctx, "health check process",
+                      respawn ? NGX_PROCESS_JUST_RESPAWN : NGX_PROCESS_RESPAWN);
 
     ch.command = NGX_CMD_OPEN_CHANNEL;
     ch.pid = ngx_processes[ngx_process_slot].pid;
@@ -738,6 +795,7 @@ ngx_worker_process_cycle(ngx_cycle_t *cycle, void *data)
     ngx_connection_t  *c;
 
     ngx_process = NGX_PROCESS_WORKER;
+    ngx_worker = worker;
 
     ngx_worker_process_init(cycle, worker);
 
@@ -805,8 +863,7 @@ ngx_worker_process_cycle(ngx_cycle_t *cycle, void *data)
                 }
             }
 
-            if (ngx_event_timer_rbtree.root == ngx_event_timer_rbtree.sentinel)
-            {
+            if (ngx_event_timers_empty()) {
                 ngx_log_error(NGX_LOG_NOTICE, cycle->log, 0, "exiting");
 
                 ngx_worker_process_exit(cycle);
@@ -961,6 +1018,10 @@ ngx_worker_process_init(ngx_cycle_t *cycle, ngx_int_t worker)
                       "sigprocmask() failed");
     }
 
+    /* the workers must not share the random sequence of the master */
+
+    srandom(((unsigned) ngx_pid << 16) ^ (unsigned) ngx_time());
+
     /*
      * disable deleting previous events for the listening sockets because
      * in the worker processes there are no events at all at this point
@@ -970,6 +1031,10 @@ ngx_worker_process_init(ngx_cycle_t *cycle, ngx_int_t worker)
         ls[i].previous = NULL;
     }
 
+    /* the pool sizes to cache are registered by the modules' init_process */
+
+    ngx_pool_cache_init(worker >= 0 ? (ngx_uint_t) ccf->pool_cache : 0);
+
     for (i = 0; ngx_modules[i]; i++) {
         if (ngx_modules[i]->init_process) {
             if (ngx_modules[i]->init_process(cycle) == NGX_ERROR) {
@@ -1036,6 +1101,10 @@ ngx_worker_process_exit(ngx_cycle_t *cycle)
         }
     }
 
+    /* return the cached blocks and remove them from the shared statistics */
+
+    ngx_pool_cache_init(0);
+
     if (ngx_exiting) {
         c = cycle->connections;
         for (i = 0; i < cycle->connection_n; i++) {
@@ -1316,7 +1385,7 @@ ngx_cache_manager_process_cycle(ngx_cycle_t *cycle, void *data)
     ngx_close_listening_sockets(cycle);
 
     /* Set a moderate number of connections for a helper process. */
-    cycle->connection_n = 512;
+    cycle->connection_n = ctx->connections;
 
     ngx_worker_process_init(cycle, -1);
 
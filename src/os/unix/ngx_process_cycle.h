@@ -32,6 +32,7 @@ typedef struct {
     ngx_event_handler_pt       handler;
     char                      *name;
     ngx_msec_t                 delay;
+    ngx_uint_t                 connections;
 } ngx_cache_manager_ctx_t;
 
 
@@ -41,6 +42,7 @@ void ngx_single_process_cycle(ngx_cycle_t *cycle);
 
 extern ngx_uint_t      ngx_process;
 extern ngx_pid_t       ngx_pid;
+extern ngx_uint_t      ngx_worker;
 extern ngx_pid_t       ngx_new_binary;
 extern ngx_uint_t      ngx_inherited;
 extern ngx_uint_t      ngx_daemonized;
@@ -125,4 +125,32 @@ ngx_int_t ngx_cond_signal(ngx_cond_t *cv);
 #endif
 
 
+#if (NGX_THREAD_POOL)
+
+/*
+ * the thread pools run in ordinary single-threaded workers and do not
+ * depend on NGX_THREADS, so they have their own pthread primitives
+ */
+
+#include <pthread.h>
+
+typedef pthread_mutex_t  ngx_thread_mutex_t;
+
+ngx_int_t ngx_thread_mutex_create(ngx_thread_mutex_t *mtx, ngx_log_t *log);
+ngx_int_t ngx_thread_mutex_destroy(ngx_thread_mutex_t *mtx, ngx_log_t *log);
+ngx_int_t ngx_thread_mutex_lock(ngx_thread_mutex_t *mtx, ngx_log_t *log);
+ngx_int_t ngx_thread_mutex_unlock(ngx_thread_mutex_t *mtx, ngx_log_t *log);
+
+
+typedef pthread_cond_t  ngx_thread_cond_t;
+
+ngx_int_t ngx_thread_cond_create(ngx_thread_cond_t *cond, ngx_log_t *log);
+ngx_int_t ngx_thread_cond_destroy(ngx_thread_cond_t *cond, ngx_log_t *log);
+ngx_int_t ngx_thread_cond_signal(ngx_thread_cond_t *cond, ngx_log_t *log);
+ngx_int_t ngx_thread_cond_wait(ngx_thread_cond_t *cond,
+    ngx_thread_mutex_t *mtx, ngx_log_t *log);
+
+#endif
+
+
 #endif /* _NGX_THREAD_H_INCLUDED_ */